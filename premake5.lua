@@ -1,3 +1,9 @@
+newoption
+{
+    trigger = "avx2",
+    description = "Use AVX2 and FMA, the binary only runs on CPUs that have both"
+}
+
 workspace "Sand"
     architecture "x64"
     startproject "Sand"
@@ -48,7 +54,8 @@ project "Sand"
         "src/**.c",
         --Resources
         "res/shaders/**.vert",
-        "res/shaders/**.frag"
+        "res/shaders/**.frag",
+        "res/shaders/**.comp"
     }
 
     links
@@ -69,6 +76,13 @@ project "Sand"
         "MINIMAL_PLATFORM_WINDOWS"
     }
 
+    -- x64 builds for SSE2, the AVX2 paths of skinning, culling and occlusion are opt-in
+    filter "options:avx2"
+        vectorextensions "AVX2"
+
+    filter { "options:avx2", "toolset:gcc or clang" }
+        buildoptions { "-mfma" }
+
     filter "system:linux"
         links { "dl", "pthread" }
         defines { "_X11" }
@@ -0,0 +1,84 @@
+#version 430 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoords;
+layout (location = 2) in vec3 aNormal;
+layout (location = 3) in uvec4 aJoints;
+layout (location = 4) in vec4  aWeights;
+
+// per instance
+layout (location = 5) in mat4 aTransform;
+layout (location = 9) in vec4 aClip;    // first frame, frame count, frame rate, frame offset
+layout (location = 10) in mat3 aNormalMatrix;
+
+out vec2 TexCoords;
+out vec3 Normal;
+flat out vec4 BaseColor;
+flat out uint Layer;
+
+layout (std140) uniform Scene
+{
+    mat4 proj;
+    mat4 view;
+    float time;
+};
+
+layout (std140) uniform Draw
+{
+    mat4 model;
+    uint material;
+    mat3 normalMatrix;
+};
+
+struct Material
+{
+    vec4 baseColor;
+    uint layer;
+};
+
+layout (std430, binding = 8) readonly buffer Materials
+{
+    Material materials[];
+};
+
+// three texels per joint, one row per frame
+uniform sampler2D bakedJoints;
+
+mat4x3 getBakedTransform(int frame, uint joint)
+{
+    int x = int(joint) * 3;
+    return transpose(mat3x4(
+        texelFetch(bakedJoints, ivec2(x, frame), 0),
+        texelFetch(bakedJoints, ivec2(x + 1, frame), 0),
+        texelFetch(bakedJoints, ivec2(x + 2, frame), 0)));
+}
+
+void main()
+{
+    float frame = mod(time * aClip.z + aClip.w, aClip.y);
+    float alpha = fract(frame);
+
+    int frame0 = int(aClip.x + floor(frame));
+    int frame1 = int(aClip.x + mod(floor(frame) + 1.0, aClip.y));
+
+    vec3 totalPos = vec3(0.0);
+    vec3 totalNormal = vec3(0.0);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        mat4x3 t0 = getBakedTransform(frame0, aJoints[i]);
+        mat4x3 t1 = getBakedTransform(frame1, aJoints[i]);
+        mat4x3 jointTransform = t0 + (t1 - t0) * alpha;
+
+        totalPos += jointTransform * vec4(aPos, 1.0) * aWeights[i];
+        totalNormal += jointTransform * vec4(aNormal, 0.0) * aWeights[i];
+    }
+
+    mat4 world = aTransform * model;
+    gl_Position = proj * view * world * vec4(totalPos, 1.0);
+
+    TexCoords = aTexCoords;
+    BaseColor = materials[material].baseColor;
+    Layer = materials[material].layer;
+    Normal = aNormalMatrix * (normalMatrix * totalNormal);
+}
@@ -1,14 +1,15 @@
-#version 330 core
+#version 430 core
 
 in vec2 TexCoords;
 in vec3 Normal;
+flat in vec4 BaseColor;
+flat in uint Layer;
 
 out vec4 FragColor;
 
-uniform sampler2D baseTexture;
-uniform vec3 baseColor = vec3(0.4);
+uniform sampler2DArray baseTexture;  // one layer per base texture of the material set
 
 void main()
 {
-    FragColor = vec4(baseColor, 1.0) * texture(baseTexture, TexCoords);
+    FragColor = vec4(BaseColor.rgb, 1.0) * texture(baseTexture, vec3(TexCoords, float(Layer)));
 }
\ No newline at end of file
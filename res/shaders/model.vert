@@ -1,4 +1,4 @@
-#version 330 core
+#version 430 core
 
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
@@ -6,17 +6,40 @@ layout (location = 2) in vec3 aNormal;
 layout (location = 3) in uvec4 aJoints;
 layout (location = 4) in vec4  aWeights;
 
+// per instance
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in uint aMaterial;
+layout (location = 12) in mat3 aNormalMatrix;
+
 out vec2 TexCoords;
 out vec3 Normal;
+flat out vec4 BaseColor;
+flat out uint Layer;
+
+layout (std140) uniform Scene
+{
+    mat4 proj;
+    mat4 view;
+    float time;
+};
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+struct Material
+{
+    vec4 baseColor;
+    uint layer;
+};
+
+layout (std430, binding = 8) readonly buffer Materials
+{
+    Material materials[];
+};
 
 void main()
 {
-    gl_Position = proj * view * model * vec4(aPos, 1.0);
+    gl_Position = proj * view * aModel * vec4(aPos, 1.0);
 
     TexCoords = aTexCoords;
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    BaseColor = materials[aMaterial].baseColor;
+    Layer = materials[aMaterial].layer;
+    Normal = aNormalMatrix * aNormal;
 }
\ No newline at end of file
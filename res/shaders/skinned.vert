@@ -1,6 +1,4 @@
-#version 330 core
-
-const int MAX_JOINTS = 32;
+#version 430 core
 
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
@@ -8,30 +6,111 @@ layout (location = 2) in vec3 aNormal;
 layout (location = 3) in uvec4 aJoints;
 layout (location = 4) in vec4  aWeights;
 
+// per instance
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in uint aMaterial;
+layout (location = 10) in int aJointOffset;    // first row of the palette
+#ifdef DUAL_QUATERNION
+layout (location = 11) in float aJointScale;
+#endif
+layout (location = 12) in mat3 aNormalMatrix;
+
 out vec2 TexCoords;
 out vec3 Normal;
+flat out vec4 BaseColor;
+flat out uint Layer;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+layout (std140) uniform Scene
+{
+    mat4 proj;
+    mat4 view;
+    float time;
+};
 
-uniform mat4 jointTransforms[MAX_JOINTS];
+struct Material
+{
+    vec4 baseColor;
+    uint layer;
+};
 
-void main()
+layout (std430, binding = 8) readonly buffer Materials
+{
+    Material materials[];
+};
+
+// three rows of the affine joint transform per joint,
+// or real and dual part of the joint dual quaternion with DUAL_QUATERNION
+layout (std430, binding = 0) readonly buffer JointPalette
+{
+    vec4 jointRows[];
+};
+
+#ifdef DUAL_QUATERNION
+
+void skin(out vec3 pos, out vec3 normal)
+{
+    uint base = uint(aJointOffset);
+
+    vec4 real0 = jointRows[base + aJoints[0] * 2u];
+
+    vec4 real = vec4(0.0);
+    vec4 dual = vec4(0.0);
+    for (int i = 0; i < 4; ++i)
+    {
+        uint index = base + aJoints[i] * 2u;
+        vec4 r = jointRows[index];
+
+        // blend in the hemisphere of the first influence
+        float w = dot(real0, r) < 0.0 ? -aWeights[i] : aWeights[i];
+        real += r * w;
+        dual += jointRows[index + 1u] * w;
+    }
+
+    float len = length(real);
+    real /= len;
+    dual /= len;
+
+    pos = aPos * aJointScale;
+    pos += 2.0 * cross(real.xyz, cross(real.xyz, pos) + real.w * pos);
+    pos += 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+
+    normal = aNormal + 2.0 * cross(real.xyz, cross(real.xyz, aNormal) + real.w * aNormal);
+}
+
+#else
+
+mat4x3 getJointTransform(uint joint)
+{
+    uint i = uint(aJointOffset) + joint * 3u;
+    return transpose(mat3x4(jointRows[i], jointRows[i + 1u], jointRows[i + 2u]));
+}
+
+void skin(out vec3 pos, out vec3 normal)
 {
-    vec4 totalPos = vec4(0.0);
-    vec4 totalNormal = vec4(0.0);
+    pos = vec3(0.0);
+    normal = vec3(0.0);
 
     for (int i = 0; i < 4; ++i)
     {
-        mat4 jointTransform = jointTransforms[aJoints[i]];
-        totalPos += jointTransform * vec4(aPos, 1.0) * aWeights[i];
+        mat4x3 jointTransform = getJointTransform(aJoints[i]);
+        pos += jointTransform * vec4(aPos, 1.0) * aWeights[i];
 
-        totalNormal += jointTransform * vec4(aNormal, 0.0) * aWeights[i];
+        normal += jointTransform * vec4(aNormal, 0.0) * aWeights[i];
     }
+}
+
+#endif
+
+void main()
+{
+    vec3 pos;
+    vec3 normal;
+    skin(pos, normal);
 
-    gl_Position = proj * view * model * totalPos;
+    gl_Position = proj * view * aModel * vec4(pos, 1.0);
 
     TexCoords = aTexCoords;
-    Normal = mat3(transpose(inverse(model))) * totalNormal.xyz;
-}
\ No newline at end of file
+    BaseColor = materials[aMaterial].baseColor;
+    Layer = materials[aMaterial].layer;
+    Normal = aNormalMatrix * normal;
+}
@@ -0,0 +1,39 @@
+#include "gpu_timer.h"
+
+void gpuTimerCreate(GpuTimer* timer)
+{
+    glGenQueries(GPU_TIMER_QUERIES, timer->queries);
+    timer->frame = 0;
+    timer->elapsed = 0.0;
+}
+
+void gpuTimerDestroy(GpuTimer* timer)
+{
+    glDeleteQueries(GPU_TIMER_QUERIES, timer->queries);
+}
+
+void gpuTimerBegin(GpuTimer* timer)
+{
+    GLuint query = timer->queries[timer->frame % GPU_TIMER_QUERIES];
+
+    // collect the result of the query issued GPU_TIMER_QUERIES frames ago
+    if (timer->frame >= GPU_TIMER_QUERIES)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+            timer->elapsed = (double)nanoseconds * 1e-6;
+        }
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void gpuTimerEnd(GpuTimer* timer)
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    timer->frame++;
+}
@@ -0,0 +1,26 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <ignis/ignis.h>
+
+/*
+ * Measures GPU time between begin and end with GL_TIME_ELAPSED queries.
+ * Results are read a few frames later to avoid stalling the pipeline.
+ */
+#define GPU_TIMER_QUERIES 4
+
+typedef struct
+{
+    GLuint queries[GPU_TIMER_QUERIES];
+    uint32_t frame;
+
+    double elapsed; /* milliseconds of the latest finished query */
+} GpuTimer;
+
+void gpuTimerCreate(GpuTimer* timer);
+void gpuTimerDestroy(GpuTimer* timer);
+
+void gpuTimerBegin(GpuTimer* timer);
+void gpuTimerEnd(GpuTimer* timer);
+
+#endif /* !GPU_TIMER_H */
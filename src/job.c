@@ -0,0 +1,368 @@
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#endif
+
+#include "job.h"
+
+#include <stdlib.h>
+
+/*
+ * --------------------------------------------------------------
+ *                          platform
+ * --------------------------------------------------------------
+ */
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+typedef HANDLE JobThread;
+
+#define jobAtomicAdd(p, v)      (InterlockedExchangeAdd((volatile LONG*)(p), (v)) + (v))
+#define jobAtomicLoad(p)        InterlockedOr((volatile LONG*)(p), 0)
+#define jobAtomicStore(p, v)    InterlockedExchange((volatile LONG*)(p), (v))
+#define jobAtomicExchange(p, v) InterlockedExchange((volatile LONG*)(p), (v))
+#define jobYield()              SwitchToThread()
+
+static DWORD WINAPI jobWorkerMain(LPVOID arg);
+
+static int jobThreadStart(JobThread* thread, void* arg)
+{
+    *thread = CreateThread(NULL, 0, jobWorkerMain, arg, 0, NULL);
+    return *thread != NULL;
+}
+
+static void jobThreadJoin(JobThread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static void* jobMutexCreate()
+{
+    CRITICAL_SECTION* mutex = malloc(sizeof(CRITICAL_SECTION));
+    if (mutex) InitializeCriticalSection(mutex);
+    return mutex;
+}
+
+static void jobMutexDestroy(void* mutex)   { DeleteCriticalSection(mutex); free(mutex); }
+static void jobMutexLock(void* mutex)      { EnterCriticalSection(mutex); }
+static void jobMutexUnlock(void* mutex)    { LeaveCriticalSection(mutex); }
+
+static void* jobCondCreate()
+{
+    CONDITION_VARIABLE* cond = malloc(sizeof(CONDITION_VARIABLE));
+    if (cond) InitializeConditionVariable(cond);
+    return cond;
+}
+
+static void jobCondDestroy(void* cond)              { free(cond); }
+static void jobCondWait(void* cond, void* mutex)    { SleepConditionVariableCS(cond, mutex, INFINITE); }
+static void jobCondBroadcast(void* cond)            { WakeAllConditionVariable(cond); }
+
+static uint32_t jobCoreCount()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (uint32_t)info.dwNumberOfProcessors;
+}
+
+double jobTimerNow()
+{
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+#else
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef pthread_t JobThread;
+
+#define jobAtomicAdd(p, v)      __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define jobAtomicLoad(p)        __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define jobAtomicStore(p, v)    __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define jobAtomicExchange(p, v) __atomic_exchange_n((p), (v), __ATOMIC_ACQUIRE)
+#define jobYield()              sched_yield()
+
+static void* jobWorkerMain(void* arg);
+
+static int jobThreadStart(JobThread* thread, void* arg)
+{
+    return pthread_create(thread, NULL, jobWorkerMain, arg) == 0;
+}
+
+static void jobThreadJoin(JobThread thread)
+{
+    pthread_join(thread, NULL);
+}
+
+static void* jobMutexCreate()
+{
+    pthread_mutex_t* mutex = malloc(sizeof(pthread_mutex_t));
+    if (mutex) pthread_mutex_init(mutex, NULL);
+    return mutex;
+}
+
+static void jobMutexDestroy(void* mutex)   { pthread_mutex_destroy(mutex); free(mutex); }
+static void jobMutexLock(void* mutex)      { pthread_mutex_lock(mutex); }
+static void jobMutexUnlock(void* mutex)    { pthread_mutex_unlock(mutex); }
+
+static void* jobCondCreate()
+{
+    pthread_cond_t* cond = malloc(sizeof(pthread_cond_t));
+    if (cond) pthread_cond_init(cond, NULL);
+    return cond;
+}
+
+static void jobCondDestroy(void* cond)              { pthread_cond_destroy(cond); free(cond); }
+static void jobCondWait(void* cond, void* mutex)    { pthread_cond_wait(cond, mutex); }
+static void jobCondBroadcast(void* cond)            { pthread_cond_broadcast(cond); }
+
+static uint32_t jobCoreCount()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+}
+
+double jobTimerNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+#endif
+
+/*
+ * --------------------------------------------------------------
+ *                          queue
+ * --------------------------------------------------------------
+ */
+typedef struct
+{
+    JobFunc func;
+    void* data;
+    size_t begin;
+    size_t end;
+    volatile int32_t* counter;
+} Job;
+
+struct JobQueue
+{
+    Job jobs[JOB_QUEUE_CAPACITY];
+    size_t head; /* thieves take from here */
+    size_t tail; /* the owner pushes and pops here */
+    volatile int32_t lock;
+};
+
+struct JobWorker
+{
+    JobPool* pool;
+    uint32_t index;
+    JobThread thread;
+};
+
+static void jobQueueLock(JobQueue* queue)
+{
+    while (jobAtomicExchange(&queue->lock, 1))
+        while (jobAtomicLoad(&queue->lock)) jobYield();
+}
+
+static void jobQueueUnlock(JobQueue* queue)
+{
+    jobAtomicStore(&queue->lock, 0);
+}
+
+static int jobQueuePush(JobQueue* queue, Job job)
+{
+    jobQueueLock(queue);
+    int pushed = queue->tail - queue->head < JOB_QUEUE_CAPACITY;
+    if (pushed) queue->jobs[queue->tail++ % JOB_QUEUE_CAPACITY] = job;
+    jobQueueUnlock(queue);
+    return pushed;
+}
+
+static int jobQueuePop(JobQueue* queue, Job* job)
+{
+    jobQueueLock(queue);
+    int popped = queue->tail > queue->head;
+    if (popped) *job = queue->jobs[--queue->tail % JOB_QUEUE_CAPACITY];
+    jobQueueUnlock(queue);
+    return popped;
+}
+
+static int jobQueueSteal(JobQueue* queue, Job* job)
+{
+    jobQueueLock(queue);
+    int stolen = queue->tail > queue->head;
+    if (stolen) *job = queue->jobs[queue->head++ % JOB_QUEUE_CAPACITY];
+    jobQueueUnlock(queue);
+    return stolen;
+}
+
+static void jobRun(Job job, uint32_t thread)
+{
+    job.func(job.data, job.begin, job.end, thread);
+    jobAtomicAdd(job.counter, -1);
+}
+
+/* Runs one job from the own queue or stolen from another one */
+static int jobExecuteOne(JobPool* pool, uint32_t self)
+{
+    uint32_t queue_count = pool->worker_count + 1;
+
+    Job job;
+    int found = jobQueuePop(&pool->queues[self], &job);
+    for (uint32_t i = 1; !found && i < queue_count; ++i)
+        found = jobQueueSteal(&pool->queues[(self + i) % queue_count], &job);
+
+    if (!found) return 0;
+
+    jobAtomicAdd(&pool->pending, -1);
+    jobRun(job, self);
+    return 1;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI jobWorkerMain(LPVOID arg)
+#else
+static void* jobWorkerMain(void* arg)
+#endif
+{
+    JobWorker* worker = arg;
+    JobPool* pool = worker->pool;
+
+    while (jobAtomicLoad(&pool->running))
+    {
+        if (jobExecuteOne(pool, worker->index)) continue;
+
+        jobMutexLock(pool->sleep_mutex);
+        while (jobAtomicLoad(&pool->pending) <= 0 && jobAtomicLoad(&pool->running))
+            jobCondWait(pool->sleep_cond, pool->sleep_mutex);
+        jobMutexUnlock(pool->sleep_mutex);
+    }
+
+    return 0;
+}
+
+/*
+ * --------------------------------------------------------------
+ *                          pool
+ * --------------------------------------------------------------
+ */
+int jobPoolCreate(JobPool* pool, uint32_t worker_count)
+{
+    if (worker_count == 0)
+    {
+        uint32_t cores = jobCoreCount();
+        worker_count = cores > 1 ? cores - 1 : 0;
+    }
+
+    pool->worker_count = worker_count;
+    pool->pending = 0;
+    pool->running = 1;
+
+    pool->queues = calloc(worker_count + 1, sizeof(JobQueue));
+    pool->workers = calloc(worker_count + 1, sizeof(JobWorker));
+    pool->sleep_mutex = jobMutexCreate();
+    pool->sleep_cond = jobCondCreate();
+
+    if (!pool->queues || !pool->workers || !pool->sleep_mutex || !pool->sleep_cond)
+    {
+        pool->worker_count = 0;
+        jobPoolDestroy(pool);
+        return 0;
+    }
+
+    // queue 0 belongs to the submitting thread
+    for (uint32_t i = 1; i <= worker_count; ++i)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        if (!jobThreadStart(&pool->workers[i].thread, &pool->workers[i]))
+        {
+            pool->worker_count = i - 1;
+            break;
+        }
+    }
+
+    return 1;
+}
+
+void jobPoolDestroy(JobPool* pool)
+{
+    if (pool->sleep_mutex)
+    {
+        jobMutexLock(pool->sleep_mutex);
+        jobAtomicStore(&pool->running, 0);
+        jobCondBroadcast(pool->sleep_cond);
+        jobMutexUnlock(pool->sleep_mutex);
+    }
+
+    for (uint32_t i = 1; i <= pool->worker_count; ++i)
+        jobThreadJoin(pool->workers[i].thread);
+
+    if (pool->sleep_mutex) jobMutexDestroy(pool->sleep_mutex);
+    if (pool->sleep_cond)  jobCondDestroy(pool->sleep_cond);
+
+    free(pool->queues);
+    free(pool->workers);
+
+    pool->queues = NULL;
+    pool->workers = NULL;
+    pool->sleep_mutex = NULL;
+    pool->sleep_cond = NULL;
+    pool->worker_count = 0;
+}
+
+uint32_t jobPoolThreadCount(const JobPool* pool)
+{
+    return pool ? pool->worker_count + 1 : 1;
+}
+
+void jobPoolParallelFor(JobPool* pool, size_t count, size_t batch, JobFunc func, void* data)
+{
+    if (!count) return;
+    if (!batch) batch = 1;
+
+    size_t job_count = (count + batch - 1) / batch;
+    if (!pool || !pool->worker_count || job_count == 1)
+    {
+        func(data, 0, count, 0);
+        return;
+    }
+
+    volatile int32_t counter = (int32_t)job_count;
+    uint32_t queue_count = pool->worker_count + 1;
+
+    for (size_t i = 0; i < job_count; ++i)
+    {
+        size_t begin = i * batch;
+        size_t end = begin + batch < count ? begin + batch : count;
+
+        Job job = { func, data, begin, end, &counter };
+
+        // spread the batches over all queues, idle workers steal the rest
+        jobAtomicAdd(&pool->pending, 1);
+        if (!jobQueuePush(&pool->queues[i % queue_count], job))
+        {
+            jobAtomicAdd(&pool->pending, -1);
+            jobRun(job, 0);
+        }
+    }
+
+    jobMutexLock(pool->sleep_mutex);
+    jobCondBroadcast(pool->sleep_cond);
+    jobMutexUnlock(pool->sleep_mutex);
+
+    while (jobAtomicLoad(&counter) > 0)
+    {
+        if (!jobExecuteOne(pool, 0)) jobYield();
+    }
+}
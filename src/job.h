@@ -0,0 +1,53 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * --------------------------------------------------------------
+ *                          job pool
+ * --------------------------------------------------------------
+ * Small work-stealing thread pool. Every worker (and the submitting
+ * thread) owns a deque of jobs: the owner pops from the back, idle
+ * workers steal from the front of other deques.
+ */
+#define JOB_QUEUE_CAPACITY 1024
+
+/* thread is below jobPoolThreadCount and 0 on the submitting thread, jobs use it to pick per thread scratch memory */
+typedef void (*JobFunc)(void* data, size_t begin, size_t end, uint32_t thread);
+
+typedef struct JobQueue JobQueue;
+typedef struct JobWorker JobWorker;
+
+typedef struct
+{
+    JobQueue* queues;   /* one per worker plus one for the submitting thread */
+    JobWorker* workers;
+    uint32_t worker_count;
+
+    volatile int32_t pending;
+    volatile int32_t running;
+
+    void* sleep_mutex;
+    void* sleep_cond;
+} JobPool;
+
+/* worker_count == 0 uses one worker per core minus the submitting thread */
+int  jobPoolCreate(JobPool* pool, uint32_t worker_count);
+void jobPoolDestroy(JobPool* pool);
+
+/* Number of threads taking part in a parallel for (workers + caller) */
+uint32_t jobPoolThreadCount(const JobPool* pool);
+
+/*
+ * Splits [0, count) into ranges of at most batch elements and runs func on
+ * them in parallel. Returns when every range has been processed. The calling
+ * thread helps with the work. pool may be NULL to run serially.
+ */
+void jobPoolParallelFor(JobPool* pool, size_t count, size_t batch, JobFunc func, void* data);
+
+/* Monotonic time in seconds, used to profile jobs */
+double jobTimerNow();
+
+#endif /* !JOB_H */
@@ -3,6 +3,10 @@
 #include "math/math.h"
 #include "camera.h"
 #include "model/model.h"
+#include "job.h"
+#include "gpu_timer.h"
+#include "stream_buffer.h"
+#include "shader_cache.h"
 
 #include "nuklear_glfw_gl3.h"
 
@@ -31,6 +35,8 @@ Camera camera = { 0 };
 
 IgnisShader shader_model;
 IgnisShader shader_skinned;
+IgnisShader shader_skinned_dq;
+IgnisShader shader_baked;
 
 int paused = 0;
 
@@ -39,6 +45,31 @@ AnimationList animations = { 0 };
 size_t animation_count = 0;
 size_t animation_index = 0;
 
+JobPool jobs = { 0 };
+AnimationWorld world = { 0 };
+JointPaletteBuffer palette_buffer = { 0 };
+SkinningBuffer skinning_buffer = { 0 };
+BakedAnimation baked_animation = { 0 };
+BakedCrowd baked_crowd = { 0 };
+float baked_time = 0.0f;
+int use_baked = 0;
+size_t nodes_updated = 0;
+GpuTimer skinning_timer = { 0 };
+size_t dq_fallbacks = 0;
+int crowd_size = 1;
+float crossfade_time = ANIMATION_CROSSFADE;
+int threaded = 1;
+DrawList draw_list = { 0 };
+int bvh_culling = 1;
+OcclusionBuffer occlusion = { 0 };
+int occlusion_culling = 1;
+int picked_instance = -1;
+mat4 inv_view_proj;
+JointMask layer_mask = { 0 };
+int masked_layer = 0;
+StreamBuffer stream_buffer = { 0 };
+ShaderCache shader_cache = { 0 };
+
 static void setViewport(float w, float h)
 {
     width = w;
@@ -47,6 +78,120 @@ static void setViewport(float w, float h)
     screen_projection = mat4_ortho(0.0f, w, h, 0.0f, -1.0f, 1.0f);
 }
 
+static vec3 unprojectPoint(mat4 m, float x, float y, float z)
+{
+    float w = m.v[0][3] * x + m.v[1][3] * y + m.v[2][3] * z + m.v[3][3];
+    return vec3_mult(mat4_transform_point(m, (vec3){ x, y, z }), 1.0f / w);
+}
+
+static const Animation* getCurrentAnimation()
+{
+    return animation_index < animations.count ? &animations.data[animation_index] : NULL;
+}
+
+#define BAKED_ANIMATION_PATH "baked_animation.bake"
+
+/* A saved bake is only reused if it was made from the same skeleton, clips and frame rate */
+static int loadBakedAnimationForModel()
+{
+    if (!loadBakedAnimation(&baked_animation, BAKED_ANIMATION_PATH)) return IGNIS_FAILURE;
+
+    int match = baked_animation.joint_count == model.joint_count && baked_animation.clip_count == animations.count
+             && baked_animation.source_hash == getBakedAnimationHash(&model, &animations, BAKED_ANIMATION_FRAME_RATE);
+
+    if (!match)
+    {
+        MINIMAL_WARN("[Baked] %s does not match the model, baking again", BAKED_ANIMATION_PATH);
+        destroyBakedAnimation(&baked_animation);
+        return IGNIS_FAILURE;
+    }
+    return IGNIS_SUCCESS;
+}
+
+/* Guesses the upper body: the child of the first branching joint with the highest influenced vertices (gltf is y up) */
+static uint32_t findUpperBodyJoint(const Model* model)
+{
+    for (uint32_t i = 0; i < model->joint_count; ++i)
+    {
+        uint32_t best = HIERARCHY_ROOT;
+        float best_y = 0.0f;
+        size_t children = 0;
+
+        // joints are depth sorted, children come after their parent
+        for (uint32_t c = i + 1; c < model->joint_count; ++c)
+        {
+            if (model->joints[c] != i) continue;
+            children++;
+
+            aabb bounds = model->joint_bounds[c];
+            if (bounds.min.y > bounds.max.y) continue;
+
+            float y = 0.5f * (bounds.min.y + bounds.max.y);
+            if (best == HIERARCHY_ROOT || y > best_y)
+            {
+                best = c;
+                best_y = y;
+            }
+        }
+
+        if (children > 1 && best != HIERARCHY_ROOT) return best;
+    }
+    return HIERARCHY_ROOT;
+}
+
+/* The upper body plays the next clip on top of whatever the whole body plays, fades out when disabled */
+static void updateMaskedLayers()
+{
+    if (!layer_mask.count || animations.count < 2) return;
+
+    const Animation* clip = &animations.data[(animation_index + 1) % animations.count];
+    for (size_t i = 0; i < world.instance_count; ++i)
+        fadeMaskedLayer(&world.instances[i].blend, clip, &layer_mask, masked_layer ? 1.0f : 0.0f, crossfade_time);
+}
+
+/* Places crowd_size x crowd_size instances of the skinned model on a grid */
+static void populateAnimationWorld()
+{
+    clearAnimationWorld(&world);
+    clearBakedCrowd(&baked_crowd);
+    picked_instance = -1;
+    if (!model.joint_count) return;
+
+    vec3 min = { 0 }, max = { 0 };
+    for (size_t i = 0; i < model.mesh_count; ++i)
+    {
+        min.x = fminf(min.x, model.meshes[i].min.x);
+        min.y = fminf(min.y, model.meshes[i].min.y);
+        max.x = fmaxf(max.x, model.meshes[i].max.x);
+        max.y = fmaxf(max.y, model.meshes[i].max.y);
+    }
+    float spacing = fmaxf(fmaxf(max.x - min.x, max.y - min.y) * 1.5f, 1.0f);
+    float offset = (crowd_size - 1) * spacing * 0.5f;
+
+    for (int y = 0; y < crowd_size; ++y)
+    {
+        for (int x = 0; x < crowd_size; ++x)
+        {
+            vec3 position = { x * spacing - offset, y * spacing - offset, 0.0f };
+            if (use_baked)
+            {
+                float time_offset = (float)((x * 7 + y * 13) % 17) / 17.0f;
+                if (!addBakedInstance(&baked_crowd, mat4_translation(position), (uint32_t)animation_index, time_offset, 1.0f))
+                    return;
+                continue;
+            }
+
+            if (!addAnimationInstance(&world, &model, getCurrentAnimation(), mat4_translation(position)))
+                return;
+
+            // desync the crowd a little
+            world.instances[world.instance_count - 1].blend.layers[0].time = (float)((x * 7 + y * 13) % 17) / 17.0f;
+        }
+    }
+
+    updateMaskedLayers();
+}
+
 uint8_t onLoad(const char* title, int32_t x, int32_t y, uint32_t w, uint32_t h)
 {
     /* minimal initialization */
@@ -93,15 +238,27 @@ uint8_t onLoad(const char* title, int32_t x, int32_t y, uint32_t w, uint32_t h)
     cameraCreateOrtho(&camera, 0.0f, 0.0f, (float)width, (float)height);
     cameraSetCenterOrtho(&camera, (vec2) {0.0f, 0.0f});
 
+    /* per frame uploads */
+    streamBufferCreate(&stream_buffer, 0);
+
+    /* shaders link in the background while the model loads */
+    double shader_start = jobTimerNow();
+    createShaderCache(&shader_cache, "res/shaders/cache/");
+
+    createShaderUniforms();
+    setShaderUniformStream(&stream_buffer);
+    loadModelShader(&shader_cache, &shader_model, "res/shaders/model.vert", "res/shaders/model.frag", NULL);
+    loadModelShader(&shader_cache, &shader_skinned, "res/shaders/skinned.vert", "res/shaders/model.frag", NULL);
+    loadModelShader(&shader_cache, &shader_skinned_dq, "res/shaders/skinned.vert", "res/shaders/model.frag", "DUAL_QUATERNION");
+    loadModelShader(&shader_cache, &shader_baked, "res/shaders/baked.vert", "res/shaders/model.frag", NULL);
+    double shader_time = jobTimerNow() - shader_start;
+
     /* nuklear */
-    nk_glfw3_init(&glfw, window);
+    nk_glfw3_init(&glfw, window, &shader_cache);
+    glfw.stream = &stream_buffer;
 
     nk_glfw3_load_font_atlas(&glfw);
 
-    /* shader */
-    shader_model = ignisCreateShadervf("res/shaders/model.vert", "res/shaders/model.frag");
-    shader_skinned = ignisCreateShadervf("res/shaders/skinned.vert", "res/shaders/model.frag");
-
     /* gltf model */
     //loadModelGLTF(&model, &animation, "res/models/", "Box.gltf");
     //loadModelGLTF(&model, &animation, "res/models/walking_robot", "scene.gltf");
@@ -113,17 +270,84 @@ uint8_t onLoad(const char* title, int32_t x, int32_t y, uint32_t w, uint32_t h)
     //loadGLTF("res/models/", "Fox.glb");
 
     uploadModel(&model);
+    animation_count = animations.count;
+
+    uint32_t upper_body = model.joint_count ? findUpperBodyJoint(&model) : HIERARCHY_ROOT;
+    if (upper_body != HIERARCHY_ROOT)
+        createJointMaskSubtree(&layer_mask, &model, upper_body, 1.0f);
+
+    // rotations are interpolated with quat_fast_slerp and its batched variant, report how far both are off
+    for (size_t i = 0; i < animations.count; ++i)
+    {
+        float array_error = 0.0f;
+        float error = getAnimationSlerpError(&animations.data[i], 16, &array_error);
+        MINIMAL_INFO("[Animation] Clip %zu: fast slerp error %.5f deg (array %.5f deg)", i, error, array_error);
+    }
+
+    /* animation world */
+    jobPoolCreate(&jobs, 0);
+    createAnimationWorld(&world, &jobs);
+
+    /* baked animation */
+    if (loadBakedAnimationForModel() || bakeAnimations(&baked_animation, &model, &animations, BAKED_ANIMATION_FRAME_RATE))
+    {
+        uploadBakedAnimation(&baked_animation);
+        createBakedCrowd(&baked_crowd, &model, &baked_animation);
+    }
+
+    populateAnimationWorld();
+
+    createJointPaletteBuffer(&palette_buffer, world.palette_count * JOINT_PALETTE_LINEAR_ROWS);
+    palette_buffer.stream = &stream_buffer;
+    if (model.joint_count)
+    {
+        createSkinningBuffer(&skinning_buffer, &model, &shader_cache);
+        skinning_buffer.stream = &stream_buffer;
+    }
+    gpuTimerCreate(&skinning_timer);
+    createDrawList(&draw_list);
+    draw_list.stream = &stream_buffer;
+    createOcclusionBuffer(&occlusion, 256, 128);
+
+    shader_start = jobTimerNow();
+    finishShaderVariants(&shader_cache, 1);
+    shader_time += jobTimerNow() - shader_start;
+
+    MINIMAL_INFO("[Shader] %zu programs from cache, %zu compiled, %zu failed in %.2f ms", shader_cache.hits, shader_cache.compiled, shader_cache.failed, shader_time * 1000.0);
+
+    // the compute skinning falls back to the cpu, every draw needs its model shader
+    if (!shader_model || !shader_skinned || !shader_skinned_dq || !shader_baked)
+    {
+        MINIMAL_ERROR("[Shader] Failed to build the model shaders");
+        return MINIMAL_FAIL;
+    }
 
     return MINIMAL_OK;
 }
 
 void onDestroy()
 {
+    destroyAnimationWorld(&world);
+    destroyBakedCrowd(&baked_crowd);
+    destroyBakedAnimation(&baked_animation);
+    destroyJointPaletteBuffer(&palette_buffer);
+    if (model.joint_count) destroySkinningBuffer(&skinning_buffer);
+    gpuTimerDestroy(&skinning_timer);
+    destroyDrawList(&draw_list);
+    destroyOcclusionBuffer(&occlusion);
+    streamBufferDestroy(&stream_buffer);
+    jobPoolDestroy(&jobs);
+
+    destroyJointMask(&layer_mask);
     destroyModel(&model);
     destroyAnimationList(&animations);
 
     ignisDeleteShader(shader_model);
     ignisDeleteShader(shader_skinned);
+    ignisDeleteShader(shader_skinned_dq);
+    ignisDeleteShader(shader_baked);
+    destroyShaderUniforms();
+    destroyShaderCache(&shader_cache);
 
     nk_glfw3_shutdown(&glfw);
 
@@ -155,17 +379,32 @@ int onEvent(void *context, const MinimalEvent *e)
         glfw.scroll.y += y;
     }
 
+    // pick the instance under the cursor
+    if (minimalEventMouseButtonPressed(e, MINIMAL_MOUSE_BUTTON_1, &x, &y) && !nk_window_is_any_hovered(&glfw.ctx) && !use_baked)
+    {
+        float ndc_x = 2.0f * x / width - 1.0f;
+        float ndc_y = 1.0f - 2.0f * y / height;
+
+        vec3 origin = unprojectPoint(inv_view_proj, ndc_x, ndc_y, -1.0f);
+        vec3 target = unprojectPoint(inv_view_proj, ndc_x, ndc_y, 1.0f);
+
+        size_t index = 0;
+        picked_instance = pickAnimationInstance(&world, origin, vec3_sub(target, origin), &index) ? (int)index : -1;
+    }
+
     /*
     // TODO: fix minimal not registering mouse release if moved out of window while pressed
     if (minimalEventMouseButtonReleased(e, MINIMAL_MOUSE_BUTTON_1, NULL, NULL))
         MINIMAL_INFO("Released");
     */
 
+    size_t clip = animation_index;
     switch (minimalEventKeyPressed(e))
     {
     case MINIMAL_KEY_ESCAPE:   minimalClose(window); break;
     //case MINIMAL_KEY_F6:       minimalToggleVsync(window); break;
     //case MINIMAL_KEY_F7:       minimalToggleDebug(window); break;
+    case MINIMAL_KEY_F8:       threaded = !threaded; world.jobs = threaded ? &jobs : NULL; break;
     case MINIMAL_KEY_F9:       view_mode = !view_mode; break;
     case MINIMAL_KEY_F10:      poly_mode = !poly_mode; break;
     case MINIMAL_KEY_SPACE:    paused = !paused; break;
@@ -176,6 +415,21 @@ int onEvent(void *context, const MinimalEvent *e)
     case MINIMAL_KEY_4: if (animation_count >= 3) animation_index = 3; break;
     }
 
+    // fade the crowd over to the new clip
+    if (clip != animation_index)
+    {
+        for (size_t i = 0; i < world.instance_count; ++i)
+            crossfadeAnimation(&world.instances[i].blend, getCurrentAnimation(), crossfade_time);
+        updateMaskedLayers();
+    }
+
+    if (use_baked && clip != animation_index)
+        populateAnimationWorld();
+
+    // nodes the new clip does not animate go back to their rest pose
+    if (clip != animation_index)
+        resetNodeHierarchy(&model.nodes);
+
     return MINIMAL_OK;
 }
 
@@ -186,6 +440,9 @@ void onTick(void* context, const MinimalFrameData* framedata)
     // clear screen
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // waits for the GPU to release the region of this frame
+    streamBufferBegin(&stream_buffer);
+
     /*
     */
     if (minimalKeyDown(MINIMAL_KEY_W)) camera_radius -= camera_zoom * framedata->deltatime;
@@ -195,7 +452,13 @@ void onTick(void* context, const MinimalFrameData* framedata)
 
     if (!paused)
     {
-        tickAnimation(&animations.data[animation_index], framedata->deltatime);
+        const Animation* animation = getCurrentAnimation();
+        if (animation)
+        {
+            tickAnimation(&animations.data[animation_index], framedata->deltatime);
+            nodes_updated = animateModel(&model, animation, animation->time);
+        }
+        baked_time += framedata->deltatime;
     }
 
     mat4 proj = mat4_perspective(degToRad(45.0f), (float)width / (float)height, 0.1f, 100.0f);
@@ -214,8 +477,16 @@ void onTick(void* context, const MinimalFrameData* framedata)
     //mat4 view = camera.view;
 
 
-    // render grid
     mat4 view_proj = mat4_multiply(proj, view);
+    inv_view_proj = mat4_invert(view_proj);
+
+    if (!paused)
+    {
+        setAnimationWorldView(&world, view_proj, eye);
+        tickAnimationWorld(&world, framedata->deltatime);
+    }
+
+    // render grid
     ignisDebugRendererSetViewProjection(view_proj.v[0]);
 
     ignisRenderDebugGrid(10.0f, 10.0f, 1.0f);
@@ -225,17 +496,137 @@ void onTick(void* context, const MinimalFrameData* framedata)
 
     glPolygonMode(GL_FRONT_AND_BACK, poly_mode ? GL_LINE : GL_FILL);
 
-    if (model.joint_count)
+    // camera for every model shader
+    setSceneUniforms(proj, view, baked_time);
+    resetDrawList(&draw_list, view_proj, eye, 100.0f);
+
+    // occluders of every instance, the draw list tests its boxes against them
+    draw_list.occlusion = NULL;
+    if (occlusion_culling && (model.occluder_index_count || model.occluder_instance_count) && !use_baked)
+    {
+        clearOcclusionBuffer(&occlusion, view_proj);
+        if (model.joint_count)
+        {
+            for (size_t i = 0; i < world.instance_count; ++i)
+                addOccluder(&occlusion, model.occluder_positions, model.occluder_indices, model.occluder_index_count, world.instances[i].transform);
+        }
+        else
+        {
+            addOccluder(&occlusion, model.occluder_positions, model.occluder_indices, model.occluder_index_count, mat4_identity());
+
+            // the largest meshes in their animated place when nothing is authored
+            for (size_t i = 0; i < model.occluder_instance_count; ++i)
+            {
+                uint32_t instance = model.occluder_instances[i];
+                const Mesh* mesh = &model.meshes[model.instances[instance]];
+                addOccluder(&occlusion, mesh->positions, mesh->indices, mesh->element_count, model.transforms[instance]);
+            }
+        }
+
+        rasterizeOcclusionBuffer(&occlusion, threaded ? &jobs : NULL);
+        draw_list.occlusion = &occlusion;
+    }
+
+    if (use_baked)
+    {
+
+        gpuTimerBegin(&skinning_timer);
+        renderBakedCrowd(&baked_crowd, shader_baked);
+        gpuTimerEnd(&skinning_timer);
+    }
+    else if (model.joint_count && (model.skinning == SKINNING_CPU || model.skinning == SKINNING_COMPUTE))
     {
-        ignisSetUniformMat4(shader_skinned, "proj", 1, proj.v[0]);
-        ignisSetUniformMat4(shader_skinned, "view", 1, view.v[0]);
-        renderModelSkinned(&model, &animations.data[animation_index], shader_skinned);
+        if (model.skinning == SKINNING_CPU)
+            skinAnimationWorld(&skinning_buffer, &world, threaded ? &jobs : NULL);
+
+        gpuTimerBegin(&skinning_timer);
+        int skinned = 1;
+        if (model.skinning == SKINNING_COMPUTE)
+        {
+            resetJointPaletteBuffer(&palette_buffer);
+            size_t linear_base = writeJointPalette(&palette_buffer, world.palettes, world.palette_count);
+
+            // the palette buffer failed to grow, skip the frame instead of skinning with garbage rows
+            skinned = linear_base != JOINT_PALETTE_INVALID;
+            if (skinned)
+            {
+                uploadJointPaletteBuffer(&palette_buffer);
+                bindJointPaletteBuffer(&palette_buffer, JOINT_PALETTE_BINDING);
+
+                skinAnimationWorldCompute(&skinning_buffer, &world, linear_base);
+            }
+        }
+
+        // every pass from here on draws the skinned vertices with the static shader
+        size_t visible = skinned ? cullAnimationWorld(&world, bvh_culling ? &draw_list.frustum : NULL) : 0;
+        for (size_t k = 0; k < visible; ++k)
+        {
+            size_t i = world.visible[k];
+            pushSkinningBufferDraws(&draw_list, &skinning_buffer, i, world.instances[i].bounds, world.instances[i].transform, shader_model);
+        }
+
+        cullDrawList(&draw_list);
+        sortDrawList(&draw_list);
+        submitDrawList(&draw_list);
+        gpuTimerEnd(&skinning_timer);
+    }
+    else if (model.joint_count)
+    {
+
+        dq_fallbacks = 0;
+        for (size_t i = 0; i < world.instance_count; ++i)
+            dq_fallbacks += !world.instances[i].dq_valid;
+
+        // the world keeps all palettes next to each other
+        resetJointPaletteBuffer(&palette_buffer);
+
+        size_t linear_base = JOINT_PALETTE_INVALID;
+        if (model.skinning == SKINNING_LINEAR || dq_fallbacks)
+            linear_base = writeJointPalette(&palette_buffer, world.palettes, world.palette_count);
+
+        size_t dq_base = JOINT_PALETTE_INVALID;
+        if (model.skinning == SKINNING_DUAL_QUAT)
+            dq_base = writeJointPaletteRows(&palette_buffer, world.dq_palettes, world.palette_count * JOINT_PALETTE_DQ_ROWS);
+
+        // a palette that was asked for but did not fit skips skinned draws for this frame
+        int skinned = (linear_base != JOINT_PALETTE_INVALID || (model.skinning != SKINNING_LINEAR && !dq_fallbacks))
+                   && (dq_base != JOINT_PALETTE_INVALID || model.skinning != SKINNING_DUAL_QUAT);
+
+        if (skinned)
+        {
+            uploadJointPaletteBuffer(&palette_buffer);
+            bindJointPaletteBuffer(&palette_buffer, JOINT_PALETTE_BINDING);
+        }
+
+        gpuTimerBegin(&skinning_timer);
+        size_t visible = skinned ? cullAnimationWorld(&world, bvh_culling ? &draw_list.frustum : NULL) : 0;
+        for (size_t k = 0; k < visible; ++k)
+        {
+            const AnimationInstance* instance = &world.instances[world.visible[k]];
+            if (dq_base != JOINT_PALETTE_INVALID && instance->dq_valid)
+            {
+                size_t offset = dq_base + instance->palette_offset * JOINT_PALETTE_DQ_ROWS;
+                pushModelDrawsSkinned(&draw_list, instance->model, instance->bounds, offset, instance->dq_scale, instance->transform, shader_skinned_dq);
+            }
+            else if (linear_base != JOINT_PALETTE_INVALID)
+            {
+                size_t offset = linear_base + instance->palette_offset * JOINT_PALETTE_LINEAR_ROWS;
+                pushModelDrawsSkinned(&draw_list, instance->model, instance->bounds, offset, 1.0f, instance->transform, shader_skinned);
+            }
+        }
+
+        cullDrawList(&draw_list);
+        sortDrawList(&draw_list);
+        submitDrawList(&draw_list);
+        gpuTimerEnd(&skinning_timer);
     }
     else
     {
-        ignisSetUniformMat4(shader_model, "proj", 1, proj.v[0]);
-        ignisSetUniformMat4(shader_model, "view", 1, view.v[0]);
-        renderModel(&model, &animations.data[animation_index], shader_model);
+        pushModelDraws(&draw_list, &model, shader_model);
+
+        cullDrawList(&draw_list);
+        sortDrawList(&draw_list);
+        submitDrawList(&draw_list);
     }
 
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -244,10 +635,12 @@ void onTick(void* context, const MinimalFrameData* framedata)
     nk_glfw3_new_frame(&glfw, framedata->deltatime);
 
     struct nk_context* ctx = &glfw.ctx;
-    if (nk_begin(ctx, "Debug", nk_rect(0, 0, 180, 110), 0))
+    if (nk_begin(ctx, "Debug", nk_rect(0, 0, 240, 710), 0))
     {
         nk_layout_row_dynamic(ctx, 20, 1);
         nk_labelf(ctx, NK_TEXT_LEFT, "Fps: %d", framedata->fps);
+        nk_layout_row_dynamic(ctx, 20, 1);
+        nk_labelf(ctx, NK_TEXT_LEFT, "Stream: %zu / %zu KB, %u stalls", stream_buffer.used / 1024, stream_buffer.frame_size / 1024, stream_buffer.stalls);
 
         nk_layout_row_dynamic(ctx, 20, 1);
         nk_labelf(ctx, NK_TEXT_LEFT, "Current animation:  %d", animation_index);
@@ -255,11 +648,120 @@ void onTick(void* context, const MinimalFrameData* framedata)
         nk_labelf(ctx, NK_TEXT_LEFT, "Animation Duration: %4.2f", animations.data[animation_index].duration);
         nk_layout_row_dynamic(ctx, 20, 1);
         nk_labelf(ctx, NK_TEXT_LEFT, "Animation Time:     %4.2f", animations.data[animation_index].time);
+
+        if (!use_baked)
+        {
+            const DrawListStats* stats = &draw_list.stats;
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Draws: %zu, %zu cmds in %zu calls", stats->draws, stats->commands, stats->batches);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Binds: %zu shader, %zu tex, %zu vao", stats->shader_binds, stats->texture_binds, stats->vao_binds);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Binds saved: %zu", stats->binds_saved);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            draw_list.culling = nk_checkbox_label(ctx, "Frustum culling", draw_list.culling);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Culled: %zu / %zu", stats->culled, stats->tested);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            occlusion_culling = nk_checkbox_label(ctx, "Occlusion culling", occlusion_culling);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            if (!occlusion_culling || draw_list.occlusion)
+                nk_labelf(ctx, NK_TEXT_LEFT, "Occluded: %zu (%zu occluder tris)", stats->occluded, draw_list.occlusion ? occlusion.triangle_count : 0);
+            else if (use_baked)
+                nk_label(ctx, "Occluded: not used by the baked crowd", NK_TEXT_LEFT);
+            else if (model.joint_count)
+                nk_label(ctx, "Occluded: no occluders, skinned models need Occluder nodes", NK_TEXT_LEFT);
+            else
+                nk_label(ctx, "Occluded: no occluders in this model", NK_TEXT_LEFT);
+            if (model.joint_count)
+            {
+                nk_layout_row_dynamic(ctx, 20, 1);
+                bvh_culling = nk_checkbox_label(ctx, "BVH culling", bvh_culling);
+                nk_layout_row_dynamic(ctx, 20, 1);
+                nk_labelf(ctx, NK_TEXT_LEFT, "BVH: %zu nodes, sah %.1f / %.1f", world.bvh.node_count, world.bvh.cost, world.bvh.build_cost);
+                nk_layout_row_dynamic(ctx, 20, 1);
+                nk_labelf(ctx, NK_TEXT_LEFT, "Picked instance: %d", picked_instance);
+            }
+        }
+
+        if (!model.joint_count)
+        {
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Nodes updated: %zu / %zu", nodes_updated, model.nodes.count);
+        }
+
+        if (model.joint_count)
+        {
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Instances: %zu", use_baked ? baked_crowd.instance_count : world.instance_count);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            int size = nk_slider_int(ctx, 1, crowd_size, use_baked ? 256 : 64, 1);
+            if (size != crowd_size)
+            {
+                crowd_size = size;
+                populateAnimationWorld();
+            }
+            if (baked_crowd.baked)
+            {
+                nk_layout_row_dynamic(ctx, 20, 2);
+                int baked = nk_checkbox_label(ctx, "Baked crowd", use_baked);
+                if (baked != use_baked)
+                {
+                    use_baked = baked;
+                    crowd_size = crowd_size > 64 ? 64 : crowd_size;
+                    populateAnimationWorld();
+                }
+                if (nk_button_label(ctx, "Save baked"))
+                    saveBakedAnimation(&baked_animation, BAKED_ANIMATION_PATH);
+            }
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Anim update: %4.2f ms (%u threads)", world.update_time * 1000.0, world.jobs ? jobPoolThreadCount(world.jobs) : 1);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_property_float(ctx, "Crossfade (s)", 0.0f, &crossfade_time, 2.0f, 0.05f, 0.01f);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Blend layers: %zu", world.instance_count ? world.instances[0].blend.count : 0);
+            if (layer_mask.count && animations.count > 1)
+            {
+                nk_layout_row_dynamic(ctx, 20, 1);
+                int masked = nk_checkbox_label(ctx, "Upper body layer", masked_layer);
+                if (masked != masked_layer)
+                {
+                    masked_layer = masked;
+                    updateMaskedLayers();
+                }
+            }
+            nk_layout_row_dynamic(ctx, 20, 1);
+            model.lod.enabled = nk_checkbox_label(ctx, "Animation LOD", model.lod.enabled);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Joint evals: %zu", world.joints_evaluated);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Joint evals saved: %zu", world.joints_saved);
+
+            nk_layout_row_dynamic(ctx, 20, 2);
+            model.skinning = nk_radio_label(ctx, "Linear", model.skinning, SKINNING_LINEAR);
+            model.skinning = nk_radio_label(ctx, "DQ", model.skinning, SKINNING_DUAL_QUAT);
+            model.skinning = nk_radio_label(ctx, "CPU", model.skinning, SKINNING_CPU);
+            if (skinning_buffer.compute)
+                model.skinning = nk_radio_label(ctx, "Compute", model.skinning, SKINNING_COMPUTE);
+            nk_layout_row_dynamic(ctx, 20, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Skinning GPU: %4.3f ms", skinning_timer.elapsed);
+            if (model.skinning == SKINNING_CPU)
+            {
+                nk_layout_row_dynamic(ctx, 20, 1);
+                nk_labelf(ctx, NK_TEXT_LEFT, "Skinning CPU: %4.3f ms", skinning_buffer.skinning_time * 1000.0);
+            }
+            if (model.skinning == SKINNING_DUAL_QUAT)
+            {
+                nk_layout_row_dynamic(ctx, 20, 1);
+                nk_labelf(ctx, NK_TEXT_LEFT, "Linear fallbacks: %zu (%zu lod lerped)", dq_fallbacks, world.dq_lerp_fallbacks);
+            }
+        }
     }
     nk_end(ctx);
 
     nk_glfw3_render(&glfw, screen_projection.v[0]);
 
+    streamBufferEnd(&stream_buffer);
     minimalSwapBuffers(window);
 }
 
@@ -0,0 +1,227 @@
+#include "frustum.h"
+
+#include <math.h>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define FRUSTUM_AVX2
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define FRUSTUM_SSE
+#endif
+
+aabb aabb_empty()
+{
+    aabb result = {
+        {  INFINITY,  INFINITY,  INFINITY },
+        { -INFINITY, -INFINITY, -INFINITY }
+    };
+    return result;
+}
+
+aabb aabb_merge(aabb a, aabb b)
+{
+    aabb result = {
+        { fminf(a.min.x, b.min.x), fminf(a.min.y, b.min.y), fminf(a.min.z, b.min.z) },
+        { fmaxf(a.max.x, b.max.x), fmaxf(a.max.y, b.max.y), fmaxf(a.max.z, b.max.z) }
+    };
+    return result;
+}
+
+int aabb_is_empty(aabb box)
+{
+    return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z;
+}
+
+aabb aabb_transform(aabb box, mat4 m)
+{
+    if (aabb_is_empty(box)) return box;
+
+    // transform the center and project the extent onto the absolute axes
+    vec3 center = vec3_mult(vec3_add(box.min, box.max), 0.5f);
+    vec3 extent = vec3_mult(vec3_sub(box.max, box.min), 0.5f);
+
+    center = mat4_transform_point(m, center);
+
+    float e[3];
+    for (int r = 0; r < 3; ++r)
+        e[r] = fabsf(m.v[0][r]) * extent.x + fabsf(m.v[1][r]) * extent.y + fabsf(m.v[2][r]) * extent.z;
+
+    aabb result = {
+        { center.x - e[0], center.y - e[1], center.z - e[2] },
+        { center.x + e[0], center.y + e[1], center.z + e[2] }
+    };
+    return result;
+}
+
+float aabb_surface_area(aabb box)
+{
+    if (aabb_is_empty(box)) return 0.0f;
+
+    vec3 d = vec3_sub(box.max, box.min);
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+int aabb_intersect_ray(aabb box, vec3 origin, vec3 inv_dir, float max_t, float* t)
+{
+    float x0 = (box.min.x - origin.x) * inv_dir.x, x1 = (box.max.x - origin.x) * inv_dir.x;
+    float y0 = (box.min.y - origin.y) * inv_dir.y, y1 = (box.max.y - origin.y) * inv_dir.y;
+    float z0 = (box.min.z - origin.z) * inv_dir.z, z1 = (box.max.z - origin.z) * inv_dir.z;
+
+    float enter = fmaxf(fmaxf(fminf(x0, x1), fminf(y0, y1)), fmaxf(fminf(z0, z1), 0.0f));
+    float leave = fminf(fminf(fmaxf(x0, x1), fmaxf(y0, y1)), fminf(fmaxf(z0, z1), max_t));
+
+    if (enter > leave) return 0;
+
+    if (t) *t = enter;
+    return 1;
+}
+
+static plane plane_normalize(float a, float b, float c, float d)
+{
+    float l = 1.0f / sqrtf(a * a + b * b + c * c);
+
+    plane result = { { a * l, b * l, c * l }, d * l };
+    return result;
+}
+
+frustum frustum_extract(mat4 m)
+{
+    frustum result;
+    for (int i = 0; i < 3; ++i)
+    {
+        // row 3 +/- row i
+        result.planes[i * 2 + 0] = plane_normalize(m.v[0][3] + m.v[0][i], m.v[1][3] + m.v[1][i], m.v[2][3] + m.v[2][i], m.v[3][3] + m.v[3][i]);
+        result.planes[i * 2 + 1] = plane_normalize(m.v[0][3] - m.v[0][i], m.v[1][3] - m.v[1][i], m.v[2][3] - m.v[2][i], m.v[3][3] - m.v[3][i]);
+    }
+    return result;
+}
+
+int frustum_test_sphere(const frustum* f, vec3 center, float radius)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        if (vec3_dot(f->planes[i].normal, center) + f->planes[i].distance < -radius)
+            return 0;
+    }
+    return 1;
+}
+
+int frustum_test_aabb(const frustum* f, aabb box)
+{
+    vec3 center = vec3_mult(vec3_add(box.min, box.max), 0.5f);
+    vec3 extent = vec3_mult(vec3_sub(box.max, box.min), 0.5f);
+
+    for (int i = 0; i < 6; ++i)
+    {
+        vec3 n = f->planes[i].normal;
+        float r = fabsf(n.x) * extent.x + fabsf(n.y) * extent.y + fabsf(n.z) * extent.z;
+
+        if (vec3_dot(n, center) + f->planes[i].distance < -r)
+            return 0;
+    }
+    return 1;
+}
+
+int frustum_classify_aabb(const frustum* f, aabb box, uint8_t* planes)
+{
+    vec3 center = vec3_mult(vec3_add(box.min, box.max), 0.5f);
+    vec3 extent = vec3_mult(vec3_sub(box.max, box.min), 0.5f);
+
+    for (int i = 0; i < 6; ++i)
+    {
+        if (!(*planes & (1 << i))) continue;
+
+        vec3 n = f->planes[i].normal;
+        float r = fabsf(n.x) * extent.x + fabsf(n.y) * extent.y + fabsf(n.z) * extent.z;
+        float d = vec3_dot(n, center) + f->planes[i].distance;
+
+        if (d < -r) return FRUSTUM_OUTSIDE;
+        if (d >= r) *planes &= ~(1 << i);
+    }
+    return *planes ? FRUSTUM_INTERSECT : FRUSTUM_INSIDE;
+}
+
+#if defined(FRUSTUM_AVX2) || defined(FRUSTUM_SSE)
+
+#ifdef FRUSTUM_AVX2
+    #define FRUSTUM_LANES           8
+    #define frustum_simd            __m256
+    #define frustum_set1(x)         _mm256_set1_ps(x)
+    #define frustum_add(a, b)       _mm256_add_ps(a, b)
+    #define frustum_sub(a, b)       _mm256_sub_ps(a, b)
+    #define frustum_mul(a, b)       _mm256_mul_ps(a, b)
+    #define frustum_or(a, b)        _mm256_or_ps(a, b)
+    #define frustum_cmplt(a, b)     _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+    #define frustum_movemask(a)     _mm256_movemask_ps(a)
+    #define frustum_zero()          _mm256_setzero_ps()
+    #define frustum_gather(b, f)    _mm256_setr_ps(b[0].f, b[1].f, b[2].f, b[3].f, b[4].f, b[5].f, b[6].f, b[7].f)
+#else
+    #define FRUSTUM_LANES           4
+    #define frustum_simd            __m128
+    #define frustum_set1(x)         _mm_set1_ps(x)
+    #define frustum_add(a, b)       _mm_add_ps(a, b)
+    #define frustum_sub(a, b)       _mm_sub_ps(a, b)
+    #define frustum_mul(a, b)       _mm_mul_ps(a, b)
+    #define frustum_or(a, b)        _mm_or_ps(a, b)
+    #define frustum_cmplt(a, b)     _mm_cmplt_ps(a, b)
+    #define frustum_movemask(a)     _mm_movemask_ps(a)
+    #define frustum_zero()          _mm_setzero_ps()
+    #define frustum_gather(b, f)    _mm_setr_ps(b[0].f, b[1].f, b[2].f, b[3].f)
+#endif
+
+/* One bit per box that is at least partially inside */
+static int frustum_test_aabbs_simd(const frustum* f, const aabb* boxes)
+{
+    frustum_simd half = frustum_set1(0.5f);
+
+    // boxes as center and extent, one component per register
+    frustum_simd min_x = frustum_gather(boxes, min.x), max_x = frustum_gather(boxes, max.x);
+    frustum_simd min_y = frustum_gather(boxes, min.y), max_y = frustum_gather(boxes, max.y);
+    frustum_simd min_z = frustum_gather(boxes, min.z), max_z = frustum_gather(boxes, max.z);
+
+    frustum_simd cx = frustum_mul(frustum_add(min_x, max_x), half), ex = frustum_mul(frustum_sub(max_x, min_x), half);
+    frustum_simd cy = frustum_mul(frustum_add(min_y, max_y), half), ey = frustum_mul(frustum_sub(max_y, min_y), half);
+    frustum_simd cz = frustum_mul(frustum_add(min_z, max_z), half), ez = frustum_mul(frustum_sub(max_z, min_z), half);
+
+    frustum_simd outside = frustum_zero();
+    for (int i = 0; i < 6; ++i)
+    {
+        const plane* p = &f->planes[i];
+
+        frustum_simd d = frustum_add(frustum_mul(cx, frustum_set1(p->normal.x)), frustum_mul(cy, frustum_set1(p->normal.y)));
+        d = frustum_add(d, frustum_add(frustum_mul(cz, frustum_set1(p->normal.z)), frustum_set1(p->distance)));
+
+        frustum_simd r = frustum_add(frustum_mul(ex, frustum_set1(fabsf(p->normal.x))), frustum_mul(ey, frustum_set1(fabsf(p->normal.y))));
+        r = frustum_add(r, frustum_mul(ez, frustum_set1(fabsf(p->normal.z))));
+
+        outside = frustum_or(outside, frustum_cmplt(frustum_add(d, r), frustum_zero()));
+    }
+
+    return ~frustum_movemask(outside) & ((1 << FRUSTUM_LANES) - 1);
+}
+
+#endif
+
+size_t frustum_test_aabbs(const frustum* f, const aabb* boxes, size_t count, uint8_t* visible)
+{
+    size_t result = 0;
+    size_t i = 0;
+#if defined(FRUSTUM_AVX2) || defined(FRUSTUM_SSE)
+    for (; i + FRUSTUM_LANES <= count; i += FRUSTUM_LANES)
+    {
+        int mask = frustum_test_aabbs_simd(f, &boxes[i]);
+        for (int l = 0; l < FRUSTUM_LANES; ++l)
+        {
+            visible[i + l] = (mask >> l) & 1;
+            result += visible[i + l];
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        visible[i] = (uint8_t)frustum_test_aabb(f, boxes[i]);
+        result += visible[i];
+    }
+    return result;
+}
@@ -0,0 +1,61 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "mat4.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    vec3 normal;
+    float distance;
+} plane;
+
+/* Axis aligned box, empty if min is greater than max */
+typedef struct
+{
+    vec3 min;
+    vec3 max;
+} aabb;
+
+aabb aabb_empty();
+aabb aabb_merge(aabb a, aabb b);
+int  aabb_is_empty(aabb box);
+
+/* Box around the transformed box */
+aabb aabb_transform(aabb box, mat4 m);
+
+float aabb_surface_area(aabb box);
+
+/* Slab test, inv_dir is 1 / direction. Returns 0 if the ray misses the box before max_t */
+int aabb_intersect_ray(aabb box, vec3 origin, vec3 inv_dir, float max_t, float* t);
+
+/* Planes point inwards: left, right, bottom, top, near, far */
+typedef struct
+{
+    plane planes[6];
+} frustum;
+
+frustum frustum_extract(mat4 view_proj);
+
+/* Returns 0 if the sphere is completely outside of the frustum */
+int frustum_test_sphere(const frustum* f, vec3 center, float radius);
+
+/* Returns 0 if the box is completely outside of the frustum */
+int frustum_test_aabb(const frustum* f, aabb box);
+
+#define FRUSTUM_OUTSIDE     0
+#define FRUSTUM_INTERSECT   1
+#define FRUSTUM_INSIDE      2
+
+/*
+ * Tests the box against the planes set in the bit mask planes and clears the
+ * planes the box is completely inside of, so children of the box can skip them
+ */
+int frustum_classify_aabb(const frustum* f, aabb box, uint8_t* planes);
+
+/* frustum_test_aabb for count boxes, vectorized where available. Returns the number of visible boxes */
+size_t frustum_test_aabbs(const frustum* f, const aabb* boxes, size_t count, uint8_t* visible);
+
+#endif /* !FRUSTUM_H */
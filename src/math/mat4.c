@@ -2,6 +2,14 @@
 
 #include <math.h>
 
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define QUAT_AVX2
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define QUAT_SSE
+#endif
+
 mat4 mat4_identity()
 {
     mat4 result = {
@@ -235,6 +243,15 @@ mat4 mat4_multiply(mat4 l, mat4 r)
     return result;
 }
 
+vec3 mat4_transform_point(mat4 m, vec3 v)
+{
+    vec3 result;
+    result.x = m.v[0][0] * v.x + m.v[1][0] * v.y + m.v[2][0] * v.z + m.v[3][0];
+    result.y = m.v[0][1] * v.x + m.v[1][1] * v.y + m.v[2][1] * v.z + m.v[3][1];
+    result.z = m.v[0][2] * v.x + m.v[1][2] * v.y + m.v[2][2] * v.z + m.v[3][2];
+    return result;
+}
+
 mat4 mat4_invert(mat4 m)
 {
     float s[6];
@@ -279,6 +296,42 @@ mat4 mat4_invert(mat4 m)
     return result;
 }
 
+#define MAT4_UNIFORM_EPSILON 1e-4f
+
+int mat4_normal_matrix(mat4 m, float* normal)
+{
+    vec3 c0 = { m.v[0][0], m.v[0][1], m.v[0][2] };
+    vec3 c1 = { m.v[1][0], m.v[1][1], m.v[1][2] };
+    vec3 c2 = { m.v[2][0], m.v[2][1], m.v[2][2] };
+
+    // orthogonal columns of equal length only scale normals
+    float l0 = vec3_dot(c0, c0), l1 = vec3_dot(c1, c1), l2 = vec3_dot(c2, c2);
+    float epsilon = MAT4_UNIFORM_EPSILON * l0;
+    if (fabsf(l0 - l1) <= epsilon && fabsf(l0 - l2) <= epsilon
+        && fabsf(vec3_dot(c0, c1)) <= epsilon && fabsf(vec3_dot(c1, c2)) <= epsilon && fabsf(vec3_dot(c2, c0)) <= epsilon)
+    {
+        for (int c = 0; c < 3; ++c)
+            for (int r = 0; r < 3; ++r)
+                normal[c * 3 + r] = m.v[c][r];
+        return 0;
+    }
+
+    // the cofactor matrix is the inverse transpose times the determinant, keep its sign out
+    vec3 n0 = vec3_cross(c1, c2);
+    vec3 n1 = vec3_cross(c2, c0);
+    vec3 n2 = vec3_cross(c0, c1);
+    float sign = vec3_dot(c0, n0) < 0.0f ? -1.0f : 1.0f;
+
+    vec3 columns[3] = { n0, n1, n2 };
+    for (int c = 0; c < 3; ++c)
+    {
+        normal[c * 3 + 0] = columns[c].x * sign;
+        normal[c * 3 + 1] = columns[c].y * sign;
+        normal[c * 3 + 2] = columns[c].z * sign;
+    }
+    return 1;
+}
+
 mat4 mat4_interpolate(mat4 mat0, mat4 mat1, float time)
 {
     quat rot0 = quat_cast(mat0);
@@ -311,18 +364,16 @@ quat quat_nlerp(quat q0, quat q1, float value)
     result.z = q0.z + value * (q1.z - q0.z);
     result.w = q0.w + value * (q1.w - q0.w);
 
-    // QuaternionNormalize(q);
-    quat q = result;
+    return quat_normalize(result);
+}
+
+quat quat_normalize(quat q)
+{
     float length = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
     if (length == 0.0f) length = 1.0f;
     float ilength = 1.0f / length;
 
-    result.x = q.x * ilength;
-    result.y = q.y * ilength;
-    result.z = q.z * ilength;
-    result.w = q.w * ilength;
-
-    return result;
+    return (quat) { q.x * ilength, q.y * ilength, q.z * ilength, q.w * ilength };
 }
 
 quat quat_slerp(quat q0, quat q1, float value)
@@ -366,6 +417,154 @@ quat quat_slerp(quat q0, quat q1, float value)
     return result;
 }
 
+// Fast slerp: nlerp with the interpolation parameter corrected by a polynomial in t and |cos|
+// (after Arseny Kapoulkine's "Approximating slerp"), no trigonometry involved
+quat quat_fast_slerp(quat q0, quat q1, float t)
+{
+    float ca = q0.x * q1.x + q0.y * q1.y + q0.z * q1.z + q0.w * q1.w;
+    float d = fabsf(ca);
+
+    float a = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+    float b = 0.848013f + d * (-1.06021f + d * 0.215638f);
+    float k = a * (t - 0.5f) * (t - 0.5f) + b;
+    float ot = t + t * (t - 0.5f) * (t - 1.0f) * k;
+
+    float w0 = 1.0f - ot;
+    float w1 = ca < 0.0f ? -ot : ot;
+
+    return quat_normalize((quat) {
+        q0.x * w0 + q1.x * w1,
+        q0.y * w0 + q1.y * w1,
+        q0.z * w0 + q1.z * w1,
+        q0.w * w0 + q1.w * w1
+    });
+}
+
+#if defined(QUAT_AVX2) || defined(QUAT_SSE)
+
+#ifdef QUAT_AVX2
+    #define QUAT_LANES              8
+    #define quat_simd               __m256
+    #define quat_set1(x)            _mm256_set1_ps(x)
+    #define quat_add(a, b)          _mm256_add_ps(a, b)
+    #define quat_sub(a, b)          _mm256_sub_ps(a, b)
+    #define quat_mul(a, b)          _mm256_mul_ps(a, b)
+    #define quat_div(a, b)          _mm256_div_ps(a, b)
+    #define quat_and(a, b)          _mm256_and_ps(a, b)
+    #define quat_andnot(a, b)       _mm256_andnot_ps(a, b)
+    #define quat_xor(a, b)          _mm256_xor_ps(a, b)
+    #define quat_sqrt(a)            _mm256_sqrt_ps(a)
+    #define quat_unpacklo(a, b)     _mm256_unpacklo_ps(a, b)
+    #define quat_unpackhi(a, b)     _mm256_unpackhi_ps(a, b)
+    #define quat_shuffle(a, b, m)   _mm256_shuffle_ps(a, b, m)
+#else
+    #define QUAT_LANES              4
+    #define quat_simd               __m128
+    #define quat_set1(x)            _mm_set1_ps(x)
+    #define quat_add(a, b)          _mm_add_ps(a, b)
+    #define quat_sub(a, b)          _mm_sub_ps(a, b)
+    #define quat_mul(a, b)          _mm_mul_ps(a, b)
+    #define quat_div(a, b)          _mm_div_ps(a, b)
+    #define quat_and(a, b)          _mm_and_ps(a, b)
+    #define quat_andnot(a, b)       _mm_andnot_ps(a, b)
+    #define quat_xor(a, b)          _mm_xor_ps(a, b)
+    #define quat_sqrt(a)            _mm_sqrt_ps(a)
+    #define quat_unpacklo(a, b)     _mm_unpacklo_ps(a, b)
+    #define quat_unpackhi(a, b)     _mm_unpackhi_ps(a, b)
+    #define quat_shuffle(a, b, m)   _mm_shuffle_ps(a, b, m)
+#endif
+
+/*
+ * 4x4 transpose within every 128 bit lane. With AVX2 each register holds two quaternions,
+ * so the lanes end up as [q0 q2 q4 q6 | q1 q3 q5 q7]. The transpose is its own inverse.
+ */
+static void quat_transpose(quat_simd* a, quat_simd* b, quat_simd* c, quat_simd* d)
+{
+    quat_simd t0 = quat_unpacklo(*a, *b);
+    quat_simd t1 = quat_unpackhi(*a, *b);
+    quat_simd t2 = quat_unpacklo(*c, *d);
+    quat_simd t3 = quat_unpackhi(*c, *d);
+
+    *a = quat_shuffle(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    *b = quat_shuffle(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    *c = quat_shuffle(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    *d = quat_shuffle(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+static void quat_fast_slerp_simd(const quat* q0, const quat* q1, const float* t, quat* out)
+{
+#ifdef QUAT_AVX2
+    quat_simd x0 = _mm256_loadu_ps(&q0[0].x), y0 = _mm256_loadu_ps(&q0[2].x), z0 = _mm256_loadu_ps(&q0[4].x), w0 = _mm256_loadu_ps(&q0[6].x);
+    quat_simd x1 = _mm256_loadu_ps(&q1[0].x), y1 = _mm256_loadu_ps(&q1[2].x), z1 = _mm256_loadu_ps(&q1[4].x), w1 = _mm256_loadu_ps(&q1[6].x);
+    quat_simd u = _mm256_permutevar8x32_ps(_mm256_loadu_ps(t), _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+#else
+    quat_simd x0 = _mm_loadu_ps(&q0[0].x), y0 = _mm_loadu_ps(&q0[1].x), z0 = _mm_loadu_ps(&q0[2].x), w0 = _mm_loadu_ps(&q0[3].x);
+    quat_simd x1 = _mm_loadu_ps(&q1[0].x), y1 = _mm_loadu_ps(&q1[1].x), z1 = _mm_loadu_ps(&q1[2].x), w1 = _mm_loadu_ps(&q1[3].x);
+    quat_simd u = _mm_loadu_ps(t);
+#endif
+    quat_transpose(&x0, &y0, &z0, &w0);
+    quat_transpose(&x1, &y1, &z1, &w1);
+
+    quat_simd sign_bit = quat_set1(-0.0f);
+    quat_simd half = quat_set1(0.5f);
+    quat_simd one = quat_set1(1.0f);
+
+    quat_simd ca = quat_add(quat_add(quat_mul(x0, x1), quat_mul(y0, y1)), quat_add(quat_mul(z0, z1), quat_mul(w0, w1)));
+    quat_simd sign = quat_and(ca, sign_bit);
+    quat_simd d = quat_andnot(sign_bit, ca);
+
+    quat_simd a = quat_sub(quat_set1(3.55645f), quat_mul(d, quat_set1(1.43519f)));
+    a = quat_add(quat_set1(-3.2452f), quat_mul(d, a));
+    a = quat_add(quat_set1(1.0904f), quat_mul(d, a));
+
+    quat_simd b = quat_add(quat_set1(-1.06021f), quat_mul(d, quat_set1(0.215638f)));
+    b = quat_add(quat_set1(0.848013f), quat_mul(d, b));
+
+    quat_simd th = quat_sub(u, half);
+    quat_simd k = quat_add(quat_mul(a, quat_mul(th, th)), b);
+    quat_simd ot = quat_add(u, quat_mul(quat_mul(u, th), quat_mul(quat_sub(u, one), k)));
+
+    quat_simd s0 = quat_sub(one, ot);
+    quat_simd s1 = quat_xor(ot, sign);
+
+    quat_simd x = quat_add(quat_mul(x0, s0), quat_mul(x1, s1));
+    quat_simd y = quat_add(quat_mul(y0, s0), quat_mul(y1, s1));
+    quat_simd z = quat_add(quat_mul(z0, s0), quat_mul(z1, s1));
+    quat_simd w = quat_add(quat_mul(w0, s0), quat_mul(w1, s1));
+
+    quat_simd length = quat_sqrt(quat_add(quat_add(quat_mul(x, x), quat_mul(y, y)), quat_add(quat_mul(z, z), quat_mul(w, w))));
+    x = quat_div(x, length);
+    y = quat_div(y, length);
+    z = quat_div(z, length);
+    w = quat_div(w, length);
+
+    quat_transpose(&x, &y, &z, &w);
+#ifdef QUAT_AVX2
+    _mm256_storeu_ps(&out[0].x, x);
+    _mm256_storeu_ps(&out[2].x, y);
+    _mm256_storeu_ps(&out[4].x, z);
+    _mm256_storeu_ps(&out[6].x, w);
+#else
+    _mm_storeu_ps(&out[0].x, x);
+    _mm_storeu_ps(&out[1].x, y);
+    _mm_storeu_ps(&out[2].x, z);
+    _mm_storeu_ps(&out[3].x, w);
+#endif
+}
+
+#endif
+
+void quat_fast_slerp_array(const quat* q0, const quat* q1, const float* t, quat* out, size_t count)
+{
+    size_t i = 0;
+#if defined(QUAT_AVX2) || defined(QUAT_SSE)
+    for (; i + QUAT_LANES <= count; i += QUAT_LANES)
+        quat_fast_slerp_simd(&q0[i], &q1[i], &t[i], &out[i]);
+#endif
+    for (; i < count; ++i)
+        out[i] = quat_fast_slerp(q0[i], q1[i], t[i]);
+}
+
 quat quat_cast(mat4 mat)
 {
     float r = 0.f;
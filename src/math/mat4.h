@@ -3,6 +3,8 @@
 
 #include "vec3.h"
 
+#include <stddef.h>
+
 typedef struct quat
 {
     float x, y, z, w;
@@ -33,13 +35,29 @@ mat4 mat4_rotate_z(mat4 mat, float f);
 
 mat4 mat4_multiply(mat4 l, mat4 r);
 
+vec3 mat4_transform_point(mat4 m, vec3 v);
+
 mat4 mat4_invert(mat4 m);
 
+/*
+ * Column major 3x3 that transforms normals by m, normals have to be renormalized.
+ * Returns 0 if m is a rotation with uniform scale and its upper 3x3 was used as is.
+ */
+int mat4_normal_matrix(mat4 m, float* normal);
+
 mat4 mat4_interpolate(mat4 mat0, mat4 mat1, float time);
 
 quat quat_identity();
+quat quat_normalize(quat q);
 
 quat quat_slerp(quat q0, quat q1, float value);
+
+/*
+ * Approximate slerp without trigonometry, the error stays far below what is visible
+ * for animation keys. The array version interpolates 4 (SSE) or 8 (AVX2) at once.
+ */
+quat quat_fast_slerp(quat q0, quat q1, float t);
+void quat_fast_slerp_array(const quat* q0, const quat* q1, const float* t, quat* out, size_t count);
 quat quat_cast(mat4 mat);
 
 #endif /* !MAT4_H */
@@ -0,0 +1,290 @@
+#include "mat4x3.h"
+
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define MAT4X3_SSE
+#endif
+
+mat4x3 mat4x3_identity()
+{
+    mat4x3 result = {
+        1.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 0.0f
+    };
+    return result;
+}
+
+mat4x3 mat4x3_trs(vec3 t, quat q, vec3 s)
+{
+    float x2 = q.x + q.x;
+    float y2 = q.y + q.y;
+    float z2 = q.z + q.z;
+
+    float xx = q.x * x2;
+    float xy = q.x * y2;
+    float xz = q.x * z2;
+    float yy = q.y * y2;
+    float yz = q.y * z2;
+    float zz = q.z * z2;
+    float wx = q.w * x2;
+    float wy = q.w * y2;
+    float wz = q.w * z2;
+
+    mat4x3 result;
+    result.v[0][0] = (1.0f - (yy + zz)) * s.x;
+    result.v[0][1] = (xy + wz) * s.x;
+    result.v[0][2] = (xz - wy) * s.x;
+
+    result.v[1][0] = (xy - wz) * s.y;
+    result.v[1][1] = (1.0f - (xx + zz)) * s.y;
+    result.v[1][2] = (yz + wx) * s.y;
+
+    result.v[2][0] = (xz + wy) * s.z;
+    result.v[2][1] = (yz - wx) * s.z;
+    result.v[2][2] = (1.0f - (xx + yy)) * s.z;
+
+    result.v[3][0] = t.x;
+    result.v[3][1] = t.y;
+    result.v[3][2] = t.z;
+    return result;
+}
+
+mat4x3 mat4x3_multiply(mat4x3 l, mat4x3 r)
+{
+    mat4x3 result;
+    result.v[0][0] = l.v[0][0] * r.v[0][0] + l.v[1][0] * r.v[0][1] + l.v[2][0] * r.v[0][2];
+    result.v[0][1] = l.v[0][1] * r.v[0][0] + l.v[1][1] * r.v[0][1] + l.v[2][1] * r.v[0][2];
+    result.v[0][2] = l.v[0][2] * r.v[0][0] + l.v[1][2] * r.v[0][1] + l.v[2][2] * r.v[0][2];
+    result.v[1][0] = l.v[0][0] * r.v[1][0] + l.v[1][0] * r.v[1][1] + l.v[2][0] * r.v[1][2];
+    result.v[1][1] = l.v[0][1] * r.v[1][0] + l.v[1][1] * r.v[1][1] + l.v[2][1] * r.v[1][2];
+    result.v[1][2] = l.v[0][2] * r.v[1][0] + l.v[1][2] * r.v[1][1] + l.v[2][2] * r.v[1][2];
+    result.v[2][0] = l.v[0][0] * r.v[2][0] + l.v[1][0] * r.v[2][1] + l.v[2][0] * r.v[2][2];
+    result.v[2][1] = l.v[0][1] * r.v[2][0] + l.v[1][1] * r.v[2][1] + l.v[2][1] * r.v[2][2];
+    result.v[2][2] = l.v[0][2] * r.v[2][0] + l.v[1][2] * r.v[2][1] + l.v[2][2] * r.v[2][2];
+    result.v[3][0] = l.v[0][0] * r.v[3][0] + l.v[1][0] * r.v[3][1] + l.v[2][0] * r.v[3][2] + l.v[3][0];
+    result.v[3][1] = l.v[0][1] * r.v[3][0] + l.v[1][1] * r.v[3][1] + l.v[2][1] * r.v[3][2] + l.v[3][1];
+    result.v[3][2] = l.v[0][2] * r.v[3][0] + l.v[1][2] * r.v[3][1] + l.v[2][2] * r.v[3][2] + l.v[3][2];
+    return result;
+}
+
+#ifdef MAT4X3_SSE
+
+// out may alias l or r
+static void mat4x3_multiply_sse(const mat4x3* l, const mat4x3* r, mat4x3* out)
+{
+    // the fourth lane of the first three columns holds the next column and is never stored
+    __m128 l0 = _mm_loadu_ps(l->v[0]);
+    __m128 l1 = _mm_loadu_ps(l->v[1]);
+    __m128 l2 = _mm_loadu_ps(l->v[2]);
+    __m128 l3 = _mm_setr_ps(l->v[3][0], l->v[3][1], l->v[3][2], 0.0f);
+
+    __m128 c[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        c[i] = _mm_mul_ps(l0, _mm_set1_ps(r->v[i][0]));
+        c[i] = _mm_add_ps(c[i], _mm_mul_ps(l1, _mm_set1_ps(r->v[i][1])));
+        c[i] = _mm_add_ps(c[i], _mm_mul_ps(l2, _mm_set1_ps(r->v[i][2])));
+    }
+    c[3] = _mm_add_ps(c[3], l3);
+
+    // stored in order, so every spilled lane is overwritten by the following column
+    _mm_storeu_ps(out->v[0], c[0]);
+    _mm_storeu_ps(out->v[1], c[1]);
+    _mm_storeu_ps(out->v[2], c[2]);
+    _mm_storel_pi((__m64*)out->v[3], c[3]);
+    _mm_store_ss(&out->v[3][2], _mm_movehl_ps(c[3], c[3]));
+}
+
+// e[k] holds the k-th float of four matrices
+static void mat4x3_load4_sse(const mat4x3* const m[4], __m128 e[12])
+{
+    for (int k = 0; k < 12; k += 4)
+    {
+        __m128 r0 = _mm_loadu_ps((const float*)m[0]->v + k);
+        __m128 r1 = _mm_loadu_ps((const float*)m[1]->v + k);
+        __m128 r2 = _mm_loadu_ps((const float*)m[2]->v + k);
+        __m128 r3 = _mm_loadu_ps((const float*)m[3]->v + k);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        e[k + 0] = r0;
+        e[k + 1] = r1;
+        e[k + 2] = r2;
+        e[k + 3] = r3;
+    }
+}
+
+static void mat4x3_store4_sse(mat4x3* const m[4], const __m128 e[12])
+{
+    for (int k = 0; k < 12; k += 4)
+    {
+        __m128 r0 = e[k + 0], r1 = e[k + 1], r2 = e[k + 2], r3 = e[k + 3];
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps((float*)m[0]->v + k, r0);
+        _mm_storeu_ps((float*)m[1]->v + k, r1);
+        _mm_storeu_ps((float*)m[2]->v + k, r2);
+        _mm_storeu_ps((float*)m[3]->v + k, r3);
+    }
+}
+
+// four products per call, one joint in every lane, all inputs are read before the first store
+static void mat4x3_multiply4_sse(const mat4x3* const l[4], mat4x3* const r[4])
+{
+    __m128 a[12], b[12], out[12];
+    mat4x3_load4_sse(l, a);
+    mat4x3_load4_sse((const mat4x3* const*)r, b);
+
+    for (int c = 0; c < 4; ++c)
+    {
+        for (int row = 0; row < 3; ++row)
+        {
+            __m128 v = _mm_mul_ps(a[row], b[c * 3]);
+            v = _mm_add_ps(v, _mm_mul_ps(a[3 + row], b[c * 3 + 1]));
+            v = _mm_add_ps(v, _mm_mul_ps(a[6 + row], b[c * 3 + 2]));
+            if (c == 3) v = _mm_add_ps(v, a[9 + row]);
+            out[c * 3 + row] = v;
+        }
+    }
+
+    mat4x3_store4_sse(r, out);
+}
+
+#endif
+
+void mat4x3_multiply_parents(mat4x3* m, const uint32_t* parents, size_t begin, size_t end)
+{
+    size_t i = begin;
+#ifdef MAT4X3_SSE
+    // no parent lies in the range, so four joints of a level can be multiplied side by side
+    for (; i + 4 <= end; i += 4)
+    {
+        const mat4x3* l[4] = { &m[parents[i]], &m[parents[i + 1]], &m[parents[i + 2]], &m[parents[i + 3]] };
+        mat4x3* r[4] = { &m[i], &m[i + 1], &m[i + 2], &m[i + 3] };
+        mat4x3_multiply4_sse(l, r);
+    }
+
+    for (; i < end; ++i)
+        mat4x3_multiply_sse(&m[parents[i]], &m[i], &m[i]);
+#else
+    for (; i < end; ++i)
+        m[i] = mat4x3_multiply(m[parents[i]], m[i]);
+#endif
+}
+
+void mat4x3_multiply_array(mat4x3* l, const mat4x3* r, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+#ifdef MAT4X3_SSE
+        mat4x3_multiply_sse(&l[i], &r[i], &l[i]);
+#else
+        l[i] = mat4x3_multiply(l[i], r[i]);
+#endif
+    }
+}
+
+mat4x3 mat4x3_lerp(mat4x3 m0, mat4x3 m1, float value)
+{
+    mat4x3 result;
+    for (int c = 0; c < 4; ++c)
+    {
+        result.v[c][0] = m0.v[c][0] + value * (m1.v[c][0] - m0.v[c][0]);
+        result.v[c][1] = m0.v[c][1] + value * (m1.v[c][1] - m0.v[c][1]);
+        result.v[c][2] = m0.v[c][2] + value * (m1.v[c][2] - m0.v[c][2]);
+    }
+    return result;
+}
+
+quat mat4x3_rotation(mat4x3 m, float inv_scale)
+{
+    // r(row, column)
+    float r00 = m.v[0][0] * inv_scale, r01 = m.v[1][0] * inv_scale, r02 = m.v[2][0] * inv_scale;
+    float r10 = m.v[0][1] * inv_scale, r11 = m.v[1][1] * inv_scale, r12 = m.v[2][1] * inv_scale;
+    float r20 = m.v[0][2] * inv_scale, r21 = m.v[1][2] * inv_scale, r22 = m.v[2][2] * inv_scale;
+
+    quat q;
+    float trace = r00 + r11 + r22;
+    if (trace > 0.0f)
+    {
+        float s = 0.5f / sqrtf(trace + 1.0f);
+        q.w = 0.25f / s;
+        q.x = (r21 - r12) * s;
+        q.y = (r02 - r20) * s;
+        q.z = (r10 - r01) * s;
+    }
+    else if (r00 > r11 && r00 > r22)
+    {
+        float s = 2.0f * sqrtf(1.0f + r00 - r11 - r22);
+        q.w = (r21 - r12) / s;
+        q.x = 0.25f * s;
+        q.y = (r01 + r10) / s;
+        q.z = (r02 + r20) / s;
+    }
+    else if (r11 > r22)
+    {
+        float s = 2.0f * sqrtf(1.0f + r11 - r00 - r22);
+        q.w = (r02 - r20) / s;
+        q.x = (r01 + r10) / s;
+        q.y = 0.25f * s;
+        q.z = (r12 + r21) / s;
+    }
+    else
+    {
+        float s = 2.0f * sqrtf(1.0f + r22 - r00 - r11);
+        q.w = (r10 - r01) / s;
+        q.x = (r02 + r20) / s;
+        q.y = (r12 + r21) / s;
+        q.z = 0.25f * s;
+    }
+    return q;
+}
+
+int mat4x3_has_uniform_scale(mat4x3 m, float scale, float epsilon)
+{
+    float tolerance = scale * epsilon;
+    for (int c = 0; c < 3; ++c)
+    {
+        float length = vec3_length((vec3){ m.v[c][0], m.v[c][1], m.v[c][2] });
+        if (fabsf(length - scale) > tolerance) return 0;
+    }
+
+    // equal lengths are not enough, a blend of two rotations also shears the columns
+    for (int a = 0; a < 3; ++a)
+    {
+        vec3 first = { m.v[a][0], m.v[a][1], m.v[a][2] };
+        for (int b = a + 1; b < 3; ++b)
+        {
+            vec3 second = { m.v[b][0], m.v[b][1], m.v[b][2] };
+            if (fabsf(vec3_dot(first, second)) > scale * tolerance) return 0;
+        }
+    }
+    return 1;
+}
+
+mat4x3 mat4x3_cast(mat4 m)
+{
+    mat4x3 result;
+    for (int c = 0; c < 4; ++c)
+    {
+        result.v[c][0] = m.v[c][0];
+        result.v[c][1] = m.v[c][1];
+        result.v[c][2] = m.v[c][2];
+    }
+    return result;
+}
+
+mat4 mat4x3_to_mat4(mat4x3 m)
+{
+    mat4 result;
+    for (int c = 0; c < 4; ++c)
+    {
+        result.v[c][0] = m.v[c][0];
+        result.v[c][1] = m.v[c][1];
+        result.v[c][2] = m.v[c][2];
+        result.v[c][3] = 0.0f;
+    }
+    result.v[3][3] = 1.0f;
+    return result;
+}
@@ -0,0 +1,45 @@
+#ifndef MAT4X3_H
+#define MAT4X3_H
+
+#include "mat4.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Affine transform stored as 4 columns of 3 rows (like glsl mat4x3).
+ * The implicit last row is (0, 0, 0, 1).
+ */
+typedef struct
+{
+    float v[4][3];
+} mat4x3;
+
+mat4x3 mat4x3_identity();
+
+/* Composes translation * rotation * scale without building intermediate matrices */
+mat4x3 mat4x3_trs(vec3 t, quat q, vec3 s);
+
+mat4x3 mat4x3_multiply(mat4x3 l, mat4x3 r);
+
+/*
+ * Batched products, vectorized where available.
+ * multiply_parents: m[i] = m[parents[i]] * m[i] for i in [begin, end), no parent may lie in the range.
+ * multiply_array:   l[i] = l[i] * r[i]
+ */
+void mat4x3_multiply_parents(mat4x3* m, const uint32_t* parents, size_t begin, size_t end);
+void mat4x3_multiply_array(mat4x3* l, const mat4x3* r, size_t count);
+
+/* Component-wise interpolation, only suitable for transforms that are close together */
+mat4x3 mat4x3_lerp(mat4x3 m0, mat4x3 m1, float value);
+
+/* Rotation of a transform whose columns have the length 1 / inv_scale */
+quat mat4x3_rotation(mat4x3 m, float inv_scale);
+
+/* Columns of the length scale that are perpendicular to each other */
+int mat4x3_has_uniform_scale(mat4x3 m, float scale, float epsilon);
+
+mat4x3 mat4x3_cast(mat4 m);
+mat4   mat4x3_to_mat4(mat4x3 m);
+
+#endif /* !MAT4X3_H */
@@ -8,6 +8,8 @@
 #include "vec3.h"
 
 #include "mat4.h"
+#include "mat4x3.h"
+#include "frustum.h"
 
 #define MPI   3.1415926536f
 #define MPI_2 1.5707963268f
@@ -43,6 +43,11 @@ float vec3_dot(vec3 left, vec3 right)
     return left.x * right.x + left.y * right.y + left.z * right.z;
 }
 
+float vec3_length(vec3 v)
+{
+    return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+}
+
 vec3 vec3_negate(vec3 v)
 {
     return (vec3) { -v.x, -v.y, -v.z };
@@ -16,6 +16,7 @@ vec3 vec3_normalize(vec3 v);
 vec3 vec3_cross(vec3 left, vec3 right);
 
 float vec3_dot(vec3 left, vec3 right);
+float vec3_length(vec3 v);
 
 vec3 vec3_negate(vec3 v);
 
@@ -1,18 +1,130 @@
 #include "model.h"
 
-int loadAnimationChannelGLTF(AnimationChannel* channel, cgltf_animation_sampler* sampler)
+#include <string.h>
+
+static uint32_t loadAnimationTimelineGLTF(Animation* animation, const cgltf_accessor* input, const cgltf_accessor** inputs)
+{
+    for (uint32_t i = 0; i < animation->timeline_count; ++i)
+    {
+        if (inputs[i] == input) return i;
+    }
+
+    AnimationTimeline* timeline = &animation->timelines[animation->timeline_count];
+    timeline->times = malloc(input->count * sizeof(float));
+    if (!timeline->times) return ANIMATION_NO_TIMELINE;
+
+    timeline->count = cgltf_accessor_unpack_floats(input, timeline->times, input->count);
+
+    inputs[animation->timeline_count] = input;
+    return (uint32_t)animation->timeline_count++;
+}
+
+/*
+ * Turns the cubic spline keys (in-tangent, value, out-tangent) into Hermite segments in
+ * polynomial form, so sampling is a single Horner step per component
+ */
+static void getCubicCoefficients(const float* keys, const float* times, size_t count, size_t comps, float* coefficients)
 {
-    channel->frame_count = sampler->input->count;
+    for (size_t k = 0; k < count; ++k)
+    {
+        float* a = coefficients + k * comps * 4;
+        float* b = a + comps;
+        float* c = b + comps;
+        float* d = c + comps;
 
+        const float* p0 = keys + (k * 3 + 1) * comps;
+
+        // hold the last value
+        if (k + 1 == count)
+        {
+            for (size_t i = 0; i < comps; ++i)
+            {
+                a[i] = b[i] = c[i] = 0.0f;
+                d[i] = p0[i];
+            }
+            continue;
+        }
+
+        // tangents are scaled by the segment duration
+        float dt = times[k + 1] - times[k];
+        const float* out0 = keys + (k * 3 + 2) * comps;
+        const float* in1  = keys + (k * 3 + 3) * comps;
+        const float* p1   = keys + (k * 3 + 4) * comps;
+
+        for (size_t i = 0; i < comps; ++i)
+        {
+            float m0 = dt * out0[i];
+            float m1 = dt * in1[i];
+
+            a[i] = 2.0f * p0[i] + m0 - 2.0f * p1[i] + m1;
+            b[i] = -3.0f * p0[i] - 2.0f * m0 + 3.0f * p1[i] - m1;
+            c[i] = m0;
+            d[i] = p0[i];
+        }
+    }
+}
+
+/* Flips keys onto the hemisphere of their predecessor, so interpolation never has to */
+static void alignRotationKeys(AnimationChannel* channel)
+{
+    if (channel->interpolation == ANIMATION_CUBIC) return;
+
+    for (size_t k = 1; k < channel->frame_count; ++k)
+    {
+        const float* prev = &channel->transforms[(k - 1) * 4];
+        float* key = &channel->transforms[k * 4];
+
+        if (prev[0] * key[0] + prev[1] * key[1] + prev[2] * key[2] + prev[3] * key[3] >= 0.0f) continue;
+
+        for (int c = 0; c < 4; ++c)
+            key[c] = -key[c];
+    }
+}
+
+static AnimationInterpolation getInterpolationGLTF(cgltf_interpolation_type type)
+{
+    switch (type)
+    {
+    case cgltf_interpolation_type_step:         return ANIMATION_STEP;
+    case cgltf_interpolation_type_cubic_spline: return ANIMATION_CUBIC;
+    default:                                    return ANIMATION_LINEAR;
+    }
+}
+
+int loadAnimationChannelGLTF(Animation* animation, AnimationChannel* channel, const cgltf_animation_sampler* sampler, const cgltf_accessor** inputs)
+{
     // load input
-    channel->times = malloc(channel->frame_count * sizeof(float));
-    cgltf_accessor_unpack_floats(sampler->input, channel->times, channel->frame_count);
+    channel->timeline = loadAnimationTimelineGLTF(animation, sampler->input, inputs);
+    if (channel->timeline == ANIMATION_NO_TIMELINE) return IGNIS_FAILURE;
 
     // load output
-    size_t comps = cgltf_num_components(sampler->output->component_type);
-    channel->transforms = malloc(channel->frame_count * comps * sizeof(float));
-    cgltf_accessor_unpack_floats(sampler->output, channel->transforms, channel->frame_count * comps);
+    size_t count = sampler->input->count;
+    size_t comps = cgltf_num_components(sampler->output->type);
+    channel->interpolation = getInterpolationGLTF(sampler->interpolation);
+
+    if (channel->interpolation != ANIMATION_CUBIC)
+    {
+        channel->transforms = malloc(count * comps * sizeof(float));
+        if (!channel->transforms) return IGNIS_FAILURE;
+
+        cgltf_accessor_unpack_floats(sampler->output, channel->transforms, count * comps);
+        channel->frame_count = count;
+        return IGNIS_SUCCESS;
+    }
+
+    float* keys = malloc(count * 3 * comps * sizeof(float));
+    channel->transforms = malloc(count * 4 * comps * sizeof(float));
+    if (!keys || !channel->transforms)
+    {
+        free(keys);
+        return IGNIS_FAILURE;
+    }
+
+    cgltf_accessor_unpack_floats(sampler->output, keys, count * 3 * comps);
+    getCubicCoefficients(keys, animation->timelines[channel->timeline].times, count, comps, channel->transforms);
+    channel->frame_count = count;
 
+    free(keys);
     return IGNIS_SUCCESS;
 }
 
@@ -24,26 +136,39 @@ int loadAnimationChannelBindPose(AnimationChannel* channel, uint8_t comps, float
     for (uint8_t c = 0; c < comps; ++c)
         channel->transforms[c] = bind[c];
 
+    channel->timeline = ANIMATION_NO_TIMELINE;
+    channel->interpolation = ANIMATION_STEP;
     channel->frame_count = 1;
     return IGNIS_SUCCESS;
 }
 
 void destroyAnimationChannel(AnimationChannel* channel)
 {
-    if (channel->times)      free(channel->times);
     if (channel->transforms) free(channel->transforms);
 }
 
 size_t getNodeIndex(const cgltf_node* target, const cgltf_data* data)
 {
     if (data->skins_count)  return getJointIndex(target, &data->skins[0], data->skins[0].joints_count);
-    if (target->mesh)       return getMeshIndex(target->mesh, data->meshes, data->meshes_count);
-    return data->meshes_count;
+    return target - data->nodes;
 }
 
 int loadAnimationGLTF(Animation* animation, cgltf_animation* gltf_animation, const cgltf_data* data)
 {
-    animation->channel_count = data->skins_count ? data->skins[0].joints_count : data->meshes_count;
+    animation->channel_count = data->skins_count ? data->skins[0].joints_count : data->nodes_count;
+
+    // channels are stored in the same order as the joints or nodes of the model
+    uint32_t* order = malloc(animation->channel_count * sizeof(uint32_t));
+    uint32_t* remap = malloc(animation->channel_count * sizeof(uint32_t));
+    if (!order || !remap)
+    {
+        free(order);
+        free(remap);
+        return IGNIS_FAILURE;
+    }
+
+    if (data->skins_count)  getSkinJointOrder(data, &data->skins[0], order, remap);
+    else                    getNodeOrder(data, order, remap);
 
     animation->time = 0.0f;
     animation->duration = 0.0f;
@@ -51,7 +176,19 @@ int loadAnimationGLTF(Animation* animation, cgltf_animation* gltf_animation, con
     animation->translations = calloc(animation->channel_count, sizeof(AnimationChannel));
     animation->rotations    = calloc(animation->channel_count, sizeof(AnimationChannel));
     animation->scales       = calloc(animation->channel_count, sizeof(AnimationChannel));
-    if (!animation->translations || !animation->rotations || !animation->scales) return IGNIS_FAILURE;
+
+    // samplers usually share their input accessor, so there are at most as many timelines as samplers
+    animation->timelines = calloc(gltf_animation->samplers_count, sizeof(AnimationTimeline));
+    animation->timeline_count = 0;
+
+    const cgltf_accessor** inputs = malloc(gltf_animation->samplers_count * sizeof(cgltf_accessor*));
+    if (!animation->translations || !animation->rotations || !animation->scales || !animation->timelines || !inputs)
+    {
+        free(order);
+        free(remap);
+        free(inputs);
+        return IGNIS_FAILURE;
+    }
 
     for (size_t i = 0; i < gltf_animation->channels_count; ++i)
     {
@@ -59,17 +196,20 @@ int loadAnimationGLTF(Animation* animation, cgltf_animation* gltf_animation, con
         if (index >= animation->channel_count) // Animation channel for a node not in the armature
             continue;
 
+        index = remap[index];
+
         cgltf_animation_channel* channel = &gltf_animation->channels[i];
         switch (channel->target_path)
         {
         case cgltf_animation_path_type_translation:
-            loadAnimationChannelGLTF(&animation->translations[index], channel->sampler);
+            loadAnimationChannelGLTF(animation, &animation->translations[index], channel->sampler, inputs);
             break;
         case cgltf_animation_path_type_rotation:
-            loadAnimationChannelGLTF(&animation->rotations[index], channel->sampler);
+            loadAnimationChannelGLTF(animation, &animation->rotations[index], channel->sampler, inputs);
+            alignRotationKeys(&animation->rotations[index]);
             break;
         case cgltf_animation_path_type_scale:
-            loadAnimationChannelGLTF(&animation->scales[index], channel->sampler);
+            loadAnimationChannelGLTF(animation, &animation->scales[index], channel->sampler, inputs);
             break;
         default:
             IGNIS_WARN("MODEL: Unsupported target_path on channel %d's sampler. Skipping.", i);
@@ -80,13 +220,19 @@ int loadAnimationGLTF(Animation* animation, cgltf_animation* gltf_animation, con
         animation->duration = max(animation->duration, channel->sampler->input->max[0]);
     }
 
+    free(inputs);
 
-    if (!data->skins_count) return IGNIS_SUCCESS;
+    if (!data->skins_count)
+    {
+        free(order);
+        free(remap);
+        return IGNIS_SUCCESS;
+    }
 
     // fill missing channels
     for (size_t i = 0; i < animation->channel_count; ++i)
     {
-        cgltf_node* node = data->skins[0].joints[i];
+        cgltf_node* node = data->skins[0].joints[order[i]];
 
         // load translation
         if (animation->translations[i].frame_count == 0 && node->has_translation)
@@ -101,6 +247,8 @@ int loadAnimationGLTF(Animation* animation, cgltf_animation* gltf_animation, con
             loadAnimationChannelBindPose(&animation->scales[i], 3, node->scale);
     }
 
+    free(order);
+    free(remap);
 
     return IGNIS_SUCCESS;
 }
@@ -116,105 +264,367 @@ void destroyAnimation(Animation* animation)
     free(animation->translations);
     free(animation->rotations);
     free(animation->scales);
+
+    for (size_t i = 0; i < animation->timeline_count; ++i)
+        free(animation->timelines[i].times);
+    free(animation->timelines);
 }
 
-int getChannelKeyFrame(AnimationChannel* channel, float time)
+AnimationKey getTimelineKey(const AnimationTimeline* timeline, float time)
 {
-    if (!channel->times) return 0;
+    AnimationKey key = { 0, 0.0f };
+    if (!timeline->count || time <= timeline->times[0]) return key;
 
-    if (channel->times[0] > time) return -1;
-    if (channel->times[channel->frame_count - 1] < time) return channel->frame_count - 1;
+    size_t last = timeline->count - 1;
+    if (time >= timeline->times[last])
+    {
+        key.frame = (uint32_t)last;
+        return key;
+    }
 
-    for (size_t i = 0; i < channel->frame_count - 1; ++i)
+    // times[lo] <= time < times[hi]
+    size_t lo = 0, hi = last;
+    while (hi - lo > 1)
     {
-        if ((channel->times[i] <= time) && (time < channel->times[i + 1]))
-            return i;
+        size_t mid = (lo + hi) / 2;
+        if (timeline->times[mid] <= time) lo = mid;
+        else                              hi = mid;
     }
-    return 0;
+
+    key.frame = (uint32_t)lo;
+    key.factor = (time - timeline->times[lo]) / (timeline->times[hi] - timeline->times[lo]);
+    return key;
 }
 
-float getChannelTransform(AnimationChannel* channel, float time, uint8_t comps, float* t0, float* t1)
+AnimationKey* getAnimationKeys(const Animation* animation, float time, AnimationKey* buffer, size_t capacity)
 {
-    if (!channel->transforms) return 0.0f;
+    AnimationKey* keys = buffer;
+    if (animation->timeline_count > capacity)
+    {
+        keys = malloc(animation->timeline_count * sizeof(AnimationKey));
+        if (!keys) return NULL;
+    }
+
+    for (size_t i = 0; i < animation->timeline_count; ++i)
+        keys[i] = getTimelineKey(&animation->timelines[i], time);
+
+    return keys;
+}
 
-    int frame = getChannelKeyFrame(channel, time);
+void releaseAnimationKeys(AnimationKey* keys, AnimationKey* buffer)
+{
+    if (keys != buffer) free(keys);
+}
 
-    size_t offset = frame < 0 ? 0 : frame * comps;
+static AnimationKey getChannelKey(const Animation* animation, const AnimationChannel* channel, const AnimationKey* keys, float time)
+{
+    AnimationKey key = { 0, 0.0f };
+    if (channel->timeline == ANIMATION_NO_TIMELINE) return key;
+
+    if (keys) return keys[channel->timeline];
+    return getTimelineKey(&animation->timelines[channel->timeline], time);
+}
+
+/* Writes the key value to t0 and the next one to t1, returns the factor to blend them with */
+static float getChannelTransform(const AnimationChannel* channel, AnimationKey key, uint8_t comps, float* t0, float* t1)
+{
+    if (channel->interpolation == ANIMATION_CUBIC)
+    {
+        const float* a = channel->transforms + key.frame * comps * 4;
+        const float* b = a + comps;
+        const float* c = b + comps;
+        const float* d = c + comps;
+
+        float t = key.factor;
+        for (uint8_t i = 0; i < comps; ++i)
+            t0[i] = ((a[i] * t + b[i]) * t + c[i]) * t + d[i];
+
+        return 0.0f;
+    }
+
+    size_t offset = key.frame * comps;
     for (uint8_t i = 0; i < comps; ++i)
         t0[i] = channel->transforms[offset + i];
 
-    if (channel->frame_count <= 1 || !channel->times || frame < 0 || frame >= channel->frame_count - 1)
+    if (channel->interpolation == ANIMATION_STEP || key.factor == 0.0f || key.frame + 1 >= channel->frame_count)
         return 0.0f;
 
     offset += comps;
     for (uint8_t i = 0; i < comps; ++i)
         t1[i] = channel->transforms[offset + i];
 
-    return (time - channel->times[frame]) / (channel->times[frame + 1] - channel->times[frame]);
+    return key.factor;
 }
 
-int getAnimationTransform(const Animation* animation, size_t index, mat4* transform)
+/* keys may be NULL, then every channel searches its timeline for time */
+static int sampleAnimationChannels(const Animation* animation, size_t index, const AnimationKey* keys, float time, vec3* translation, quat* rotation, vec3* scale)
 {
     if (animation == NULL) return IGNIS_FAILURE;
     if (index >= animation->channel_count) return IGNIS_FAILURE;
 
-    AnimationChannel* translation = &animation->translations[index];
-    AnimationChannel* rotation = &animation->rotations[index];
-    AnimationChannel* scale = &animation->scales[index];
+    const AnimationChannel* translations = &animation->translations[index];
+    const AnimationChannel* rotations = &animation->rotations[index];
+    const AnimationChannel* scales = &animation->scales[index];
 
-    if (!translation->frame_count && !rotation->frame_count && !scale->frame_count) return IGNIS_FAILURE;
+    if (!translations->frame_count && !rotations->frame_count && !scales->frame_count) return IGNIS_FAILURE;
 
-    // translation
-    vec3 t0 = { 0 }, t1 = { 0 };
-    float t = getChannelTransform(translation, animation->time, 3, &t0.x, &t1.x);
-    mat4 T = mat4_translation(vec3_lerp(t0, t1, t));
+    if (translations->frame_count)
+    {
+        vec3 t0 = { 0 }, t1 = { 0 };
+        float t = getChannelTransform(translations, getChannelKey(animation, translations, keys, time), 3, &t0.x, &t1.x);
+        *translation = vec3_lerp(t0, t1, t);
+    }
 
-    // rotation
-    quat q0 = quat_identity(), q1 = quat_identity();
-    t = getChannelTransform(rotation, animation->time, 4, &q0.x, &q1.x);
-    mat4 R = mat4_cast(quat_slerp(q0, q1, t));
+    if (rotations->frame_count)
+    {
+        quat q0 = quat_identity(), q1 = quat_identity();
+        float t = getChannelTransform(rotations, getChannelKey(animation, rotations, keys, time), 4, &q0.x, &q1.x);
 
-    // scale
-    vec3 s0 = { 1.0f, 1.0f, 1.0f }, s1 = { 1.0f, 1.0f, 1.0f };
-    t = getChannelTransform(scale, animation->time, 3, &s0.x, &s1.x);
-    mat4 S = mat4_scale(vec3_lerp(s0, s1, t));
+        // splines leave the unit sphere between keys
+        if (rotations->interpolation == ANIMATION_CUBIC) *rotation = quat_normalize(q0);
+        else if (t == 0.0f)                              *rotation = q0;
+        else                                             *rotation = quat_fast_slerp(q0, q1, t);
+    }
+
+    if (scales->frame_count)
+    {
+        vec3 s0 = { 1.0f, 1.0f, 1.0f }, s1 = { 1.0f, 1.0f, 1.0f };
+        float t = getChannelTransform(scales, getChannelKey(animation, scales, keys, time), 3, &s0.x, &s1.x);
+        *scale = vec3_lerp(s0, s1, t);
+    }
 
-    // T * R * S
-    *transform = mat4_multiply(T, mat4_multiply(R, S));
     return IGNIS_SUCCESS;
 }
 
-void getAnimationJointTransforms(const Model* model, const Animation* animation, mat4* transforms)
+int sampleAnimationTRS(const Animation* animation, size_t index, float time, vec3* translation, quat* rotation, vec3* scale)
 {
-    transforms[0] = mat4_identity();
-    for (size_t i = 0; i < model->joint_count; ++i)
-    {
-        mat4 local = model->joint_locals[i];
-        getAnimationTransform(animation, i, &local);
+    return sampleAnimationChannels(animation, index, NULL, time, translation, rotation, scale);
+}
 
-        uint32_t parent = model->joints[i];
-        transforms[i] = mat4_multiply(transforms[parent], local);
-    }
+int sampleAnimationTRSKeys(const Animation* animation, size_t index, const AnimationKey* keys, vec3* translation, quat* rotation, vec3* scale)
+{
+    return sampleAnimationChannels(animation, index, keys, 0.0f, translation, rotation, scale);
+}
+
+size_t sampleAnimationTRSArray(const Animation* animation, const AnimationKey* keys, const uint32_t* joints, size_t count, NodeTransform* poses, uint8_t* sampled)
+{
+    quat q0[ANIMATION_BATCH_SIZE], q1[ANIMATION_BATCH_SIZE], rotations[ANIMATION_BATCH_SIZE];
+    float factors[ANIMATION_BATCH_SIZE];
+    size_t slots[ANIMATION_BATCH_SIZE];
 
-    for (size_t i = 0; i < model->joint_count; ++i)
+    size_t total = 0;
+    for (size_t base = 0; base < count; base += ANIMATION_BATCH_SIZE)
     {
-        transforms[i] = mat4_multiply(transforms[i], model->joint_inv_transforms[i]);
+        size_t end = base + ANIMATION_BATCH_SIZE < count ? base + ANIMATION_BATCH_SIZE : count;
+        size_t pending = 0;
+
+        for (size_t k = base; k < end; ++k)
+        {
+            uint32_t index = joints[k];
+            NodeTransform* pose = &poses[k];
+            sampled[k] = 0;
+
+            if (index >= animation->channel_count) continue;
+
+            const AnimationChannel* translations = &animation->translations[index];
+            const AnimationChannel* rotation = &animation->rotations[index];
+            const AnimationChannel* scales = &animation->scales[index];
+
+            if (!translations->frame_count && !rotation->frame_count && !scales->frame_count) continue;
+
+            sampled[k] = 1;
+            total++;
+
+            if (translations->frame_count)
+            {
+                vec3 t0 = { 0 }, t1 = { 0 };
+                float t = getChannelTransform(translations, getChannelKey(animation, translations, keys, 0.0f), 3, &t0.x, &t1.x);
+                pose->translation = vec3_lerp(t0, t1, t);
+            }
+
+            if (scales->frame_count)
+            {
+                vec3 s0 = { 1.0f, 1.0f, 1.0f }, s1 = { 1.0f, 1.0f, 1.0f };
+                float t = getChannelTransform(scales, getChannelKey(animation, scales, keys, 0.0f), 3, &s0.x, &s1.x);
+                pose->scale = vec3_lerp(s0, s1, t);
+            }
+
+            if (!rotation->frame_count) continue;
+
+            // rotations between two keys are collected and interpolated together
+            size_t p = pending;
+            q0[p] = quat_identity();
+            q1[p] = quat_identity();
+            factors[p] = getChannelTransform(rotation, getChannelKey(animation, rotation, keys, 0.0f), 4, &q0[p].x, &q1[p].x);
+
+            if (rotation->interpolation == ANIMATION_CUBIC) pose->rotation = quat_normalize(q0[p]);
+            else if (factors[p] == 0.0f)                    pose->rotation = q0[p];
+            else                                            slots[pending++] = k;
+        }
+
+        quat_fast_slerp_array(q0, q1, factors, rotations, pending);
+        for (size_t p = 0; p < pending; ++p)
+            poses[slots[p]].rotation = rotations[p];
     }
+
+    return total;
 }
 
-void getBindPose(const Model* model, mat4* out)
+// angle in radians between two rotations
+static float getRotationAngle(quat a, quat b)
 {
-    out[0] = mat4_identity();
-    for (size_t i = 0; i < model->joint_count; ++i)
+    float d = fabsf(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+    return 2.0f * acosf(d < 1.0f ? d : 1.0f);
+}
+
+float getAnimationSlerpError(const Animation* animation, size_t steps, float* array_error)
+{
+    // the reference is kept per entry, the batch is flushed through quat_fast_slerp_array when full
+    quat q0[ANIMATION_BATCH_SIZE], q1[ANIMATION_BATCH_SIZE], exact[ANIMATION_BATCH_SIZE], batched[ANIMATION_BATCH_SIZE];
+    float factors[ANIMATION_BATCH_SIZE];
+    size_t pending = 0;
+
+    float error = 0.0f, batch_error = 0.0f;
+    for (size_t i = 0; i < animation->channel_count; ++i)
     {
-        uint32_t parent = model->joints[i];
-        out[i] = mat4_multiply(out[parent], model->joint_locals[i]);
+        const AnimationChannel* channel = &animation->rotations[i];
+        if (channel->interpolation != ANIMATION_LINEAR) continue;
+
+        for (size_t k = 0; k + 1 < channel->frame_count; ++k)
+        {
+            for (size_t s = 1; s < steps; ++s)
+            {
+                size_t p = pending++;
+                memcpy(&q0[p], &channel->transforms[k * 4], sizeof(quat));
+                memcpy(&q1[p], &channel->transforms[k * 4 + 4], sizeof(quat));
+                factors[p] = (float)s / (float)steps;
+                exact[p] = quat_slerp(q0[p], q1[p], factors[p]);
+
+                error = fmaxf(error, getRotationAngle(exact[p], quat_fast_slerp(q0[p], q1[p], factors[p])));
+
+                if (pending < ANIMATION_BATCH_SIZE) continue;
+
+                quat_fast_slerp_array(q0, q1, factors, batched, pending);
+                for (size_t b = 0; b < pending; ++b)
+                    batch_error = fmaxf(batch_error, getRotationAngle(exact[b], batched[b]));
+                pending = 0;
+            }
+        }
     }
 
-    for (size_t i = 0; i < model->joint_count; ++i)
+    quat_fast_slerp_array(q0, q1, factors, batched, pending);
+    for (size_t b = 0; b < pending; ++b)
+        batch_error = fmaxf(batch_error, getRotationAngle(exact[b], batched[b]));
+
+    if (array_error) *array_error = batch_error * 180.0f / MPI;
+    return error * 180.0f / MPI;
+}
+
+int sampleAnimationTransform(const Animation* animation, size_t index, float time, mat4x3* transform)
+{
+    vec3 T = { 0.0f, 0.0f, 0.0f };
+    quat R = quat_identity();
+    vec3 S = { 1.0f, 1.0f, 1.0f };
+
+    if (!sampleAnimationTRS(animation, index, time, &T, &R, &S)) return IGNIS_FAILURE;
+
+    // T * R * S
+    *transform = mat4x3_trs(T, R, S);
+    return IGNIS_SUCCESS;
+}
+
+int getAnimationTransform(const Animation* animation, size_t index, mat4* transform)
+{
+    if (animation == NULL) return IGNIS_FAILURE;
+
+    mat4x3 affine;
+    if (!sampleAnimationTransform(animation, index, animation->time, &affine)) return IGNIS_FAILURE;
+
+    *transform = mat4x3_to_mat4(affine);
+    return IGNIS_SUCCESS;
+}
+
+void evaluateJointHierarchy(const Model* model, mat4x3* transforms)
+{
+    // roots stay as they are, every later level only depends on the levels before
+    for (size_t level = 1; level < model->joint_level_count; ++level)
+        mat4x3_multiply_parents(transforms, model->joints, model->joint_levels[level], model->joint_levels[level + 1]);
+
+    mat4x3_multiply_array(transforms, model->joint_inv_transforms, model->joint_count);
+}
+
+size_t sampleAnimationJointTransformsLOD(const Model* model, const Animation* animation, float time, uint8_t min_height, mat4x3* transforms)
+{
+    // every timeline is searched once, not once per channel
+    AnimationKey buffer[ANIMATION_STACK_KEYS];
+    AnimationKey* keys = animation ? getAnimationKeys(animation, time, buffer, ANIMATION_STACK_KEYS) : NULL;
+
+    uint32_t joints[ANIMATION_BATCH_SIZE];
+    NodeTransform poses[ANIMATION_BATCH_SIZE];
+    uint8_t sampled[ANIMATION_BATCH_SIZE];
+
+    size_t total = 0;
+    for (size_t base = 0; base < model->joint_count; base += ANIMATION_BATCH_SIZE)
     {
-        out[i] = mat4_multiply(out[i], model->joint_inv_transforms[i]);
+        size_t end = base + ANIMATION_BATCH_SIZE < model->joint_count ? base + ANIMATION_BATCH_SIZE : model->joint_count;
+        size_t count = 0;
+
+        for (size_t i = base; i < end; ++i)
+        {
+            transforms[i] = model->joint_locals[i];
+            if (!keys || model->joint_heights[i] < min_height) continue;
+
+            joints[count] = (uint32_t)i;
+            poses[count] = model->joint_rest[i];
+            count++;
+        }
+
+        if (!count) continue;
+
+        sampleAnimationTRSArray(animation, keys, joints, count, poses, sampled);
+        for (size_t k = 0; k < count; ++k)
+        {
+            if (sampled[k])
+                transforms[joints[k]] = mat4x3_trs(poses[k].translation, poses[k].rotation, poses[k].scale);
+        }
+        total += count;
     }
+
+    releaseAnimationKeys(keys, buffer);
+
+    evaluateJointHierarchy(model, transforms);
+    return total;
+}
+
+void sampleAnimationJointTransforms(const Model* model, const Animation* animation, float time, mat4x3* transforms)
+{
+    sampleAnimationJointTransformsLOD(model, animation, time, 0, transforms);
+}
+
+void getAnimationJointTransforms(const Model* model, const Animation* animation, mat4x3* transforms)
+{
+    if (!animation) getBindPose(model, transforms);
+    else sampleAnimationJointTransforms(model, animation, animation->time, transforms);
+}
+
+void getBindPose(const Model* model, mat4x3* out)
+{
+    memcpy(out, model->joint_locals, model->joint_count * sizeof(mat4x3));
+    evaluateJointHierarchy(model, out);
+}
+
+void loadDefaultAnimationLOD(AnimationLOD* lod, float radius)
+{
+    lod->enabled = 1;
+
+    lod->update_distances[0] = radius * 16.0f;
+    lod->update_distances[1] = radius * 32.0f;
+    lod->update_distances[2] = radius * 64.0f;
+
+    lod->leaf_distance = radius * 24.0f;
+    lod->leaf_height = 1;
+
+    lod->freeze_culled = 1;
 }
 
 void resetAnimation(Animation* animation)
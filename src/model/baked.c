@@ -0,0 +1,498 @@
+#include "model.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BAKED_ANIMATION_MAGIC   0x454B4142u // "BAKE"
+#define BAKED_ANIMATION_VERSION 2u
+
+#define BAKED_HASH_SEED         0xcbf29ce484222325ull
+#define BAKED_HASH_PRIME        0x100000001b3ull
+
+// attribute locations of baked.vert
+#define BAKED_LOCATION_INSTANCE 5   // mat4, occupies 5 to 8
+#define BAKED_LOCATION_CLIP     9
+#define BAKED_LOCATION_NORMAL   10  // mat3, occupies 10 to 12
+
+// ----------------------------------------------------------------
+// source hash
+// ----------------------------------------------------------------
+// fnv-1a
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= BAKED_HASH_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hashChannel(uint64_t hash, const AnimationChannel* channel, size_t comps)
+{
+    if (channel->interpolation == ANIMATION_CUBIC) comps *= 4;
+
+    hash = hashBytes(hash, &channel->timeline, sizeof(channel->timeline));
+    hash = hashBytes(hash, &channel->interpolation, sizeof(channel->interpolation));
+    hash = hashBytes(hash, &channel->frame_count, sizeof(channel->frame_count));
+    return hashBytes(hash, channel->transforms, channel->frame_count * comps * sizeof(float));
+}
+
+uint64_t getBakedAnimationHash(const Model* model, const AnimationList* animations, float frame_rate)
+{
+    uint64_t hash = BAKED_HASH_SEED;
+    hash = hashBytes(hash, &frame_rate, sizeof(frame_rate));
+
+    // skeleton
+    hash = hashBytes(hash, &model->joint_count, sizeof(model->joint_count));
+    hash = hashBytes(hash, model->joints, model->joint_count * sizeof(uint32_t));
+    hash = hashBytes(hash, model->joint_locals, model->joint_count * sizeof(mat4x3));
+    hash = hashBytes(hash, model->joint_inv_transforms, model->joint_count * sizeof(mat4x3));
+
+    // clips, down to every key
+    hash = hashBytes(hash, &animations->count, sizeof(animations->count));
+    for (size_t i = 0; i < animations->count; ++i)
+    {
+        const Animation* animation = &animations->data[i];
+        hash = hashBytes(hash, &animation->duration, sizeof(animation->duration));
+        hash = hashBytes(hash, &animation->channel_count, sizeof(animation->channel_count));
+        hash = hashBytes(hash, &animation->timeline_count, sizeof(animation->timeline_count));
+
+        for (size_t t = 0; t < animation->timeline_count; ++t)
+            hash = hashBytes(hash, animation->timelines[t].times, animation->timelines[t].count * sizeof(float));
+
+        for (size_t c = 0; c < animation->channel_count; ++c)
+        {
+            hash = hashChannel(hash, &animation->translations[c], 3);
+            hash = hashChannel(hash, &animation->rotations[c], 4);
+            hash = hashChannel(hash, &animation->scales[c], 3);
+        }
+    }
+
+    return hash;
+}
+
+// ----------------------------------------------------------------
+// baking
+// ----------------------------------------------------------------
+static uint16_t floatToHalf(float value)
+{
+    union { float f; uint32_t u; } bits = { value };
+
+    uint16_t sign = (uint16_t)((bits.u >> 16) & 0x8000u);
+    uint32_t abs = bits.u & 0x7FFFFFFFu;
+
+    if (abs > 0x7F800000u)  return sign | 0x7E00u; // nan
+    if (abs >= 0x47800000u) return sign | 0x7C00u; // too large, inf
+
+    if (abs >= 0x38800000u)
+    {
+        // normal, round to nearest even
+        abs += 0xFFFu + ((abs >> 13) & 1u);
+        return sign | (uint16_t)((abs - 0x38000000u) >> 13);
+    }
+
+    // subnormal or zero
+    uint32_t shift = 126u - (abs >> 23);
+    if (shift > 24u) return sign;
+
+    uint32_t mantissa = (abs & 0x7FFFFFu) | 0x800000u;
+    uint32_t half = (mantissa + (1u << (shift - 1u)) - 1u + ((mantissa >> shift) & 1u)) >> shift;
+    return sign | (uint16_t)half;
+}
+
+static void writeBakedFrame(uint16_t* dst, const mat4x3* joints, size_t count)
+{
+    // same row layout as the joint palette buffer
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (int r = 0; r < 3; ++r)
+        {
+            *dst++ = floatToHalf(joints[i].v[0][r]);
+            *dst++ = floatToHalf(joints[i].v[1][r]);
+            *dst++ = floatToHalf(joints[i].v[2][r]);
+            *dst++ = floatToHalf(joints[i].v[3][r]);
+        }
+    }
+}
+
+static int allocBakedAnimation(BakedAnimation* baked, size_t joint_count, size_t frame_count, size_t clip_count)
+{
+    baked->joint_count = joint_count;
+    baked->frame_count = frame_count;
+    baked->clip_count = clip_count;
+    baked->texture = 0;
+
+    baked->clips = calloc(clip_count, sizeof(BakedClip));
+    baked->data = malloc(frame_count * joint_count * BAKED_ANIMATION_TEXELS * 4 * sizeof(uint16_t));
+
+    if (!baked->clips || !baked->data)
+    {
+        destroyBakedAnimation(baked);
+        return IGNIS_FAILURE;
+    }
+
+    return IGNIS_SUCCESS;
+}
+
+int bakeAnimations(BakedAnimation* baked, const Model* model, const AnimationList* animations, float frame_rate)
+{
+    memset(baked, 0, sizeof(BakedAnimation));
+    if (!model->joint_count || !animations->count) return IGNIS_FAILURE;
+
+    // every clip gets at least one frame, frames are spaced evenly over the duration
+    size_t frame_count = 0;
+    for (size_t i = 0; i < animations->count; ++i)
+    {
+        float frames = ceilf(animations->data[i].duration * frame_rate);
+        frame_count += frames > 1.0f ? (size_t)frames : 1;
+    }
+
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if (frame_count > (size_t)max_size || model->joint_count * BAKED_ANIMATION_TEXELS > (size_t)max_size)
+    {
+        IGNIS_ERROR("BAKED: %zu frames of %zu joints exceed the max texture size of %d", frame_count, model->joint_count, max_size);
+        return IGNIS_FAILURE;
+    }
+
+    if (!allocBakedAnimation(baked, model->joint_count, frame_count, animations->count))
+        return IGNIS_FAILURE;
+
+    baked->source_hash = getBakedAnimationHash(model, animations, frame_rate);
+
+    mat4x3* joints = malloc(model->joint_count * sizeof(mat4x3));
+    if (!joints)
+    {
+        destroyBakedAnimation(baked);
+        return IGNIS_FAILURE;
+    }
+
+    size_t row_size = model->joint_count * BAKED_ANIMATION_TEXELS * 4;
+    size_t first_frame = 0;
+    for (size_t i = 0; i < animations->count; ++i)
+    {
+        const Animation* animation = &animations->data[i];
+        BakedClip* clip = &baked->clips[i];
+
+        float frames = ceilf(animation->duration * frame_rate);
+        clip->first_frame = (uint32_t)first_frame;
+        clip->frame_count = frames > 1.0f ? (uint32_t)frames : 1;
+        clip->duration = animation->duration;
+
+        for (uint32_t f = 0; f < clip->frame_count; ++f)
+        {
+            float time = animation->duration * (float)f / (float)clip->frame_count;
+            sampleAnimationJointTransforms(model, animation, time, joints);
+            writeBakedFrame(&baked->data[(first_frame + f) * row_size], joints, model->joint_count);
+        }
+
+        first_frame += clip->frame_count;
+    }
+
+    free(joints);
+    return IGNIS_SUCCESS;
+}
+
+void destroyBakedAnimation(BakedAnimation* baked)
+{
+    if (baked->texture) glDeleteTextures(1, &baked->texture);
+
+    free(baked->clips);
+    free(baked->data);
+    memset(baked, 0, sizeof(BakedAnimation));
+}
+
+int uploadBakedAnimation(BakedAnimation* baked)
+{
+    if (!baked->data) return IGNIS_FAILURE;
+
+    if (!baked->texture) glGenTextures(1, &baked->texture);
+
+    glBindTexture(GL_TEXTURE_2D, baked->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F,
+        (GLsizei)(baked->joint_count * BAKED_ANIMATION_TEXELS), (GLsizei)baked->frame_count,
+        0, GL_RGBA, GL_HALF_FLOAT, baked->data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return IGNIS_SUCCESS;
+}
+
+// ----------------------------------------------------------------
+// baked files
+// ----------------------------------------------------------------
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t joint_count;
+    uint32_t frame_count;
+    uint32_t clip_count;
+    uint32_t padding;
+    uint64_t source_hash;
+} BakedFileHeader;
+
+int saveBakedAnimation(const BakedAnimation* baked, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        IGNIS_ERROR("BAKED: [%s] Failed to open file for writing", path);
+        return IGNIS_FAILURE;
+    }
+
+    BakedFileHeader header = {
+        BAKED_ANIMATION_MAGIC,
+        BAKED_ANIMATION_VERSION,
+        (uint32_t)baked->joint_count,
+        (uint32_t)baked->frame_count,
+        (uint32_t)baked->clip_count,
+        0,
+        baked->source_hash
+    };
+
+    size_t data_count = baked->frame_count * baked->joint_count * BAKED_ANIMATION_TEXELS * 4;
+
+    int result = fwrite(&header, sizeof(header), 1, file) == 1
+              && fwrite(baked->clips, sizeof(BakedClip), baked->clip_count, file) == baked->clip_count
+              && fwrite(baked->data, sizeof(uint16_t), data_count, file) == data_count;
+
+    fclose(file);
+
+    if (!result) IGNIS_ERROR("BAKED: [%s] Failed to write baked animation", path);
+    return result ? IGNIS_SUCCESS : IGNIS_FAILURE;
+}
+
+int loadBakedAnimation(BakedAnimation* baked, const char* path)
+{
+    memset(baked, 0, sizeof(BakedAnimation));
+
+    size_t size = 0;
+    char* filedata = ignisReadFile(path, &size);
+    if (!filedata) return IGNIS_FAILURE;
+
+    BakedFileHeader header;
+    if (size < sizeof(header))
+    {
+        free(filedata);
+        return IGNIS_FAILURE;
+    }
+    memcpy(&header, filedata, sizeof(header));
+
+    size_t clip_size = header.clip_count * sizeof(BakedClip);
+    size_t data_size = (size_t)header.frame_count * header.joint_count * BAKED_ANIMATION_TEXELS * 4 * sizeof(uint16_t);
+
+    if (header.magic != BAKED_ANIMATION_MAGIC || header.version != BAKED_ANIMATION_VERSION
+        || size != sizeof(header) + clip_size + data_size)
+    {
+        IGNIS_ERROR("BAKED: [%s] Not a valid baked animation", path);
+        free(filedata);
+        return IGNIS_FAILURE;
+    }
+
+    if (!allocBakedAnimation(baked, header.joint_count, header.frame_count, header.clip_count))
+    {
+        free(filedata);
+        return IGNIS_FAILURE;
+    }
+
+    memcpy(baked->clips, filedata + sizeof(header), clip_size);
+    memcpy(baked->data, filedata + sizeof(header) + clip_size, data_size);
+    baked->source_hash = header.source_hash;
+
+    free(filedata);
+
+    // the texture has to fit and every clip has to stay inside it, same as when baking
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if (baked->frame_count > (size_t)max_size || baked->joint_count * BAKED_ANIMATION_TEXELS > (size_t)max_size)
+    {
+        IGNIS_ERROR("BAKED: [%s] %zu frames of %zu joints exceed the max texture size of %d", path, baked->frame_count, baked->joint_count, max_size);
+        destroyBakedAnimation(baked);
+        return IGNIS_FAILURE;
+    }
+
+    for (size_t i = 0; i < baked->clip_count; ++i)
+    {
+        const BakedClip* clip = &baked->clips[i];
+        if (!clip->frame_count || (uint64_t)clip->first_frame + clip->frame_count > baked->frame_count)
+        {
+            IGNIS_ERROR("BAKED: [%s] Clip %zu is outside of the %zu baked frames", path, i, baked->frame_count);
+            destroyBakedAnimation(baked);
+            return IGNIS_FAILURE;
+        }
+    }
+
+    return IGNIS_SUCCESS;
+}
+
+// ----------------------------------------------------------------
+// baked crowd
+// ----------------------------------------------------------------
+/* The mesh part of every draw does not change, baked.vert applies the per instance part on top */
+static int loadBakedDrawBlocks(BakedCrowd* crowd)
+{
+    const Model* model = crowd->model;
+    if (!model->instance_count) return IGNIS_SUCCESS;
+
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment < 1) alignment = 1;
+
+    size_t stride = (sizeof(DrawUniforms) + alignment - 1) / alignment * alignment;
+    uint8_t* blocks = calloc(model->instance_count, stride);
+    if (!blocks) return IGNIS_FAILURE;
+
+    for (size_t i = 0; i < model->instance_count; ++i)
+    {
+        DrawUniforms* draw = (DrawUniforms*)(blocks + i * stride);
+        draw->model = model->transforms[i];
+        draw->material = model->meshes[model->instances[i]].material;
+
+        float normal_matrix[9];
+        mat4_normal_matrix(draw->model, normal_matrix);
+        for (int c = 0; c < 3; ++c)
+            memcpy(draw->normal_matrix[c], &normal_matrix[c * 3], 3 * sizeof(float));
+    }
+
+    glGenBuffers(1, &crowd->draw_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, crowd->draw_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, model->instance_count * stride, blocks, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    crowd->draw_stride = stride;
+    free(blocks);
+    return IGNIS_SUCCESS;
+}
+
+int createBakedCrowd(BakedCrowd* crowd, const Model* model, const BakedAnimation* baked)
+{
+    memset(crowd, 0, sizeof(BakedCrowd));
+    if (baked->joint_count != model->joint_count) return IGNIS_FAILURE;
+
+    crowd->model = model;
+    crowd->baked = baked;
+
+    glGenBuffers(1, &crowd->instance_buffer);
+
+    // the model geometry with the per instance attributes of the crowd
+    glGenVertexArrays(1, &crowd->vao);
+    glBindVertexArray(crowd->vao);
+    bindModelGeometry(model);
+
+    GLsizei stride = sizeof(BakedInstance);
+    glBindBuffer(GL_ARRAY_BUFFER, crowd->instance_buffer);
+
+    for (GLuint c = 0; c < 4; ++c)
+    {
+        glEnableVertexAttribArray(BAKED_LOCATION_INSTANCE + c);
+        glVertexAttribPointer(BAKED_LOCATION_INSTANCE + c, 4, GL_FLOAT, GL_FALSE, stride, (const void*)(c * 4 * sizeof(float)));
+        glVertexAttribDivisor(BAKED_LOCATION_INSTANCE + c, 1);
+    }
+
+    glEnableVertexAttribArray(BAKED_LOCATION_CLIP);
+    glVertexAttribPointer(BAKED_LOCATION_CLIP, 4, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(BakedInstance, first_frame));
+    glVertexAttribDivisor(BAKED_LOCATION_CLIP, 1);
+
+    for (GLuint c = 0; c < 3; ++c)
+    {
+        const void* offset = (const void*)(offsetof(BakedInstance, normal_matrix) + c * 3 * sizeof(float));
+        glEnableVertexAttribArray(BAKED_LOCATION_NORMAL + c);
+        glVertexAttribPointer(BAKED_LOCATION_NORMAL + c, 3, GL_FLOAT, GL_FALSE, stride, offset);
+        glVertexAttribDivisor(BAKED_LOCATION_NORMAL + c, 1);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return loadBakedDrawBlocks(crowd);
+}
+
+void destroyBakedCrowd(BakedCrowd* crowd)
+{
+    if (crowd->instance_buffer) glDeleteBuffers(1, &crowd->instance_buffer);
+    if (crowd->draw_buffer) glDeleteBuffers(1, &crowd->draw_buffer);
+    if (crowd->vao) glDeleteVertexArrays(1, &crowd->vao);
+
+    free(crowd->instances);
+    memset(crowd, 0, sizeof(BakedCrowd));
+}
+
+void clearBakedCrowd(BakedCrowd* crowd)
+{
+    crowd->instance_count = 0;
+    crowd->dirty = 1;
+}
+
+int addBakedInstance(BakedCrowd* crowd, mat4 transform, uint32_t clip, float time_offset, float speed)
+{
+    if (clip >= crowd->baked->clip_count) return IGNIS_FAILURE;
+
+    if (crowd->instance_count >= crowd->instance_capacity)
+    {
+        size_t capacity = crowd->instance_capacity ? crowd->instance_capacity * 2 : 256;
+        BakedInstance* instances = realloc(crowd->instances, capacity * sizeof(BakedInstance));
+        if (!instances) return IGNIS_FAILURE;
+
+        crowd->instances = instances;
+        crowd->instance_capacity = capacity;
+    }
+
+    const BakedClip* baked_clip = &crowd->baked->clips[clip];
+    float frame_rate = baked_clip->duration > 0.0f ? baked_clip->frame_count / baked_clip->duration : 0.0f;
+
+    BakedInstance* instance = &crowd->instances[crowd->instance_count++];
+    instance->transform = transform;
+    mat4_normal_matrix(transform, instance->normal_matrix);
+    instance->first_frame = (float)baked_clip->first_frame;
+    instance->frame_count = (float)baked_clip->frame_count;
+    instance->frame_rate = frame_rate * speed;
+    instance->frame_offset = frame_rate * time_offset;
+
+    crowd->dirty = 1;
+    return IGNIS_SUCCESS;
+}
+
+void renderBakedCrowd(BakedCrowd* crowd, IgnisShader shader)
+{
+    const Model* model = crowd->model;
+    if (!crowd->instance_count) return;
+
+    if (crowd->dirty)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, crowd->instance_buffer);
+        glBufferData(GL_ARRAY_BUFFER, crowd->instance_count * sizeof(BakedInstance), crowd->instances, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        crowd->dirty = 0;
+    }
+
+    ignisUseShader(shader);
+
+    glActiveTexture(GL_TEXTURE0 + BAKED_ANIMATION_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, crowd->baked->texture);
+    glActiveTexture(GL_TEXTURE0);
+
+    bindMaterialSet(&model->material_set);
+    glBindVertexArray(crowd->vao);
+
+    for (size_t i = 0; i < model->instance_count; ++i)
+    {
+        const Mesh* mesh = &model->meshes[model->instances[i]];
+
+        glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_UNIFORM_BINDING, crowd->draw_buffer, i * crowd->draw_stride, sizeof(DrawUniforms));
+
+        const void* indices = (const void*)(mesh->first_index * sizeof(uint32_t));
+        glDrawElementsInstancedBaseVertex(mesh->type, (GLsizei)mesh->index_count, GL_UNSIGNED_INT, indices, (GLsizei)crowd->instance_count, (GLint)mesh->base_vertex);
+    }
+
+    glBindVertexArray(0);
+}
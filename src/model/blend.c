@@ -0,0 +1,281 @@
+#include "model.h"
+
+#include <string.h>
+
+static float wrapLayerTime(const Animation* clip, float time)
+{
+    if (clip->duration <= 0.0f) return time;
+
+    time = fmodf(time, clip->duration);
+    return time < 0.0f ? time + clip->duration : time;
+}
+
+void setAnimationBlend(AnimationBlend* blend, const Animation* clip)
+{
+    blend->count = 0;
+    if (clip) addAnimationLayer(blend, clip, 1.0f, NULL);
+}
+
+int addAnimationLayer(AnimationBlend* blend, const Animation* clip, float weight, const JointMask* mask)
+{
+    if (!clip || blend->count >= ANIMATION_BLEND_LAYERS) return IGNIS_FAILURE;
+
+    AnimationLayer* layer = &blend->layers[blend->count++];
+    layer->clip = clip;
+    layer->time = 0.0f;
+    layer->speed = 1.0f;
+    layer->weight = weight;
+    layer->target_weight = weight;
+    layer->fade_rate = 0.0f;
+    layer->mask = mask;
+
+    return IGNIS_SUCCESS;
+}
+
+/* Masked layers are at the top of the stack, the full body layers below them */
+static size_t getMaskedLayerStart(const AnimationBlend* blend)
+{
+    size_t first = blend->count;
+    while (first > 0 && blend->layers[first - 1].mask) first--;
+    return first;
+}
+
+int crossfadeAnimation(AnimationBlend* blend, const Animation* clip, float duration)
+{
+    if (!clip || duration <= 0.0f)
+    {
+        setAnimationBlend(blend, clip);
+        return IGNIS_SUCCESS;
+    }
+
+    // already fading to this clip
+    size_t top = getMaskedLayerStart(blend);
+    if (top && blend->layers[top - 1].clip == clip)
+        return IGNIS_SUCCESS;
+
+    // the bottom layer of a full stack is the one covered the most
+    if (blend->count >= ANIMATION_BLEND_LAYERS)
+    {
+        if (!top) return IGNIS_FAILURE;
+
+        memmove(&blend->layers[0], &blend->layers[1], (blend->count - 1) * sizeof(AnimationLayer));
+        blend->count--;
+        top--;
+    }
+
+    // goes in below the masked layers
+    AnimationLayer masked[ANIMATION_BLEND_LAYERS];
+    size_t masked_count = blend->count - top;
+    memcpy(masked, &blend->layers[top], masked_count * sizeof(AnimationLayer));
+    blend->count = top;
+
+    addAnimationLayer(blend, clip, 0.0f, NULL);
+
+    AnimationLayer* layer = &blend->layers[blend->count - 1];
+    layer->target_weight = 1.0f;
+    layer->fade_rate = 1.0f / duration;
+
+    memcpy(&blend->layers[blend->count], masked, masked_count * sizeof(AnimationLayer));
+    blend->count += masked_count;
+
+    return IGNIS_SUCCESS;
+}
+
+int fadeMaskedLayer(AnimationBlend* blend, const Animation* clip, const JointMask* mask, float weight, float duration)
+{
+    AnimationLayer* layer = NULL;
+    for (size_t i = getMaskedLayerStart(blend); i < blend->count; ++i)
+    {
+        if (blend->layers[i].mask == mask) layer = &blend->layers[i];
+    }
+
+    if (!layer)
+    {
+        if (weight <= 0.0f) return IGNIS_SUCCESS;
+        if (!addAnimationLayer(blend, clip, 0.0f, mask)) return IGNIS_FAILURE;
+
+        layer = &blend->layers[blend->count - 1];
+    }
+    else if (clip && clip != layer->clip && weight > 0.0f)
+    {
+        layer->clip = clip;
+        layer->time = 0.0f;
+    }
+
+    layer->target_weight = weight;
+    if (duration > 0.0f)
+    {
+        layer->fade_rate = 1.0f / duration;
+    }
+    else
+    {
+        layer->weight = weight;
+        layer->fade_rate = 0.0f;
+    }
+
+    return IGNIS_SUCCESS;
+}
+
+void tickAnimationBlend(AnimationBlend* blend, float deltatime)
+{
+    size_t first = 0;
+    for (size_t i = 0; i < blend->count; ++i)
+    {
+        AnimationLayer* layer = &blend->layers[i];
+        layer->time = wrapLayerTime(layer->clip, layer->time + deltatime * layer->speed);
+
+        if (layer->fade_rate > 0.0f)
+        {
+            float step = layer->fade_rate * deltatime;
+            if (fabsf(layer->target_weight - layer->weight) <= step)
+            {
+                layer->weight = layer->target_weight;
+                layer->fade_rate = 0.0f;
+            }
+            else
+            {
+                layer->weight += layer->weight < layer->target_weight ? step : -step;
+            }
+        }
+
+        // an opaque layer hides everything below it
+        if (layer->weight >= 1.0f && !layer->mask) first = i;
+    }
+
+    size_t count = 0;
+    for (size_t i = first; i < blend->count; ++i)
+    {
+        const AnimationLayer* layer = &blend->layers[i];
+        if (layer->weight <= 0.0f && layer->target_weight <= 0.0f) continue;
+
+        blend->layers[count++] = *layer;
+    }
+    blend->count = count;
+}
+
+static void blendNodeTransform(NodeTransform* dst, const NodeTransform* src, float weight)
+{
+    if (weight >= 1.0f)
+    {
+        *dst = *src;
+        return;
+    }
+
+    dst->translation = vec3_lerp(dst->translation, src->translation, weight);
+    dst->scale = vec3_lerp(dst->scale, src->scale, weight);
+
+    // nlerp along the shorter arc
+    quat a = dst->rotation, b = src->rotation;
+    float sign = (a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w) < 0.0f ? -1.0f : 1.0f;
+    float w0 = 1.0f - weight, w1 = weight * sign;
+
+    dst->rotation = quat_normalize((quat){
+        a.x * w0 + b.x * w1,
+        a.y * w0 + b.y * w1,
+        a.z * w0 + b.z * w1,
+        a.w * w0 + b.w * w1
+    });
+}
+
+size_t sampleAnimationBlendLOD(const Model* model, const AnimationBlend* blend, float time_offset, uint8_t min_height, AnimationKey* scratch, size_t scratch_keys, mat4x3* transforms)
+{
+    // timelines are searched once per layer, layers without weight are never sampled
+    AnimationKey stack[ANIMATION_BLEND_LAYERS][ANIMATION_STACK_KEYS];
+    AnimationKey* buffers[ANIMATION_BLEND_LAYERS];
+    AnimationKey* keys[ANIMATION_BLEND_LAYERS] = { NULL };
+
+    size_t capacity = scratch ? scratch_keys : ANIMATION_STACK_KEYS;
+    for (size_t l = 0; l < ANIMATION_BLEND_LAYERS; ++l)
+        buffers[l] = scratch ? &scratch[l * scratch_keys] : stack[l];
+
+    // masked layers walk their joint list alongside the skeleton
+    size_t cursors[ANIMATION_BLEND_LAYERS] = { 0 };
+
+    for (size_t l = 0; l < blend->count; ++l)
+    {
+        const AnimationLayer* layer = &blend->layers[l];
+        if (layer->weight <= 0.0f) continue;
+
+        float time = wrapLayerTime(layer->clip, layer->time + time_offset * layer->speed);
+        keys[l] = layer->mask
+            ? getAnimationKeysMasked(layer->clip, time, layer->mask, buffers[l], capacity)
+            : getAnimationKeys(layer->clip, time, buffers[l], capacity);
+    }
+
+    // joints are blended in batches, so every layer interpolates the rotations of a batch together
+    uint32_t joints[ANIMATION_BATCH_SIZE];
+    NodeTransform poses[ANIMATION_BATCH_SIZE];
+
+    uint32_t layer_joints[ANIMATION_BATCH_SIZE];
+    size_t layer_slots[ANIMATION_BATCH_SIZE];
+    float layer_weights[ANIMATION_BATCH_SIZE];
+    NodeTransform locals[ANIMATION_BATCH_SIZE];
+    uint8_t sampled[ANIMATION_BATCH_SIZE];
+
+    size_t total = 0;
+    for (size_t base = 0; base < model->joint_count; base += ANIMATION_BATCH_SIZE)
+    {
+        size_t end = base + ANIMATION_BATCH_SIZE < model->joint_count ? base + ANIMATION_BATCH_SIZE : model->joint_count;
+        size_t count = 0;
+
+        for (size_t i = base; i < end; ++i)
+        {
+            if (model->joint_heights[i] < min_height)
+            {
+                transforms[i] = model->joint_locals[i];
+                continue;
+            }
+
+            joints[count] = (uint32_t)i;
+            poses[count] = model->joint_rest[i];
+            count++;
+        }
+
+        for (size_t l = 0; l < blend->count; ++l)
+        {
+            const AnimationLayer* layer = &blend->layers[l];
+            if (!keys[l]) continue;
+
+            // pick the joints of the batch this layer contributes to
+            size_t layer_count = 0;
+            for (size_t k = 0; k < count; ++k)
+            {
+                float weight = layer->weight;
+                if (layer->mask)
+                {
+                    const JointMask* mask = layer->mask;
+                    while (cursors[l] < mask->count && mask->joints[cursors[l]] < joints[k]) cursors[l]++;
+
+                    if (cursors[l] >= mask->count || mask->joints[cursors[l]] != joints[k]) continue;
+                    weight *= mask->weights[cursors[l]];
+                }
+                if (weight <= 0.0f) continue;
+
+                layer_joints[layer_count] = joints[k];
+                layer_slots[layer_count] = k;
+                layer_weights[layer_count] = weight;
+                locals[layer_count] = model->joint_rest[joints[k]];
+                layer_count++;
+            }
+
+            if (!layer_count) continue;
+
+            sampleAnimationTRSArray(layer->clip, keys[l], layer_joints, layer_count, locals, sampled);
+            for (size_t k = 0; k < layer_count; ++k)
+            {
+                if (sampled[k]) blendNodeTransform(&poses[layer_slots[k]], &locals[k], layer_weights[k]);
+            }
+        }
+
+        for (size_t k = 0; k < count; ++k)
+            transforms[joints[k]] = mat4x3_trs(poses[k].translation, poses[k].rotation, poses[k].scale);
+
+        total += count;
+    }
+
+    for (size_t l = 0; l < blend->count; ++l)
+        releaseAnimationKeys(keys[l], buffers[l]);
+
+    evaluateJointHierarchy(model, transforms);
+    return total;
+}
@@ -0,0 +1,440 @@
+#include "model.h"
+
+#include <string.h>
+
+typedef struct
+{
+    aabb bounds;
+    uint32_t count;
+} BVHBin;
+
+/* A subtree left for the parallel phase, its root is already allocated in the tree */
+typedef struct
+{
+    uint32_t node;
+    uint32_t first;
+    uint32_t count;
+    uint32_t depth;
+
+    size_t scratch;     // first node of the subtree in BVHBuilder::scratch
+    size_t node_count;  // nodes of the subtree, including its root
+} BVHTask;
+
+typedef struct
+{
+    const aabb* bounds;
+    const vec3* centroids;
+    uint32_t* items;
+
+    BVHTask* tasks;
+    size_t task_count;
+
+    BVHNode* scratch;
+} BVHBuilder;
+
+typedef struct
+{
+    uint32_t node;
+    uint8_t planes;
+} BVHCullEntry;
+
+typedef struct
+{
+    uint32_t node;
+    float distance;
+} BVHRayEntry;
+
+void destroyBVH(BVH* bvh)
+{
+    free(bvh->nodes);
+    free(bvh->items);
+    free(bvh->item_bounds);
+    memset(bvh, 0, sizeof(BVH));
+}
+
+/* aabb_merge in place, the build calls this for every item on every level */
+static void growBounds(aabb* box, aabb b)
+{
+    if (b.min.x < box->min.x) box->min.x = b.min.x;
+    if (b.min.y < box->min.y) box->min.y = b.min.y;
+    if (b.min.z < box->min.z) box->min.z = b.min.z;
+    if (b.max.x > box->max.x) box->max.x = b.max.x;
+    if (b.max.y > box->max.y) box->max.y = b.max.y;
+    if (b.max.z > box->max.z) box->max.z = b.max.z;
+}
+
+/* aabb_surface_area without the empty check, only used on boxes that have items */
+static float getArea(aabb box)
+{
+    float x = box.max.x - box.min.x, y = box.max.y - box.min.y, z = box.max.z - box.min.z;
+    return 2.0f * (x * y + y * z + z * x);
+}
+
+static uint32_t getBVHBin(float value, float min, float scale)
+{
+    uint32_t bin = (uint32_t)((value - min) * scale);
+    return bin < BVH_BINS ? bin : BVH_BINS - 1;
+}
+
+static float getCentroidAxis(vec3 c, int axis)
+{
+    return axis == 0 ? c.x : (axis == 1 ? c.y : c.z);
+}
+
+/* Partitions the items and returns the size of the left child, 0 to make a leaf */
+static uint32_t splitBVHNode(BVHBuilder* builder, aabb bounds, aabb centers, uint32_t first, uint32_t count)
+{
+    if (count <= BVH_LEAF_SIZE) return 0;
+
+    uint32_t* items = &builder->items[first];
+
+    float min[3] = { centers.min.x, centers.min.y, centers.min.z };
+    float extent[3] = { centers.max.x - min[0], centers.max.y - min[1], centers.max.z - min[2] };
+    float scale[3];
+
+    // bin all three axes in one pass over the items
+    BVHBin empty = { aabb_empty(), 0 };
+    BVHBin bins[3][BVH_BINS];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        scale[axis] = extent[axis] > 0.0f ? BVH_BINS / extent[axis] : 0.0f;
+        for (uint32_t b = 0; b < BVH_BINS; ++b)
+            bins[axis][b] = empty;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        vec3 c = builder->centroids[items[i]];
+        aabb box = builder->bounds[items[i]];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (extent[axis] <= 0.0f) continue;
+
+            BVHBin* bin = &bins[axis][getBVHBin(getCentroidAxis(c, axis), min[axis], scale[axis])];
+            growBounds(&bin->bounds, box);
+            bin->count++;
+        }
+    }
+
+    float best_cost = INFINITY;
+    int best_axis = -1;
+    uint32_t best_split = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (extent[axis] <= 0.0f) continue;
+
+        // cost of everything right of each plane
+        float right_cost[BVH_BINS];
+        aabb box = empty.bounds;
+        uint32_t n = 0;
+        for (uint32_t b = BVH_BINS - 1; b > 0; --b)
+        {
+            growBounds(&box, bins[axis][b].bounds);
+            n += bins[axis][b].count;
+            right_cost[b] = n ? getArea(box) * n : 0.0f;
+        }
+
+        box = empty.bounds;
+        n = 0;
+        for (uint32_t b = 0; b < BVH_BINS - 1; ++b)
+        {
+            growBounds(&box, bins[axis][b].bounds);
+            n += bins[axis][b].count;
+            if (!n || n == count) continue;
+
+            float cost = getArea(box) * n + right_cost[b + 1];
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b + 1;
+            }
+        }
+    }
+
+    float area = aabb_surface_area(bounds);
+    if (best_axis < 0 || BVH_TRAVERSAL_COST * area + best_cost >= area * count)
+    {
+        if (count <= BVH_MAX_LEAF_SIZE) return 0;
+
+        // all centroids in one spot, any split is as good as another
+        if (best_axis < 0) return count / 2;
+    }
+
+    uint32_t left = 0, right = count;
+    while (left < right)
+    {
+        vec3 c = builder->centroids[items[left]];
+        if (getBVHBin(getCentroidAxis(c, best_axis), min[best_axis], scale[best_axis]) < best_split)
+        {
+            left++;
+        }
+        else
+        {
+            uint32_t item = items[left];
+            items[left] = items[--right];
+            items[right] = item;
+        }
+    }
+    return left;
+}
+
+/* Fills nodes[index] and its subtree, children are appended at node_count. Returns the new node count */
+static size_t buildBVHNodes(BVHBuilder* builder, BVHNode* nodes, size_t node_count, size_t index, uint32_t first, uint32_t count, uint32_t depth, int defer)
+{
+    if (defer && count <= BVH_PARALLEL_SIZE)
+    {
+        builder->tasks[builder->task_count++] = (BVHTask){ (uint32_t)index, first, count, depth, 0, 0 };
+        return node_count;
+    }
+
+    BVHNode* node = &nodes[index];
+    node->bounds = aabb_empty();
+
+    aabb centers = aabb_empty();
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        uint32_t item = builder->items[i];
+        vec3 c = builder->centroids[item];
+
+        growBounds(&node->bounds, builder->bounds[item]);
+        growBounds(&centers, (aabb){ c, c });
+    }
+
+    uint32_t left = depth < BVH_MAX_DEPTH ? splitBVHNode(builder, node->bounds, centers, first, count) : 0;
+    if (!left)
+    {
+        node->first = first;
+        node->count = count;
+        return node_count;
+    }
+
+    size_t child = node_count;
+    node->first = (uint32_t)child;
+    node->count = 0;
+
+    node_count = buildBVHNodes(builder, nodes, node_count + 2, child, first, left, depth + 1, defer);
+    return buildBVHNodes(builder, nodes, node_count, child + 1, first + left, count - left, depth + 1, defer);
+}
+
+static void buildBVHTasks(void* data, size_t begin, size_t end, uint32_t thread)
+{
+    BVHBuilder* builder = data;
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        BVHTask* task = &builder->tasks[i];
+        task->node_count = buildBVHNodes(builder, &builder->scratch[task->scratch], 1, 0, task->first, task->count, task->depth, 0);
+    }
+}
+
+int buildBVH(BVH* bvh, const aabb* bounds, size_t count, JobPool* jobs)
+{
+    bvh->node_count = 0;
+    bvh->count = 0;
+    bvh->build_cost = 0.0f;
+    bvh->cost = 0.0f;
+
+    if (!count) return IGNIS_SUCCESS;
+
+    if (count > bvh->capacity)
+    {
+        uint32_t* items = realloc(bvh->items, count * sizeof(uint32_t));
+        if (!items) return IGNIS_FAILURE;
+        bvh->items = items;
+
+        aabb* item_bounds = realloc(bvh->item_bounds, count * sizeof(aabb));
+        if (!item_bounds) return IGNIS_FAILURE;
+        bvh->item_bounds = item_bounds;
+
+        BVHNode* nodes = realloc(bvh->nodes, 2 * count * sizeof(BVHNode));
+        if (!nodes) return IGNIS_FAILURE;
+        bvh->nodes = nodes;
+
+        bvh->capacity = count;
+        bvh->node_capacity = 2 * count;
+    }
+
+    // every top level node that is split has more than BVH_PARALLEL_SIZE items
+    vec3* centroids = malloc(count * sizeof(vec3));
+    BVHTask* tasks = malloc((2 * count / BVH_PARALLEL_SIZE + 1) * sizeof(BVHTask));
+    if (!centroids || !tasks)
+    {
+        free(centroids);
+        free(tasks);
+        return IGNIS_FAILURE;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        bvh->items[i] = (uint32_t)i;
+        centroids[i] = vec3_mult(vec3_add(bounds[i].min, bounds[i].max), 0.5f);
+    }
+
+    // split the top levels here, everything below is built by the jobs
+    BVHBuilder builder = { bounds, centroids, bvh->items, tasks, 0, NULL };
+    size_t node_count = buildBVHNodes(&builder, bvh->nodes, 1, 0, 0, (uint32_t)count, 0, 1);
+
+    size_t scratch_count = 0;
+    for (size_t i = 0; i < builder.task_count; ++i)
+    {
+        tasks[i].scratch = scratch_count;
+        scratch_count += 2 * tasks[i].count - 1;
+    }
+
+    builder.scratch = malloc(scratch_count * sizeof(BVHNode));
+    if (!builder.scratch)
+    {
+        free(centroids);
+        free(tasks);
+        return IGNIS_FAILURE;
+    }
+
+    jobPoolParallelFor(jobs, builder.task_count, 1, buildBVHTasks, &builder);
+
+    // append the subtrees, the root of each replaces its placeholder
+    for (size_t i = 0; i < builder.task_count; ++i)
+    {
+        const BVHNode* local = &builder.scratch[tasks[i].scratch];
+        uint32_t base = (uint32_t)node_count - 1;
+
+        for (size_t j = 0; j < tasks[i].node_count; ++j)
+        {
+            BVHNode node = local[j];
+            if (!node.count) node.first += base;
+
+            bvh->nodes[j ? base + j : tasks[i].node] = node;
+        }
+        node_count += tasks[i].node_count - 1;
+    }
+
+    free(builder.scratch);
+    free(centroids);
+    free(tasks);
+
+    bvh->node_count = node_count;
+    bvh->count = count;
+
+    refitBVH(bvh, bounds);
+    bvh->build_cost = bvh->cost;
+
+    return IGNIS_SUCCESS;
+}
+
+void refitBVH(BVH* bvh, const aabb* bounds)
+{
+    for (size_t i = 0; i < bvh->count; ++i)
+        bvh->item_bounds[i] = bounds[bvh->items[i]];
+
+    // children come after their parents
+    float cost = 0.0f;
+    for (size_t i = bvh->node_count; i-- > 0;)
+    {
+        BVHNode* node = &bvh->nodes[i];
+        if (node->count)
+        {
+            node->bounds = aabb_empty();
+            for (uint32_t k = node->first; k < node->first + node->count; ++k)
+                growBounds(&node->bounds, bvh->item_bounds[k]);
+
+            cost += aabb_surface_area(node->bounds) * node->count;
+        }
+        else
+        {
+            node->bounds = aabb_merge(bvh->nodes[node->first].bounds, bvh->nodes[node->first + 1].bounds);
+            cost += aabb_surface_area(node->bounds) * BVH_TRAVERSAL_COST;
+        }
+    }
+
+    float root = bvh->node_count ? aabb_surface_area(bvh->nodes[0].bounds) : 0.0f;
+    bvh->cost = root > 0.0f ? cost / root : 0.0f;
+}
+
+size_t cullBVH(const BVH* bvh, const frustum* f, uint32_t* out)
+{
+    if (!bvh->node_count) return 0;
+
+    BVHCullEntry stack[BVH_MAX_DEPTH + 2];
+    size_t top = 0;
+    stack[top++] = (BVHCullEntry){ 0, 0x3f };
+
+    size_t count = 0;
+    while (top)
+    {
+        BVHCullEntry entry = stack[--top];
+        const BVHNode* node = &bvh->nodes[entry.node];
+
+        // subtrees completely inside are not tested any further
+        if (entry.planes && frustum_classify_aabb(f, node->bounds, &entry.planes) == FRUSTUM_OUTSIDE)
+            continue;
+
+        if (!node->count)
+        {
+            stack[top++] = (BVHCullEntry){ node->first + 1, entry.planes };
+            stack[top++] = (BVHCullEntry){ node->first, entry.planes };
+            continue;
+        }
+
+        for (uint32_t i = node->first; i < node->first + node->count; ++i)
+        {
+            uint8_t planes = entry.planes;
+            if (!planes || frustum_classify_aabb(f, bvh->item_bounds[i], &planes) != FRUSTUM_OUTSIDE)
+                out[count++] = bvh->items[i];
+        }
+    }
+    return count;
+}
+
+int raycastBVH(const BVH* bvh, vec3 origin, vec3 dir, float max_distance, uint32_t* item, float* distance)
+{
+    if (!bvh->node_count) return 0;
+
+    vec3 inv_dir = { 1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z };
+
+    BVHRayEntry stack[BVH_MAX_DEPTH + 2];
+    size_t top = 0;
+
+    float t = 0.0f;
+    if (!aabb_intersect_ray(bvh->nodes[0].bounds, origin, inv_dir, max_distance, &t)) return 0;
+    stack[top++] = (BVHRayEntry){ 0, t };
+
+    int hit = 0;
+    float closest = max_distance;
+    while (top)
+    {
+        BVHRayEntry entry = stack[--top];
+        if (entry.distance > closest) continue;
+
+        const BVHNode* node = &bvh->nodes[entry.node];
+        if (node->count)
+        {
+            for (uint32_t i = node->first; i < node->first + node->count; ++i)
+            {
+                if (!aabb_intersect_ray(bvh->item_bounds[i], origin, inv_dir, closest, &t)) continue;
+
+                closest = t;
+                if (item) *item = bvh->items[i];
+                hit = 1;
+            }
+            continue;
+        }
+
+        // the closer child is visited first
+        float t0 = 0.0f, t1 = 0.0f;
+        int hit0 = aabb_intersect_ray(bvh->nodes[node->first].bounds, origin, inv_dir, closest, &t0);
+        int hit1 = aabb_intersect_ray(bvh->nodes[node->first + 1].bounds, origin, inv_dir, closest, &t1);
+
+        if (hit0 && hit1 && t1 < t0)
+        {
+            stack[top++] = (BVHRayEntry){ node->first, t0 };
+            stack[top++] = (BVHRayEntry){ node->first + 1, t1 };
+            continue;
+        }
+
+        if (hit1) stack[top++] = (BVHRayEntry){ node->first + 1, t1 };
+        if (hit0) stack[top++] = (BVHRayEntry){ node->first, t0 };
+    }
+
+    if (hit && distance) *distance = closest;
+    return hit;
+}
@@ -0,0 +1,483 @@
+#include "model.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define DRAW_LIST_MIN_CAPACITY  256
+#define DRAW_LIST_STREAM_ALIGN  16
+
+#define DRAW_KEY_DEPTH_SHIFT    0
+#define DRAW_KEY_MESH_SHIFT     (DRAW_KEY_DEPTH_SHIFT + DRAW_KEY_DEPTH_BITS)
+#define DRAW_KEY_VAO_SHIFT      (DRAW_KEY_MESH_SHIFT + DRAW_KEY_MESH_BITS)
+#define DRAW_KEY_MATERIAL_SHIFT (DRAW_KEY_VAO_SHIFT + DRAW_KEY_VAO_BITS)
+#define DRAW_KEY_SHADER_SHIFT   (DRAW_KEY_MATERIAL_SHIFT + DRAW_KEY_MATERIAL_BITS)
+
+#define DRAW_KEY_MASK(bits)     ((1ull << (bits)) - 1)
+
+int createDrawList(DrawList* list)
+{
+    memset(list, 0, sizeof(DrawList));
+    list->far_plane = 1.0f;
+    list->culling = 1;
+
+    glGenBuffers(1, &list->instance_buffer);
+    glGenBuffers(1, &list->command_buffer);
+    return IGNIS_SUCCESS;
+}
+
+void destroyDrawList(DrawList* list)
+{
+    free(list->items);
+    free(list->keys);
+    free(list->sort_buffer);
+    free(list->bounds);
+    free(list->visible);
+    free(list->instances);
+    free(list->commands);
+    free(list->command_items);
+    if (list->instance_buffer) glDeleteBuffers(1, &list->instance_buffer);
+    if (list->command_buffer) glDeleteBuffers(1, &list->command_buffer);
+
+    memset(list, 0, sizeof(DrawList));
+}
+
+void resetDrawList(DrawList* list, mat4 view_proj, vec3 eye, float far_plane)
+{
+    list->count = 0;
+    list->key_count = 0;
+    list->shader_count = 0;
+    list->eye = eye;
+    list->far_plane = far_plane > 0.0f ? far_plane : 1.0f;
+    list->frustum = frustum_extract(view_proj);
+
+    memset(&list->stats, 0, sizeof(DrawListStats));
+}
+
+static int reserveDrawList(DrawList* list, size_t count)
+{
+    if (count <= list->capacity) return IGNIS_SUCCESS;
+
+    size_t capacity = list->capacity ? list->capacity : DRAW_LIST_MIN_CAPACITY;
+    while (capacity < count) capacity *= 2;
+
+    DrawItem* items = realloc(list->items, capacity * sizeof(DrawItem));
+    if (!items) return IGNIS_FAILURE;
+    list->items = items;
+
+    DrawKey* keys = realloc(list->keys, capacity * sizeof(DrawKey));
+    if (!keys) return IGNIS_FAILURE;
+    list->keys = keys;
+
+    DrawKey* sort_buffer = realloc(list->sort_buffer, capacity * sizeof(DrawKey));
+    if (!sort_buffer) return IGNIS_FAILURE;
+    list->sort_buffer = sort_buffer;
+
+    aabb* bounds = realloc(list->bounds, capacity * sizeof(aabb));
+    if (!bounds) return IGNIS_FAILURE;
+    list->bounds = bounds;
+
+    uint8_t* visible = realloc(list->visible, capacity * sizeof(uint8_t));
+    if (!visible) return IGNIS_FAILURE;
+    list->visible = visible;
+
+    DrawInstance* instances = realloc(list->instances, capacity * sizeof(DrawInstance));
+    if (!instances) return IGNIS_FAILURE;
+    list->instances = instances;
+
+    DrawCommand* commands = realloc(list->commands, capacity * sizeof(DrawCommand));
+    if (!commands) return IGNIS_FAILURE;
+    list->commands = commands;
+
+    uint32_t* command_items = realloc(list->command_items, capacity * sizeof(uint32_t));
+    if (!command_items) return IGNIS_FAILURE;
+    list->command_items = command_items;
+
+    list->capacity = capacity;
+    return IGNIS_SUCCESS;
+}
+
+static uint64_t getShaderKey(DrawList* list, IgnisShader shader)
+{
+    for (size_t i = 0; i < list->shader_count; ++i)
+        if (list->shaders[i] == shader) return i;
+
+    // shaders past the table share the last slot, they are still bound correctly
+    if (list->shader_count >= DRAW_LIST_SHADERS) return DRAW_LIST_SHADERS - 1;
+
+    list->shaders[list->shader_count] = shader;
+    return list->shader_count++;
+}
+
+// meshes of a model are one array, so their addresses give them distinct small numbers
+static uint64_t getMeshKey(const Mesh* mesh)
+{
+    return ((uintptr_t)mesh / sizeof(Mesh)) & DRAW_KEY_MASK(DRAW_KEY_MESH_BITS);
+}
+
+static uint64_t getDepthKey(const DrawList* list, mat4 transform)
+{
+    vec3 offset = {
+        transform.v[3][0] - list->eye.x,
+        transform.v[3][1] - list->eye.y,
+        transform.v[3][2] - list->eye.z
+    };
+
+    float depth = vec3_length(offset) / list->far_plane;
+    depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+
+    // in double, the mask rounds up to the next power of two as a float
+    return (uint64_t)((double)depth * (double)DRAW_KEY_MASK(DRAW_KEY_DEPTH_BITS));
+}
+
+int pushDraw(DrawList* list, const DrawItem* item, aabb bounds)
+{
+    if (list->count >= UINT32_MAX || !reserveDrawList(list, list->count + 1)) return IGNIS_FAILURE;
+
+    uint64_t key = 0;
+    key |= getShaderKey(list, item->shader) << DRAW_KEY_SHADER_SHIFT;
+    key |= ((uint64_t)item->materials->textures & DRAW_KEY_MASK(DRAW_KEY_MATERIAL_BITS)) << DRAW_KEY_MATERIAL_SHIFT;
+    key |= ((uint64_t)item->vao & DRAW_KEY_MASK(DRAW_KEY_VAO_BITS)) << DRAW_KEY_VAO_SHIFT;
+    key |= getMeshKey(item->mesh) << DRAW_KEY_MESH_SHIFT;
+    key |= getDepthKey(list, item->instance.transform) << DRAW_KEY_DEPTH_SHIFT;
+
+    list->items[list->count] = *item;
+    list->bounds[list->count] = bounds;
+    list->keys[list->key_count].key = key;
+    list->keys[list->key_count].item = (uint32_t)list->count;
+    list->key_count++;
+    list->count++;
+
+    return IGNIS_SUCCESS;
+}
+
+void setDrawTransform(DrawItem* item, mat4 transform)
+{
+    item->instance.transform = transform;
+    mat4_normal_matrix(transform, item->instance.normal_matrix);
+}
+
+int pushModelDraws(DrawList* list, const Model* model, IgnisShader shader)
+{
+    DrawItem item = { 0 };
+    item.shader = shader;
+    item.vao = model->vao.name;
+    item.materials = &model->material_set;
+
+    for (size_t i = 0; i < model->instance_count; ++i)
+    {
+        item.mesh = &model->meshes[model->instances[i]];
+        item.base_vertex = (GLint)item.mesh->base_vertex;
+        setDrawTransform(&item, model->transforms[i]);
+        item.instance.material = item.mesh->material;
+
+        aabb bounds = { item.mesh->min, item.mesh->max };
+        if (!pushDraw(list, &item, aabb_transform(bounds, item.instance.transform))) return IGNIS_FAILURE;
+    }
+
+    return IGNIS_SUCCESS;
+}
+
+int pushModelDrawsSkinned(DrawList* list, const Model* model, aabb bounds, size_t palette_offset, float scale, mat4 transform, IgnisShader shader)
+{
+    DrawItem item = { 0 };
+    item.shader = shader;
+    item.vao = model->vao.name;
+    item.materials = &model->material_set;
+    item.instance.joint_offset = (int32_t)palette_offset;
+    item.instance.joint_scale = scale;
+
+    for (size_t i = 0; i < model->instance_count; ++i)
+    {
+        item.mesh = &model->meshes[model->instances[i]];
+        item.base_vertex = (GLint)item.mesh->base_vertex;
+        setDrawTransform(&item, mat4_multiply(transform, model->transforms[i]));
+        item.instance.material = item.mesh->material;
+
+        if (!pushDraw(list, &item, aabb_transform(bounds, item.instance.transform))) return IGNIS_FAILURE;
+    }
+
+    return IGNIS_SUCCESS;
+}
+
+int pushSkinningBufferDraws(DrawList* list, const SkinningBuffer* skinning, size_t slot, aabb bounds, mat4 transform, IgnisShader shader)
+{
+    const Model* model = skinning->model;
+    if (slot >= skinning->instance_count) return IGNIS_FAILURE;
+
+    DrawItem item = { 0 };
+    item.shader = shader;
+    item.vao = skinning->vao;
+    item.materials = &model->material_set;
+
+    for (size_t i = 0; i < model->instance_count; ++i)
+    {
+        uint32_t mesh_index = model->instances[i];
+
+        item.mesh = &model->meshes[mesh_index];
+        item.base_vertex = (GLint)(slot * skinning->vertex_count + skinning->vertex_offsets[mesh_index]);
+        setDrawTransform(&item, mat4_multiply(transform, model->transforms[i]));
+        item.instance.material = item.mesh->material;
+
+        if (!pushDraw(list, &item, aabb_transform(bounds, item.instance.transform))) return IGNIS_FAILURE;
+    }
+
+    return IGNIS_SUCCESS;
+}
+
+void cullDrawList(DrawList* list)
+{
+    list->stats.tested += list->key_count;
+    if (!list->culling && !list->occlusion) return;
+
+    if (list->culling)
+        frustum_test_aabbs(&list->frustum, list->bounds, list->count, list->visible);
+    else
+        memset(list->visible, 1, list->count);
+
+    // only what is inside the frustum is worth the occlusion test
+    if (list->occlusion)
+        list->stats.occluded += testOcclusionBoxes(list->occlusion, list->bounds, list->count, list->visible);
+
+    // keys still point at their items, so only the keys are compacted
+    size_t count = 0;
+    for (size_t i = 0; i < list->key_count; ++i)
+    {
+        if (list->visible[list->keys[i].item])
+            list->keys[count++] = list->keys[i];
+    }
+
+    list->stats.culled += list->key_count - count;
+    list->key_count = count;
+}
+
+void sortDrawList(DrawList* list)
+{
+    size_t count = list->key_count;
+    if (count < 2) return;
+
+    // one histogram per byte, all gathered in a single pass
+    size_t histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t key = list->keys[i].key;
+        for (int b = 0; b < 8; ++b)
+            histograms[b][(key >> (b * 8)) & 0xff]++;
+    }
+
+    DrawKey* src = list->keys;
+    DrawKey* dst = list->sort_buffer;
+
+    for (int b = 0; b < 8; ++b)
+    {
+        size_t* histogram = histograms[b];
+        int shift = b * 8;
+
+        // a byte that is the same for all keys leaves the order as it is
+        if (histogram[(src[0].key >> shift) & 0xff] == count) continue;
+
+        size_t offset = 0;
+        for (int d = 0; d < 256; ++d)
+        {
+            size_t n = histogram[d];
+            histogram[d] = offset;
+            offset += n;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+            dst[histogram[(src[i].key >> shift) & 0xff]++] = src[i];
+
+        DrawKey* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    // an odd number of passes left the result in the sort buffer
+    if (src != list->keys)
+    {
+        list->sort_buffer = list->keys;
+        list->keys = src;
+    }
+}
+
+static void bindInstanceAttributes(GLuint buffer, size_t base)
+{
+    // set on every bind, a vertex array does not know which list draws it
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    GLsizei stride = sizeof(DrawInstance);
+    for (GLuint c = 0; c < 4; ++c)
+    {
+        glEnableVertexAttribArray(DRAW_LOCATION_TRANSFORM + c);
+        glVertexAttribPointer(DRAW_LOCATION_TRANSFORM + c, 4, GL_FLOAT, GL_FALSE, stride, (const void*)(base + c * 4 * sizeof(float)));
+        glVertexAttribDivisor(DRAW_LOCATION_TRANSFORM + c, 1);
+    }
+
+    glEnableVertexAttribArray(DRAW_LOCATION_MATERIAL);
+    glVertexAttribIPointer(DRAW_LOCATION_MATERIAL, 1, GL_UNSIGNED_INT, stride, (const void*)(base + offsetof(DrawInstance, material)));
+    glVertexAttribDivisor(DRAW_LOCATION_MATERIAL, 1);
+
+    glEnableVertexAttribArray(DRAW_LOCATION_JOINT_OFFSET);
+    glVertexAttribIPointer(DRAW_LOCATION_JOINT_OFFSET, 1, GL_INT, stride, (const void*)(base + offsetof(DrawInstance, joint_offset)));
+    glVertexAttribDivisor(DRAW_LOCATION_JOINT_OFFSET, 1);
+
+    glEnableVertexAttribArray(DRAW_LOCATION_JOINT_SCALE);
+    glVertexAttribPointer(DRAW_LOCATION_JOINT_SCALE, 1, GL_FLOAT, GL_FALSE, stride, (const void*)(base + offsetof(DrawInstance, joint_scale)));
+    glVertexAttribDivisor(DRAW_LOCATION_JOINT_SCALE, 1);
+
+    for (GLuint c = 0; c < 3; ++c)
+    {
+        const void* offset = (const void*)(base + offsetof(DrawInstance, normal_matrix) + c * 3 * sizeof(float));
+        glEnableVertexAttribArray(DRAW_LOCATION_NORMAL_MATRIX + c);
+        glVertexAttribPointer(DRAW_LOCATION_NORMAL_MATRIX + c, 3, GL_FLOAT, GL_FALSE, stride, offset);
+        glVertexAttribDivisor(DRAW_LOCATION_NORMAL_MATRIX + c, 1);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// instances of the same mesh and vertices, the material is an index per instance
+static int isSameCommand(const DrawItem* a, const DrawItem* b)
+{
+    return a->shader == b->shader && a->mesh == b->mesh && a->vao == b->vao && a->base_vertex == b->base_vertex
+        && a->materials == b->materials;
+}
+
+static int isSameBatch(const DrawItem* a, const DrawItem* b)
+{
+    return a->shader == b->shader && a->vao == b->vao && a->mesh->type == b->mesh->type
+        && a->materials == b->materials;
+}
+
+void submitDrawList(DrawList* list)
+{
+    DrawListStats* stats = &list->stats;
+    stats->draws = 0;
+    stats->commands = 0;
+    stats->batches = 0;
+    stats->shader_binds = 0;
+    stats->texture_binds = 0;
+    stats->vao_binds = 0;
+    stats->binds_saved = 0;
+
+    if (!list->key_count) return;
+
+    // instances and commands are written straight into the stream if it has room left
+    DrawInstance* instances = list->instances;
+    DrawCommand* commands = list->commands;
+    GLuint instance_buffer = list->instance_buffer;
+    GLuint command_buffer = list->command_buffer;
+    size_t instance_offset = 0;
+    size_t command_offset = 0;
+
+    if (list->stream)
+    {
+        DrawInstance* stream_instances = streamBufferAlloc(list->stream, list->key_count * sizeof(DrawInstance), DRAW_LIST_STREAM_ALIGN, &instance_offset);
+        DrawCommand* stream_commands = stream_instances ? streamBufferAlloc(list->stream, list->key_count * sizeof(DrawCommand), DRAW_LIST_STREAM_ALIGN, &command_offset) : NULL;
+        if (stream_instances && stream_commands)
+        {
+            instances = stream_instances;
+            commands = stream_commands;
+            instance_buffer = command_buffer = list->stream->name;
+        }
+        else
+        {
+            // give back the instances if only the commands did not fit
+            if (stream_instances) streamBufferShrink(list->stream, instance_offset, 0);
+            instance_offset = 0;
+            command_offset = 0;
+        }
+    }
+
+    // the instances of a command have to be next to each other in the buffer
+    for (size_t k = 0; k < list->key_count; ++k)
+        instances[k] = list->items[list->keys[k].item].instance;
+
+    size_t command_count = 0;
+    for (size_t first = 0; first < list->key_count;)
+    {
+        const DrawItem* item = &list->items[list->keys[first].item];
+
+        size_t end = first + 1;
+        while (end < list->key_count && isSameCommand(item, &list->items[list->keys[end].item])) end++;
+
+        DrawCommand* command = &commands[command_count];
+        command->count = item->mesh->index_count;
+        command->instance_count = (GLuint)(end - first);
+        command->first_index = item->mesh->first_index;
+        command->base_vertex = item->base_vertex;
+        command->base_instance = (GLuint)first;
+
+        list->command_items[command_count++] = (uint32_t)first;
+        first = end;
+    }
+
+    if (instance_buffer == list->instance_buffer)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, list->instance_buffer);
+        glBufferData(GL_ARRAY_BUFFER, list->key_count * sizeof(DrawInstance), list->instances, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, list->command_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, command_count * sizeof(DrawCommand), list->commands, GL_STREAM_DRAW);
+    }
+    else
+    {
+        // commands were reserved for one per key
+        streamBufferShrink(list->stream, command_offset, command_count * sizeof(DrawCommand));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+    }
+
+    IgnisShader shader = 0;
+    const MaterialSet* materials = NULL;
+    GLuint vao = 0;
+    int bound = 0;
+
+    for (size_t first = 0; first < command_count;)
+    {
+        const DrawItem* item = &list->items[list->keys[list->command_items[first]].item];
+
+        size_t end = first + 1;
+        while (end < command_count && isSameBatch(item, &list->items[list->keys[list->command_items[end]].item])) end++;
+
+        if (!bound || item->shader != shader)
+        {
+            ignisUseShader(item->shader);
+            shader = item->shader;
+            stats->shader_binds++;
+        }
+        else stats->binds_saved++;
+
+        if (!bound || item->materials != materials)
+        {
+            bindMaterialSet(item->materials);
+            materials = item->materials;
+            stats->texture_binds++;
+        }
+        else stats->binds_saved++;
+
+        if (!bound || item->vao != vao)
+        {
+            glBindVertexArray(item->vao);
+            bindInstanceAttributes(instance_buffer, instance_offset);
+            vao = item->vao;
+            stats->vao_binds++;
+        }
+        else stats->binds_saved++;
+
+        bound = 1;
+
+        const void* offset = (const void*)(command_offset + first * sizeof(DrawCommand));
+        glMultiDrawElementsIndirect(item->mesh->type, GL_UNSIGNED_INT, offset, (GLsizei)(end - first), 0);
+
+        stats->batches++;
+        first = end;
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    stats->draws = list->key_count;
+    stats->commands = command_count;
+}
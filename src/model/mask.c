@@ -0,0 +1,102 @@
+#include "model.h"
+
+#include <string.h>
+
+int createJointMask(JointMask* mask, const Model* model, const float* weights)
+{
+    size_t count = model->joint_count;
+    memset(mask, 0, sizeof(JointMask));
+
+    // mark the weighted joints and everything above them
+    uint8_t* needed = calloc(count, sizeof(uint8_t));
+    if (!needed) return IGNIS_FAILURE;
+
+    size_t listed = 0;
+    for (size_t i = count; i-- > 0;)
+    {
+        if (weights[i] > 0.0f) needed[i] = 1;
+        if (!needed[i]) continue;
+
+        listed++;
+        uint32_t parent = model->joints[i];
+        if (parent != HIERARCHY_ROOT) needed[parent] = 1;
+    }
+
+    mask->joints = malloc(listed * sizeof(uint32_t));
+    mask->weights = malloc(listed * sizeof(float));
+    if (listed && !(mask->joints && mask->weights))
+    {
+        free(needed);
+        destroyJointMask(mask);
+        return IGNIS_FAILURE;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!needed[i]) continue;
+
+        mask->joints[mask->count] = (uint32_t)i;
+        mask->weights[mask->count] = weights[i] > 0.0f ? weights[i] : 0.0f;
+        mask->count++;
+    }
+
+    free(needed);
+    return IGNIS_SUCCESS;
+}
+
+int createJointMaskSubtree(JointMask* mask, const Model* model, uint32_t root, float weight)
+{
+    float* weights = calloc(model->joint_count, sizeof(float));
+    if (!weights) return IGNIS_FAILURE;
+
+    // children come after their parents
+    if (root < model->joint_count) weights[root] = weight;
+    for (size_t i = root + 1; i < model->joint_count; ++i)
+    {
+        uint32_t parent = model->joints[i];
+        if (parent != HIERARCHY_ROOT && weights[parent] > 0.0f)
+            weights[i] = weight;
+    }
+
+    int result = createJointMask(mask, model, weights);
+    free(weights);
+    return result;
+}
+
+void destroyJointMask(JointMask* mask)
+{
+    free(mask->joints);
+    free(mask->weights);
+    memset(mask, 0, sizeof(JointMask));
+}
+
+AnimationKey* getAnimationKeysMasked(const Animation* animation, float time, const JointMask* mask, AnimationKey* buffer, size_t capacity)
+{
+    // with few shared timelines searching all of them once is cheaper
+    if (animation->timeline_count <= mask->count * 3)
+        return getAnimationKeys(animation, time, buffer, capacity);
+
+    AnimationKey* keys = buffer;
+    if (animation->timeline_count > capacity)
+    {
+        keys = malloc(animation->timeline_count * sizeof(AnimationKey));
+        if (!keys) return NULL;
+    }
+
+    // only joints with a weight are sampled, the other keys are never read
+    for (size_t k = 0; k < mask->count; ++k)
+    {
+        uint32_t i = mask->joints[k];
+        if (mask->weights[k] <= 0.0f || i >= animation->channel_count) continue;
+
+        const AnimationChannel* channels[3] = { &animation->translations[i], &animation->rotations[i], &animation->scales[i] };
+        for (int c = 0; c < 3; ++c)
+        {
+            uint32_t timeline = channels[c]->timeline;
+            if (timeline != ANIMATION_NO_TIMELINE)
+                keys[timeline] = getTimelineKey(&animation->timelines[timeline], time);
+        }
+    }
+
+    return keys;
+}
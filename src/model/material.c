@@ -18,6 +18,144 @@ void destroyMaterial(Material* material)
     if (!ignisIsDefaultTexture2D(material->emmisive))     ignisDeleteTexture2D(&material->emmisive);
 }
 
+// ----------------------------------------------------------------
+// material set
+// ----------------------------------------------------------------
+static int hasBaseTexture(const Material* material)
+{
+    return material->base_texture.name && !ignisIsDefaultTexture2D(material->base_texture);
+}
+
+static GLsizei getMipLevels(GLint width, GLint height)
+{
+    GLint size = width > height ? width : height;
+
+    GLsizei levels = 1;
+    while (size >>= 1) levels++;
+    return levels;
+}
+
+// leaves the texture bound
+static void getBaseTextureSize(const Material* material, GLint* width, GLint* height)
+{
+    *width = *height = 0;
+    glBindTexture(GL_TEXTURE_2D, material->base_texture.name);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, height);
+}
+
+// materials sharing a base texture share its layer
+static uint32_t getBaseTextureLayer(const Material* materials, size_t index, const MaterialData* data)
+{
+    for (size_t i = 0; i < index; ++i)
+    {
+        if (hasBaseTexture(&materials[i]) && materials[i].base_texture.name == materials[index].base_texture.name)
+            return data[i].layer;
+    }
+    return 0;
+}
+
+int createMaterialSet(MaterialSet* set, const Material* materials, size_t count)
+{
+    // one entry at least, meshes without a material read the first one
+    size_t entries = count ? count : 1;
+    MaterialData* data = calloc(entries, sizeof(MaterialData));
+    if (!data) return IGNIS_FAILURE;
+
+    data[0].base_color[0] = data[0].base_color[1] = data[0].base_color[2] = data[0].base_color[3] = 1.0f;
+
+    GLint width = 1, height = 1;
+    set->layer_count = 1;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Material* material = &materials[i];
+        data[i].base_color[0] = material->color.r;
+        data[i].base_color[1] = material->color.g;
+        data[i].base_color[2] = material->color.b;
+        data[i].base_color[3] = 1.0f;
+
+        if (!hasBaseTexture(material)) continue;
+
+        data[i].layer = getBaseTextureLayer(materials, i, data);
+        if (data[i].layer) continue;
+
+        data[i].layer = (uint32_t)set->layer_count++;
+
+        GLint w, h;
+        getBaseTextureSize(material, &w, &h);
+        if (w > width)  width = w;
+        if (h > height) height = h;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (width > MATERIAL_TEXTURE_MAX_SIZE)  width = MATERIAL_TEXTURE_MAX_SIZE;
+    if (height > MATERIAL_TEXTURE_MAX_SIZE) height = MATERIAL_TEXTURE_MAX_SIZE;
+
+    glGenBuffers(1, &set->buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, set->buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, entries * sizeof(MaterialData), data, GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenTextures(1, &set->textures);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, set->textures);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, getMipLevels(width, height), GL_RGBA8, width, height, (GLsizei)set->layer_count);
+
+    const uint8_t white[4] = { 255, 255, 255, 255 };
+    glClearTexSubImage(set->textures, 0, 0, 0, 0, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, white);
+
+    // resize every base texture into its layer on the gpu
+    GLuint framebuffers[2];
+    glGenFramebuffers(2, framebuffers);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Material* material = &materials[i];
+        if (!hasBaseTexture(material) || getBaseTextureLayer(materials, i, data)) continue;
+
+        GLint w, h;
+        getBaseTextureSize(material, &w, &h);
+
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, material->base_texture.name, 0);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, set->textures, 0, (GLint)data[i].layer);
+        glBlitFramebuffer(0, 0, w, h, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(2, framebuffers);
+
+    // one sampler for all layers, the wrap modes of the gltf samplers are lost
+    glBindTexture(GL_TEXTURE_2D_ARRAY, set->textures);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    free(data);
+    return IGNIS_SUCCESS;
+}
+
+void destroyMaterialSet(MaterialSet* set)
+{
+    glDeleteBuffers(1, &set->buffer);
+    glDeleteTextures(1, &set->textures);
+    set->buffer = 0;
+    set->textures = 0;
+    set->layer_count = 0;
+}
+
+void bindMaterialSet(const MaterialSet* set)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING, set->buffer);
+
+    glActiveTexture(GL_TEXTURE0 + BASE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, set->textures);
+}
+
 // ----------------------------------------------------------------
 // GLTF
 // ----------------------------------------------------------------
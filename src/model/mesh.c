@@ -82,7 +82,6 @@ int loadMeshGLTF(Mesh* mesh, const cgltf_primitive* primitive, uint32_t group, u
 
 void destroyMesh(Mesh* mesh)
 {
-    ignisDeleteVertexArray(&mesh->vao);
     if (mesh->positions) free(mesh->positions);
     if (mesh->texcoords) free(mesh->texcoords);
     if (mesh->normals)   free(mesh->normals);
@@ -5,6 +5,9 @@
 
 #include "minimal.h"
 
+#include <ctype.h>
+#include <string.h>
+
 // ----------------------------------------------------------------
 // utility
 // ----------------------------------------------------------------
@@ -35,26 +38,216 @@ uint32_t getJointIndex(const cgltf_node* target, const cgltf_skin* skin, uint32_
     return fallback;
 }
 
+/* Nodes named Occluder* hold authored occlusion geometry, they are never drawn */
+static int isOccluderNode(const cgltf_node* node)
+{
+    const char* prefix = "occluder";
+    if (!node->mesh || !node->name) return 0;
+
+    for (size_t i = 0; prefix[i]; ++i)
+        if (tolower((unsigned char)node->name[i]) != prefix[i]) return 0;
+
+    return 1;
+}
+
+/* Nearest ancestor of every joint that is part of the skin, looked up through a node to joint map */
+static int getSkinJointParents(const cgltf_data* data, const cgltf_skin* skin, uint32_t* parents)
+{
+    uint32_t* joint_of_node = malloc(data->nodes_count * sizeof(uint32_t));
+    if (!joint_of_node) return IGNIS_FAILURE;
+
+    for (size_t i = 0; i < data->nodes_count; ++i)
+        joint_of_node[i] = HIERARCHY_ROOT;
+
+    // walked backwards so a node listed twice maps to its first joint, like getJointIndex
+    for (size_t i = skin->joints_count; i-- > 0;)
+        joint_of_node[skin->joints[i] - data->nodes] = (uint32_t)i;
+
+    for (size_t i = 0; i < skin->joints_count; ++i)
+    {
+        parents[i] = HIERARCHY_ROOT;
+        for (const cgltf_node* parent = skin->joints[i]->parent; parent; parent = parent->parent)
+        {
+            uint32_t index = joint_of_node[parent - data->nodes];
+            if (index != HIERARCHY_ROOT)
+            {
+                parents[i] = index;
+                break;
+            }
+        }
+    }
+
+    free(joint_of_node);
+    return IGNIS_SUCCESS;
+}
+
+/* Stable sort by depth, parents always end up before their children. Returns the number of depth levels */
+static size_t sortByDepth(const uint32_t* parents, size_t count, uint32_t* order, uint32_t* remap)
+{
+    if (!count) return 0;
+
+    // remap temporarily holds the depth of every element
+    uint32_t max_depth = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t depth = 0;
+        for (uint32_t parent = parents[i]; parent != HIERARCHY_ROOT; parent = parents[parent])
+            depth++;
+
+        remap[i] = depth;
+        max_depth = max(max_depth, depth);
+    }
+
+    size_t index = 0;
+    for (uint32_t depth = 0; depth <= max_depth; ++depth)
+    {
+        for (size_t i = 0; i < count; ++i)
+            if (remap[i] == depth) order[index++] = (uint32_t)i;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        remap[order[i]] = (uint32_t)i;
+
+    return max_depth + 1;
+}
+
+size_t getSkinJointOrder(const cgltf_data* data, const cgltf_skin* skin, uint32_t* order, uint32_t* remap)
+{
+    uint32_t* parents = malloc(skin->joints_count * sizeof(uint32_t));
+    if (!parents) return 0;
+
+    if (getSkinJointParents(data, skin, parents) != IGNIS_SUCCESS)
+    {
+        free(parents);
+        return 0;
+    }
+
+    size_t levels = sortByDepth(parents, skin->joints_count, order, remap);
+
+    free(parents);
+    return levels;
+}
+
+size_t getNodeOrder(const cgltf_data* data, uint32_t* order, uint32_t* remap)
+{
+    uint32_t* parents = malloc(data->nodes_count * sizeof(uint32_t));
+    if (!parents) return 0;
+
+    for (size_t i = 0; i < data->nodes_count; ++i)
+    {
+        const cgltf_node* parent = data->nodes[i].parent;
+        parents[i] = parent ? (uint32_t)(parent - data->nodes) : HIERARCHY_ROOT;
+    }
+
+    size_t levels = sortByDepth(parents, data->nodes_count, order, remap);
+
+    free(parents);
+    return levels;
+}
+
 // ----------------------------------------------------------------
 // skin
 // ----------------------------------------------------------------
-static int loadSkinGLTF(Model* model, cgltf_skin* skin)
+static int loadSkinGLTF(Model* model, const cgltf_data* data, cgltf_skin* skin)
 {
-    model->joint_count = skin->joints_count;
-    model->joints = malloc(skin->joints_count * sizeof(uint32_t));
-    model->joint_locals = malloc(skin->joints_count * sizeof(mat4));
-    model->joint_inv_transforms = malloc(skin->joints_count * sizeof(mat4));
+    size_t count = skin->joints_count;
+
+    model->joint_count = count;
+    model->joints = malloc(count * sizeof(uint32_t));
+    model->joint_locals = malloc(count * sizeof(mat4x3));
+    model->joint_rest = malloc(count * sizeof(NodeTransform));
+    model->joint_inv_transforms = malloc(count * sizeof(mat4x3));
+    model->joint_heights = calloc(count, sizeof(uint8_t));
+    model->joint_levels = calloc(count + 1, sizeof(size_t));
+
+    uint32_t* order = malloc(count * sizeof(uint32_t));
+    uint32_t* remap = malloc(count * sizeof(uint32_t));
+    uint32_t* parents = malloc(count * sizeof(uint32_t));
+
+    if (!(model->joints && model->joint_locals && model->joint_rest && model->joint_inv_transforms && model->joint_heights && model->joint_levels && order && remap && parents)
+        || getSkinJointParents(data, skin, parents) != IGNIS_SUCCESS)
+    {
+        free(order);
+        free(remap);
+        free(parents);
+        return IGNIS_FAILURE;
+    }
 
-    if (!(model->joints && model->joint_locals && model->joint_inv_transforms)) return IGNIS_FAILURE;
+    model->joint_level_count = sortByDepth(parents, count, order, remap);
 
-    for (size_t i = 0; i < skin->joints_count; ++i)
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t index = order[i];
+        cgltf_node* node = skin->joints[index];
+
+        uint32_t parent = parents[index];
+        model->joints[i] = parent == HIERARCHY_ROOT ? HIERARCHY_ROOT : remap[parent];
+
+        mat4 local, inv_transform;
+        cgltf_node_transform_local(node, local.v[0]);
+        cgltf_accessor_read_float(skin->inverse_bind_matrices, index, inv_transform.v[0], 16);
+
+        model->joint_locals[i] = mat4x3_cast(local);
+        model->joint_rest[i] = getNodeTransformGLTF(node);
+        model->joint_inv_transforms[i] = mat4x3_cast(inv_transform);
+
+        // count joints per level, turned into offsets below
+        uint32_t depth = 0;
+        for (uint32_t p = model->joints[i]; p != HIERARCHY_ROOT; p = model->joints[p]) depth++;
+        model->joint_levels[depth + 1]++;
+    }
+
+    for (size_t level = 0; level < model->joint_level_count; ++level)
+        model->joint_levels[level + 1] += model->joint_levels[level];
+
+    // children come after their parents, so walking backwards propagates the heights up
+    for (size_t i = count; i-- > 0;)
+    {
+        uint32_t parent = model->joints[i];
+        if (parent != HIERARCHY_ROOT)
+            model->joint_heights[parent] = max(model->joint_heights[parent], model->joint_heights[i] + 1);
+    }
+
+    // vertex joint indices refer to the skin order
+    for (size_t m = 0; m < model->mesh_count; ++m)
     {
-        cgltf_node* node = skin->joints[i];
-        model->joints[i] = getJointIndex(node->parent, skin, 0);
-        cgltf_node_transform_local(node, model->joint_locals[i].v[0]);
-        cgltf_accessor_read_float(skin->inverse_bind_matrices, i, model->joint_inv_transforms[i].v[0], 16);
+        Mesh* mesh = &model->meshes[m];
+        if (!mesh->joints) continue;
+
+        for (size_t v = 0; v < mesh->vertex_count * 4; ++v)
+            mesh->joints[v] = mesh->joints[v] < count ? remap[mesh->joints[v]] : 0;
+    }
+
+    model->joint_bounds = malloc(count * sizeof(aabb));
+    if (model->joint_bounds)
+    {
+        for (size_t i = 0; i < count; ++i) model->joint_bounds[i] = aabb_empty();
+
+        for (size_t m = 0; m < model->mesh_count; ++m)
+        {
+            const Mesh* mesh = &model->meshes[m];
+            if (!mesh->joints || !mesh->weights) continue;
+
+            for (size_t v = 0; v < mesh->vertex_count; ++v)
+            {
+                vec3 p = { mesh->positions[v * 3 + 0], mesh->positions[v * 3 + 1], mesh->positions[v * 3 + 2] };
+                aabb point = { p, p };
+
+                for (size_t k = 0; k < 4; ++k)
+                {
+                    if (mesh->weights[v * 4 + k] <= 0.0f) continue;
+
+                    aabb* bounds = &model->joint_bounds[mesh->joints[v * 4 + k]];
+                    *bounds = aabb_merge(*bounds, point);
+                }
+            }
+        }
     }
 
+    free(order);
+    free(remap);
+    free(parents);
+
     return IGNIS_SUCCESS;
 }
 
@@ -62,7 +255,142 @@ static void destroySkin(Model* model)
 {
     if (model->joints) free(model->joints);
     if (model->joint_locals) free(model->joint_locals);
+    if (model->joint_rest) free(model->joint_rest);
     if (model->joint_inv_transforms) free(model->joint_inv_transforms);
+    if (model->joint_heights) free(model->joint_heights);
+    if (model->joint_levels) free(model->joint_levels);
+    if (model->joint_bounds) free(model->joint_bounds);
+}
+
+// ----------------------------------------------------------------
+// occluders
+// ----------------------------------------------------------------
+/* Merges the triangles of every occluder node in model space, expects the meshes to be loaded */
+static int loadOccludersGLTF(Model* model, const cgltf_data* data, const uint32_t* node_remap)
+{
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+    for (size_t i = 0; i < data->nodes_count; ++i)
+    {
+        if (!isOccluderNode(&data->nodes[i])) continue;
+
+        const cgltf_mesh* mesh_data = data->nodes[i].mesh;
+        size_t mesh_index = getMeshIndex(mesh_data, data->meshes, data->meshes_count);
+        for (size_t p = 0; p < mesh_data->primitives_count; ++p)
+        {
+            const Mesh* mesh = &model->meshes[mesh_index + p];
+            if (mesh_data->primitives[p].type != cgltf_primitive_type_triangles || !mesh->positions) continue;
+
+            vertex_count += mesh->vertex_count;
+            index_count += mesh->element_count ? mesh->element_count : mesh->vertex_count;
+        }
+    }
+
+    if (!index_count) return IGNIS_SUCCESS;
+
+    model->occluder_positions = malloc(vertex_count * 3 * sizeof(float));
+    model->occluder_indices = malloc(index_count * sizeof(uint32_t));
+    if (!model->occluder_positions || !model->occluder_indices) return IGNIS_FAILURE;
+
+    for (size_t i = 0; i < data->nodes_count; ++i)
+    {
+        if (!isOccluderNode(&data->nodes[i])) continue;
+
+        const cgltf_mesh* mesh_data = data->nodes[i].mesh;
+        mat4 transform = mat4x3_to_mat4(model->nodes.worlds[node_remap[i]]);
+
+        size_t mesh_index = getMeshIndex(mesh_data, data->meshes, data->meshes_count);
+        for (size_t p = 0; p < mesh_data->primitives_count; ++p)
+        {
+            const Mesh* mesh = &model->meshes[mesh_index + p];
+            if (mesh_data->primitives[p].type != cgltf_primitive_type_triangles || !mesh->positions) continue;
+
+            uint32_t base = (uint32_t)model->occluder_vertex_count;
+            for (size_t v = 0; v < mesh->vertex_count; ++v)
+            {
+                const float* src = &mesh->positions[v * 3];
+                vec3 position = mat4_transform_point(transform, (vec3){ src[0], src[1], src[2] });
+
+                float* dst = &model->occluder_positions[model->occluder_vertex_count++ * 3];
+                dst[0] = position.x;
+                dst[1] = position.y;
+                dst[2] = position.z;
+            }
+
+            size_t count = mesh->element_count ? mesh->element_count : mesh->vertex_count;
+            for (size_t k = 0; k < count; ++k)
+                model->occluder_indices[model->occluder_index_count++] = base + (mesh->indices ? mesh->indices[k] : (uint32_t)k);
+        }
+    }
+
+    return IGNIS_SUCCESS;
+}
+
+#define OCCLUDER_TRIANGLE_BUDGET 2048
+
+/*
+ * Without authored occluders the largest indexed triangle meshes stand in for them.
+ * They are added with the current instance transforms, so node animation keeps them
+ * exact. Skinned meshes leave their bind pose and are never used.
+ */
+static int selectOccluderInstances(Model* model)
+{
+    if (!model->instance_count) return IGNIS_SUCCESS;
+
+    float* sizes = malloc(model->instance_count * sizeof(float));
+    model->occluder_instances = malloc(model->instance_count * sizeof(uint32_t));
+    if (!sizes || !model->occluder_instances)
+    {
+        free(sizes);
+        return IGNIS_FAILURE;
+    }
+
+    // diagonal of the instance bounds in model space, 0 for meshes that can not occlude
+    for (size_t i = 0; i < model->instance_count; ++i)
+    {
+        const Mesh* mesh = &model->meshes[model->instances[i]];
+        sizes[i] = 0.0f;
+        if (mesh->type != GL_TRIANGLES || !mesh->positions || !mesh->indices) continue;
+
+        vec3 min = {  INFINITY,  INFINITY,  INFINITY };
+        vec3 max = { -INFINITY, -INFINITY, -INFINITY };
+        for (int c = 0; c < 8; ++c)
+        {
+            vec3 corner = {
+                (c & 1) ? mesh->max.x : mesh->min.x,
+                (c & 2) ? mesh->max.y : mesh->min.y,
+                (c & 4) ? mesh->max.z : mesh->min.z
+            };
+
+            vec3 p = mat4_transform_point(model->transforms[i], corner);
+
+            min = (vec3){ fminf(min.x, p.x), fminf(min.y, p.y), fminf(min.z, p.z) };
+            max = (vec3){ fmaxf(max.x, p.x), fmaxf(max.y, p.y), fmaxf(max.z, p.z) };
+        }
+        sizes[i] = vec3_length(vec3_sub(max, min));
+    }
+
+    // largest first until the triangle budget is spent, meshes that do not fit are skipped
+    size_t budget = OCCLUDER_TRIANGLE_BUDGET;
+    for (;;)
+    {
+        size_t best = model->instance_count;
+        for (size_t i = 0; i < model->instance_count; ++i)
+        {
+            size_t triangles = model->meshes[model->instances[i]].element_count / 3;
+            if (sizes[i] > 0.0f && triangles <= budget && (best == model->instance_count || sizes[i] > sizes[best]))
+                best = i;
+        }
+
+        if (best == model->instance_count) break;
+
+        budget -= model->meshes[model->instances[best]].element_count / 3;
+        model->occluder_instances[model->occluder_instance_count++] = (uint32_t)best;
+        sizes[best] = 0.0f;
+    }
+
+    free(sizes);
+    return IGNIS_SUCCESS;
 }
 
 // ----------------------------------------------------------------
@@ -78,7 +406,7 @@ int loadModelGLTF(Model* model, cgltf_data* data, const char* dir)
     // count mesh instances
     model->instance_count = 0;
     for (size_t i = 0; i < data->nodes_count; ++i)
-        if (data->nodes[i].mesh) model->instance_count += data->nodes[i].mesh->primitives_count;
+        if (data->nodes[i].mesh && !isOccluderNode(&data->nodes[i])) model->instance_count += data->nodes[i].mesh->primitives_count;
 
     // allocate memory
     model->meshes = calloc(model->mesh_count, sizeof(Mesh));
@@ -91,9 +419,18 @@ int loadModelGLTF(Model* model, cgltf_data* data, const char* dir)
     if (!model->materials) return IGNIS_FAILURE;
 
     model->instances = malloc(model->instance_count * sizeof(uint32_t));
+    model->instance_nodes = malloc(model->instance_count * sizeof(uint32_t));
     model->transforms = malloc(model->instance_count * sizeof(mat4));
 
-    if (!model->instances || !model->transforms) return IGNIS_FAILURE;
+    if (!model->instances || !model->instance_nodes || !model->transforms) return IGNIS_FAILURE;
+
+    // node hierarchy
+    uint32_t* node_remap = malloc(data->nodes_count * sizeof(uint32_t));
+    if (!node_remap || !loadNodeHierarchyGLTF(&model->nodes, data, node_remap))
+    {
+        free(node_remap);
+        return IGNIS_FAILURE;
+    }
 
     // Load materials
     for (size_t i = 0; i < data->materials_count; ++i)
@@ -119,24 +456,57 @@ int loadModelGLTF(Model* model, cgltf_data* data, const char* dir)
     for (size_t i = 0; i < data->nodes_count; ++i)
     {
         cgltf_mesh* mesh_data = data->nodes[i].mesh;
-        if (!mesh_data) continue;
+        if (!mesh_data || isOccluderNode(&data->nodes[i])) continue;
 
-        mat4 transform = mat4_identity();
-        cgltf_node_transform_world(&data->nodes[i], transform.v[0]);
+        uint32_t node = node_remap[i];
+        mat4 transform = mat4x3_to_mat4(model->nodes.worlds[node]);
 
         size_t mesh_index = getMeshIndex(mesh_data, data->meshes, data->meshes_count);
         for (size_t p = 0; p < mesh_data->primitives_count; ++p)
         {
             model->instances[instance_index] = mesh_index + p;
+            model->instance_nodes[instance_index] = node;
             model->transforms[instance_index] = transform;
             instance_index++;
         }
     }
 
+    if (!loadOccludersGLTF(model, data, node_remap))
+        IGNIS_WARN("MODEL: Failed to load occluders");
+
+    if (!model->occluder_index_count && !data->skins_count && !selectOccluderInstances(model))
+        IGNIS_WARN("MODEL: Failed to select occluders");
+
+    free(node_remap);
+
+    // calculate bounds
+    model->min = (vec3){  INFINITY,  INFINITY,  INFINITY };
+    model->max = (vec3){ -INFINITY, -INFINITY, -INFINITY };
+    for (size_t i = 0; i < model->instance_count; ++i)
+    {
+        Mesh* mesh = &model->meshes[model->instances[i]];
+        for (int c = 0; c < 8; ++c)
+        {
+            vec3 corner = {
+                (c & 1) ? mesh->max.x : mesh->min.x,
+                (c & 2) ? mesh->max.y : mesh->min.y,
+                (c & 4) ? mesh->max.z : mesh->min.z
+            };
+
+            vec3 p = mat4_transform_point(model->transforms[i], corner);
+
+            model->min = (vec3){ fminf(model->min.x, p.x), fminf(model->min.y, p.y), fminf(model->min.z, p.z) };
+            model->max = (vec3){ fmaxf(model->max.x, p.x), fmaxf(model->max.y, p.y), fmaxf(model->max.z, p.z) };
+        }
+    }
+    if (!model->instance_count) model->min = model->max = (vec3){ 0.0f, 0.0f, 0.0f };
+
+    loadDefaultAnimationLOD(&model->lod, vec3_length(vec3_sub(model->max, model->min)) * 0.5f);
+
     // Load skin
     if (data->skins_count == 1)
     {
-        loadSkinGLTF(model, &data->skins[0]);
+        loadSkinGLTF(model, data, &data->skins[0]);
     }
 
     MINIMAL_INFO("Model loaded");
@@ -149,12 +519,21 @@ void destroyModel(Model* model)
         destroyMesh(&model->meshes[i]);
 
     free(model->meshes);
+    ignisDeleteVertexArray(&model->vao);
 
     free(model->instances);
+    free(model->instance_nodes);
     free(model->transforms);
 
+    destroyNodeHierarchy(&model->nodes);
+
     destroySkin(model);
 
+    free(model->occluder_positions);
+    free(model->occluder_indices);
+    free(model->occluder_instances);
+
+    destroyMaterialSet(&model->material_set);
     for (int i = 0; i < model->material_count; ++i)
         destroyMaterial(&model->materials[i]);
 
@@ -232,136 +611,124 @@ int loadGLTF(const char* dir, const char* filename, Model* model, AnimationList*
 // ----------------------------------------------------------------
 // openGL stuff
 // ----------------------------------------------------------------
-int uploadMesh(Mesh* mesh)
+static const void* getMeshAttribute(const Mesh* mesh, int attribute)
 {
-    ignisGenerateVertexArray(&mesh->vao, 6);
-
-    size_t size2f = ignisGetTypeSize(IGNIS_FLOAT) * 2;
-    size_t size3f = ignisGetTypeSize(IGNIS_FLOAT) * 3;
-    size_t size4f = ignisGetTypeSize(IGNIS_FLOAT) * 4;
-    size_t size4u = ignisGetTypeSize(IGNIS_UINT32) * 4;
-
-    // positions
-    ignisLoadArrayBuffer(&mesh->vao, 0, mesh->vertex_count * size3f, mesh->positions, IGNIS_STATIC_DRAW);
-    ignisVertexAttribPointer(0, 3, IGNIS_FLOAT, GL_FALSE, 0, 0);
-
-    if (mesh->texcoords) // texcoords
-    {
-        ignisLoadArrayBuffer(&mesh->vao, 1, mesh->vertex_count * size2f, mesh->texcoords, IGNIS_STATIC_DRAW);
-        ignisVertexAttribPointer(1, 2, IGNIS_FLOAT, GL_FALSE, 0, 0);
-    }
-    else
+    switch (attribute)
     {
-        float value[2] = { 0.0f };
-        glVertexAttrib2fv(2, value);
-        glDisableVertexAttribArray(1);
+    case 0: return mesh->positions;
+    case 1: return mesh->texcoords;
+    case 2: return mesh->normals;
+    case 3: return mesh->joints;
+    case 4: return mesh->weights;
     }
+    return NULL;
+}
 
-    if (mesh->normals) // normals
-    {
-        ignisLoadArrayBuffer(&mesh->vao, 2, mesh->vertex_count * size3f, mesh->normals, IGNIS_STATIC_DRAW);
-        ignisVertexAttribPointer(2, 3, IGNIS_FLOAT, GL_FALSE, 0, 0);
-    }
-    else
+// missing attributes are zero, same as the constant a mesh without them is drawn with
+static void packMeshAttribute(const Model* model, int attribute, size_t vertex_size, uint8_t* dst)
+{
+    for (size_t i = 0; i < model->mesh_count; ++i)
     {
-        float value[3] = { 0.0f };
-        glVertexAttrib3fv(2, value);
-        glDisableVertexAttribArray(2);
-    }
+        const Mesh* mesh = &model->meshes[i];
+        const void* src = getMeshAttribute(mesh, attribute);
 
-    if (mesh->joints) // joints
-    {
-        ignisLoadArrayBuffer(&mesh->vao, 3, mesh->vertex_count * size4u, mesh->joints, IGNIS_STATIC_DRAW);
-        ignisVertexAttribIPointer(3, 4, IGNIS_UINT32, 0, 0);
+        size_t size = mesh->vertex_count * vertex_size;
+        if (src) memcpy(dst, src, size);
+        else     memset(dst, 0, size);
+
+        dst += size;
     }
-    else
+}
+
+static const GLint MODEL_ATTRIBUTE_COMPONENTS[5] = { 3, 2, 3, 4, 4 };
+
+int uploadModel(Model* model)
+{
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+    for (size_t i = 0; i < model->mesh_count; ++i)
     {
-        GLuint value[4] = { 0 };
-        glVertexAttribI4uiv(3, value);
-        glDisableVertexAttribArray(3);
+        Mesh* mesh = &model->meshes[i];
+        mesh->base_vertex = (uint32_t)vertex_count;
+        mesh->first_index = (uint32_t)index_count;
+        mesh->index_count = (uint32_t)(mesh->element_count ? mesh->element_count : mesh->vertex_count);
+
+        vertex_count += mesh->vertex_count;
+        index_count += mesh->index_count;
     }
 
-    if (mesh->weights) // weights
+    // every attribute is 4 bytes per component
+    uint8_t* vertices = malloc(vertex_count * 4 * sizeof(float));
+    uint32_t* indices = malloc(index_count * sizeof(uint32_t));
+    if ((vertex_count && !vertices) || (index_count && !indices))
     {
-        ignisLoadArrayBuffer(&mesh->vao, 4, mesh->vertex_count * size4f, mesh->weights, IGNIS_STATIC_DRAW);
-        ignisVertexAttribPointer(4, 4, IGNIS_FLOAT, GL_FALSE, 0, 0);
+        free(vertices);
+        free(indices);
+        return IGNIS_FAILURE;
     }
-    else
+
+    ignisGenerateVertexArray(&model->vao, 6);
+    for (int a = 0; a < 5; ++a)
     {
-        float value[4] = { 0.0f };
-        glVertexAttrib4fv(4, value);
-        glDisableVertexAttribArray(4);
+        size_t vertex_size = MODEL_ATTRIBUTE_COMPONENTS[a] * sizeof(float);
+        packMeshAttribute(model, a, vertex_size, vertices);
+        ignisLoadArrayBuffer(&model->vao, a, vertex_count * vertex_size, vertices, IGNIS_STATIC_DRAW);
     }
 
-    if (mesh->indices)
-        ignisLoadElementBuffer(&mesh->vao, 5, mesh->indices, mesh->element_count, IGNIS_STATIC_DRAW);
-
-    return IGNIS_SUCCESS;
-}
-
-int uploadModel(Model* model)
-{
-    for (int i = 0; i < model->mesh_count; i++) uploadMesh(&model->meshes[i]);
-    return IGNIS_SUCCESS;
-}
+    // indices stay relative to the mesh, draws add the base vertex
+    for (size_t i = 0; i < model->mesh_count; ++i)
+    {
+        const Mesh* mesh = &model->meshes[i];
+        uint32_t* dst = indices + mesh->first_index;
 
-void bindMaterial(IgnisShader shader, const Material* material)
-{
-    ignisBindTexture2D(&material->base_texture, 0);
+        if (mesh->element_count)
+            memcpy(dst, mesh->indices, mesh->element_count * sizeof(uint32_t));
+        else
+            for (uint32_t v = 0; v < mesh->index_count; ++v) dst[v] = v;
+    }
+    ignisLoadElementBuffer(&model->vao, 5, indices, index_count, IGNIS_STATIC_DRAW);
 
-    ignisSetUniformi(shader, "baseTexture", 0);
-    ignisSetUniform3f(shader, "baseColor", 1, &material->color.r);
-}
+    bindModelGeometry(model);
+    glBindVertexArray(0);
 
-void renderMesh(const Mesh* mesh)
-{
-    ignisBindVertexArray(&mesh->vao);
+    model->vertex_count = vertex_count;
+    model->index_count = index_count;
 
-    if (mesh->element_count)
-        glDrawElements(mesh->type, mesh->element_count, GL_UNSIGNED_INT, NULL);
-    else
-        glDrawArrays(mesh->type, 0, mesh->vertex_count);
+    free(vertices);
+    free(indices);
+    return createMaterialSet(&model->material_set, model->materials, model->material_count);
 }
 
-void renderModel(const Model* model, const Animation* animation, IgnisShader shader)
+void bindModelGeometry(const Model* model)
 {
-    ignisUseShader(shader);
-
-    for (size_t i = 0; i < model->instance_count; ++i)
+    for (GLuint a = 0; a < 5; ++a)
     {
-        Mesh* mesh = &model->meshes[model->instances[i]];
-
-        mat4 transform = model->transforms[i];
-        if (getAnimationTransform(animation, mesh->group, &transform))
-            transform = mat4_multiply(model->transforms[i], transform);
-        ignisSetUniformMat4(shader, "model", 1, transform.v[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, model->vao.buffers[a].name);
+        glEnableVertexAttribArray(a);
 
-        // bind material
-        bindMaterial(shader, &model->materials[mesh->material]);
-
-        renderMesh(mesh);
+        if (a == 3)
+            glVertexAttribIPointer(a, MODEL_ATTRIBUTE_COMPONENTS[a], GL_UNSIGNED_INT, 0, NULL);
+        else
+            glVertexAttribPointer(a, MODEL_ATTRIBUTE_COMPONENTS[a], GL_FLOAT, GL_FALSE, 0, NULL);
     }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->vao.buffers[5].name);
 }
 
-void renderModelSkinned(const Model* model, const Animation* animation, IgnisShader shader)
+size_t animateModel(Model* model, const Animation* animation, float time)
 {
-    ignisUseShader(shader);
+    if (model->joint_count) return 0;
+
+    animateNodeHierarchy(&model->nodes, animation, time);
+    size_t updated = updateNodeHierarchy(&model->nodes);
 
     for (size_t i = 0; i < model->instance_count; ++i)
     {
-        Mesh* mesh = &model->meshes[model->instances[i]];
-
-        mat4 transform = model->transforms[i];
-        ignisSetUniformMat4(shader, "model", 1, transform.v[0]);
-
-        mat4 transforms[32] = { 0 };
-        //getBindPose(model, transforms);
-        getAnimationJointTransforms(model, animation, transforms);
-        ignisSetUniformMat4(shader, "jointTransforms", model->joint_count, transforms[0].v[0]);
-
-        // bind material
-        bindMaterial(shader, &model->materials[mesh->material]);
-
-        renderMesh(mesh);
+        uint32_t node = model->instance_nodes[i];
+        if (model->nodes.flags[node] & NODE_UPDATED)
+            model->transforms[i] = mat4x3_to_mat4(model->nodes.worlds[node]);
     }
+
+    return updated;
 }
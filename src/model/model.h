@@ -6,6 +6,9 @@
 #include <ignis/ignis.h>
 
 #include "math/math.h"
+#include "job.h"
+#include "stream_buffer.h"
+#include "shader_cache.h"
 
 typedef struct Model Model;
 
@@ -15,6 +18,16 @@ typedef struct Model Model;
 size_t getMeshIndex(const cgltf_mesh* target, const cgltf_mesh* meshes, size_t count);
 uint32_t getJointIndex(const cgltf_node* target, const cgltf_skin* skin, uint32_t fallback);
 
+#define HIERARCHY_ROOT ((uint32_t)-1)   // parent of joints and nodes without an ancestor
+
+/*
+ * Breadth-first order of the skin joints or scene nodes: order maps to gltf
+ * indices and remap maps gltf indices into the order.
+ * Returns the number of depth levels.
+ */
+size_t getSkinJointOrder(const cgltf_data* data, const cgltf_skin* skin, uint32_t* order, uint32_t* remap);
+size_t getNodeOrder(const cgltf_data* data, uint32_t* order, uint32_t* remap);
+
 // ----------------------------------------------------------------
 // material
 // ----------------------------------------------------------------
@@ -36,17 +49,47 @@ int  loadDefaultMaterial(Material* material);
 int  loadMaterialGLTF(Material* material, const cgltf_material* gltf_material, const char* dir);
 void destroyMaterial(Material* material);
 
+#define MATERIAL_TEXTURE_MAX_SIZE   2048
+
+/* Matches the std430 layout of the Materials block */
+typedef struct
+{
+    float base_color[4];
+    uint32_t layer;         // of the base texture in the texture array
+    uint32_t padding[3];
+} MaterialData;
+
+/*
+ * All materials of a model in one storage buffer, indexed per draw, and their
+ * base textures as the layers of one array texture. Layer 0 is white for
+ * materials without a base texture, so draws never have to rebind between materials.
+ */
+typedef struct
+{
+    GLuint buffer;
+    GLuint textures;        // GL_TEXTURE_2D_ARRAY, every layer resized to the largest base texture
+    size_t layer_count;
+} MaterialSet;
+
+int  createMaterialSet(MaterialSet* set, const Material* materials, size_t count);
+void destroyMaterialSet(MaterialSet* set);
+void bindMaterialSet(const MaterialSet* set);
+
 // ----------------------------------------------------------------
 // mesh
 // ----------------------------------------------------------------
 typedef struct Mesh
 {
-    IgnisVertexArray vao;
     IgnisPrimitiveType type;
 
     size_t vertex_count;
     size_t element_count;
 
+    // range in the geometry of the model, meshes without indices get a generated list
+    uint32_t base_vertex;
+    uint32_t first_index;
+    uint32_t index_count;
+
     vec3 min;
     vec3 max;
 
@@ -71,17 +114,55 @@ void destroyMesh(Mesh* mesh);
 // ----------------------------------------------------------------
 // animation
 // ----------------------------------------------------------------
-typedef struct AnimationChannel
+#define ANIMATION_NO_TIMELINE   ((uint32_t)-1)
+#define ANIMATION_STACK_KEYS    32
+#define ANIMATION_BATCH_SIZE    64      // joints sampled together
+
+/* Local transform of a node or joint */
+typedef struct
+{
+    vec3 translation;
+    quat rotation;
+    vec3 scale;
+} NodeTransform;
+
+/* Key times shared by all channels that sample the same input accessor */
+typedef struct AnimationTimeline
 {
     float* times;
+    size_t count;
+} AnimationTimeline;
+
+/* Position on a timeline: the key before the sample time and the blend factor to the next */
+typedef struct AnimationKey
+{
+    uint32_t frame;
+    float factor;
+} AnimationKey;
+
+AnimationKey getTimelineKey(const AnimationTimeline* timeline, float time);
+
+typedef enum
+{
+    ANIMATION_STEP,
+    ANIMATION_LINEAR,
+    ANIMATION_CUBIC
+} AnimationInterpolation;
+
+/*
+ * Step and linear channels store one value per key. Cubic channels store the Hermite segment
+ * starting at each key as polynomial coefficients a[comps] b[comps] c[comps] d[comps], evaluated with
+ * ((a * t + b) * t + c) * t + d. The segment of the last key is constant.
+ */
+typedef struct AnimationChannel
+{
+    uint32_t timeline;  // ANIMATION_NO_TIMELINE for constant channels
     float* transforms;
 
     size_t frame_count;
+    AnimationInterpolation interpolation;
 } AnimationChannel;
 
-int  loadAnimationChannelGLTF(AnimationChannel* channel, cgltf_animation_sampler* sampler);
-void destroyAnimationChannel(AnimationChannel* channel);
-
 typedef struct Animation
 {
     AnimationChannel* translations;
@@ -89,16 +170,58 @@ typedef struct Animation
     AnimationChannel* scales;
     size_t channel_count;
 
+    AnimationTimeline* timelines;
+    size_t timeline_count;
+
     float time;
     float duration;
 } Animation;
 
+/* inputs holds the source accessor of every timeline already loaded into the animation */
+int  loadAnimationChannelGLTF(Animation* animation, AnimationChannel* channel, const cgltf_animation_sampler* sampler, const cgltf_accessor** inputs);
+void destroyAnimationChannel(AnimationChannel* channel);
+
 int  loadAnimationGLTF(Animation* animation, cgltf_animation* gltf_animation, const cgltf_data* data);
 void destroyAnimation(Animation* animation);
 
+int  sampleAnimationTransform(const Animation* animation, size_t index, float time, mat4x3* transform);
+void sampleAnimationJointTransforms(const Model* model, const Animation* animation, float time, mat4x3* transforms);
+
+/* Joints with a subtree height below min_height keep their bind pose. Returns the number of sampled joints */
+size_t sampleAnimationJointTransformsLOD(const Model* model, const Animation* animation, float time, uint8_t min_height, mat4x3* transforms);
+
 int  getAnimationTransform(const Animation* animation, size_t index, mat4* transform);
-void getAnimationJointTransforms(const Model* model, const Animation* animation, mat4* transforms);
-void getBindPose(const Model* model, mat4* out);
+
+/* Only overwrites the components that have a channel, fails if there is none */
+int  sampleAnimationTRS(const Animation* animation, size_t index, float time, vec3* translation, quat* rotation, vec3* scale);
+
+/*
+ * Searches every timeline once for the given time. Returns buffer if it holds capacity keys,
+ * otherwise heap memory that has to be released with releaseAnimationKeys
+ */
+AnimationKey* getAnimationKeys(const Animation* animation, float time, AnimationKey* buffer, size_t capacity);
+void releaseAnimationKeys(AnimationKey* keys, AnimationKey* buffer);
+
+/* Same as sampleAnimationTRS with the keys from getAnimationKeys */
+int  sampleAnimationTRSKeys(const Animation* animation, size_t index, const AnimationKey* keys, vec3* translation, quat* rotation, vec3* scale);
+
+/*
+ * sampleAnimationTRSKeys for a list of joints, their rotations are interpolated together
+ * with quat_fast_slerp_array. sampled[k] tells if joints[k] has any channel. Returns the sampled count
+ */
+size_t sampleAnimationTRSArray(const Animation* animation, const AnimationKey* keys, const uint32_t* joints, size_t count, NodeTransform* poses, uint8_t* sampled);
+
+/*
+ * Largest angle in degrees between quat_fast_slerp and quat_slerp over all linear rotation keys.
+ * array_error receives the same for quat_fast_slerp_array, may be NULL
+ */
+float getAnimationSlerpError(const Animation* animation, size_t steps, float* array_error);
+
+void getAnimationJointTransforms(const Model* model, const Animation* animation, mat4x3* transforms);
+void getBindPose(const Model* model, mat4x3* out);
+
+/* Turns local joint transforms into the skinning palette in place */
+void evaluateJointHierarchy(const Model* model, mat4x3* transforms);
 
 void resetAnimation(Animation* animation);
 void tickAnimation(Animation* animation, float deltatime);
@@ -112,9 +235,124 @@ typedef struct
 int  loadAnimationsGLTF(AnimationList* list, cgltf_data* data);
 void destroyAnimationList(AnimationList* list);
 
+// ----------------------------------------------------------------
+// node hierarchy
+// ----------------------------------------------------------------
+#define NODE_DIRTY      0x01    // local transform changed, world needs an update
+#define NODE_UPDATED    0x02    // world changed in the last update
+
+/*
+ * Flattened scene nodes sorted so parents come before their children.
+ * Updates walk the nodes once and only recompute dirty subtrees.
+ */
+typedef struct
+{
+    uint32_t* parents;          // HIERARCHY_ROOT for root nodes
+    NodeTransform* locals;
+    NodeTransform* rest;        // locals as loaded
+    mat4x3* worlds;
+    uint8_t* flags;
+    size_t count;
+
+    // timeline keys, grown to the largest animation applied
+    AnimationKey* keys;
+    size_t key_capacity;
+} NodeHierarchy;
+
+/* Decomposes matrix nodes, shear is lost */
+NodeTransform getNodeTransformGLTF(const cgltf_node* node);
+
+/* remap is optional and receives the hierarchy index of every gltf node */
+int  loadNodeHierarchyGLTF(NodeHierarchy* nodes, const cgltf_data* data, uint32_t* remap);
+void destroyNodeHierarchy(NodeHierarchy* nodes);
+
+void resetNodeHierarchy(NodeHierarchy* nodes);
+void setNodeTransform(NodeHierarchy* nodes, size_t index, NodeTransform transform);
+
+/* Applies the channels of a node animation, the channels are indexed by node */
+void animateNodeHierarchy(NodeHierarchy* nodes, const Animation* animation, float time);
+
+/* Returns the number of recomputed world transforms */
+size_t updateNodeHierarchy(NodeHierarchy* nodes);
+
+// ----------------------------------------------------------------
+// animation level of detail
+// ----------------------------------------------------------------
+#define ANIMATION_LOD_LEVELS 3
+
+typedef struct
+{
+    int enabled;
+
+    // beyond update_distances[i] the pose is sampled every 2^(i+1) frames
+    // and interpolated in between, 0 disables a level
+    float update_distances[ANIMATION_LOD_LEVELS];
+
+    // beyond leaf_distance joints with a subtree height below leaf_height are not sampled
+    float leaf_distance;
+    uint8_t leaf_height;
+
+    // instances outside of the view frustum are not evaluated
+    int freeze_culled;
+} AnimationLOD;
+
+/* Distances are derived from the bounding radius of the model */
+void loadDefaultAnimationLOD(AnimationLOD* lod, float radius);
+
+// ----------------------------------------------------------------
+// shader uniforms
+// ----------------------------------------------------------------
+#define SCENE_UNIFORM_BINDING   0   // std140 block "Scene", written once per frame
+#define DRAW_UNIFORM_BINDING    1   // std140 block "Draw", one range per draw
+#define MATERIAL_BINDING        8   // std430 block "Materials", after the compute skinning buffers
+#define BASE_TEXTURE_UNIT       0
+
+/* Matches the std140 layout of the Scene block */
+typedef struct
+{
+    mat4 proj;
+    mat4 view;
+    float time;
+    float padding[3];
+} SceneUniforms;
+
+/* Matches the std140 layout of the Draw block, the draw list passes these per instance instead */
+typedef struct
+{
+    mat4 model;
+    uint32_t material;          // index into the bound MaterialSet
+    uint32_t padding[3];
+    float normal_matrix[3][4];  // std140 mat3, every column padded to a vec4
+} DrawUniforms;
+
+/* Creates the uniform buffers shared by all model shaders and binds them to their binding points */
+int  createShaderUniforms();
+void destroyShaderUniforms();
+
+/*
+ * Loads a variant of a model shader and resolves everything it needs once it is
+ * linked: the Scene and Draw blocks are bound to their binding points and the
+ * samplers to their texture units. shader is 0 if it fails, see finishShaderVariants.
+ */
+int loadModelShader(ShaderCache* cache, IgnisShader* shader, const char* vert, const char* frag, const char* defines);
+
+/* Optional, the blocks are written into the stream unless it is full */
+void setShaderUniformStream(StreamBuffer* stream);
+
+void setSceneUniforms(mat4 proj, mat4 view, float time);
+void setDrawUniforms(const DrawUniforms* draw);
+
 // ----------------------------------------------------------------
 // model
 // ----------------------------------------------------------------
+typedef enum
+{
+    SKINNING_LINEAR,
+    SKINNING_DUAL_QUAT,
+    SKINNING_CPU,       // linear blend skinning on the cpu, drawn with the static model shader
+    SKINNING_COMPUTE    // linear blend skinning in a compute pre-pass, drawn like SKINNING_CPU
+} SkinningMode;
+
 struct Model
 {
     Mesh* meshes;
@@ -122,27 +360,706 @@ struct Model
 
     Material* materials;
     size_t material_count;
+    MaterialSet material_set;   // uploaded with the geometry
 
     // instances
     uint32_t* instances;
-    mat4* transforms;
+    uint32_t* instance_nodes;
+    mat4* transforms;           // world transforms of the instance nodes
     size_t instance_count;
 
-    // skin
-    uint32_t* joints;
-    mat4* joint_locals;
-    mat4* joint_inv_transforms;
+    NodeHierarchy nodes;
+
+    // all meshes back to back, drawn with the ranges of the meshes
+    IgnisVertexArray vao;
+    size_t vertex_count;
+    size_t index_count;
+
+    // bounds of all instances in model space
+    vec3 min;
+    vec3 max;
+
+    // skin, joints are sorted by depth so parents come before their children
+    uint32_t* joints;           // parent of every joint or HIERARCHY_ROOT
+    mat4x3* joint_locals;
+    NodeTransform* joint_rest;  // joint_locals as translation, rotation and scale
+    mat4x3* joint_inv_transforms;
+    uint8_t* joint_heights;     // longest path to a leaf joint (leaves are 0)
+    size_t* joint_levels;       // first joint of every depth level, joint_level_count + 1 entries
+    aabb* joint_bounds;         // vertices each joint influences in bind pose, empty if it has none
+    size_t joint_level_count;
     size_t joint_count;
+
+    // authored occluders in model space, from nodes named Occluder* that are not drawn
+    float* occluder_positions;
+    uint32_t* occluder_indices;
+    size_t occluder_vertex_count;
+    size_t occluder_index_count;
+
+    // instances whose meshes occlude when nothing is authored, drawn with their current transform
+    uint32_t* occluder_instances;
+    size_t occluder_instance_count;
+
+    SkinningMode skinning;
+    AnimationLOD lod;
 };
 
 int  loadModelGLTF(Model* model, cgltf_data* data, const char* dir);
 void destroyModel(Model* model);
 
-
-int uploadMesh(Mesh* mesh);
+/* Uploads the meshes into one set of buffers shared by the whole model and the materials into a MaterialSet */
 int uploadModel(Model* model);
-void renderModel(const Model* model, const Animation* animation, IgnisShader shader);
-void renderModelSkinned(const Model* model, const Animation* animation, IgnisShader shader);
+/* Points the attributes and the element buffer of the bound vertex array at the model geometry */
+void bindModelGeometry(const Model* model);
+/* Animates the node hierarchy of a model without skin and updates the instance transforms */
+size_t animateModel(Model* model, const Animation* animation, float time);
+
+// ----------------------------------------------------------------
+// joint masks
+// ----------------------------------------------------------------
+
+/*
+ * Joints a layer or consumer needs, compiled into a sorted index list that
+ * includes all ancestors. Joints are depth sorted, so parents come first.
+ */
+typedef struct
+{
+    uint32_t* joints;
+    float* weights;     // weight of every listed joint, 0 for ancestors only needed for evaluation
+    size_t count;
+} JointMask;
+
+/* Lists every joint with a weight above 0 and its ancestors, weights has one entry per model joint */
+int  createJointMask(JointMask* mask, const Model* model, const float* weights);
+/* Lists root, its descendants with the given weight and its ancestors */
+int  createJointMaskSubtree(JointMask* mask, const Model* model, uint32_t root, float weight);
+void destroyJointMask(JointMask* mask);
+
+/* getAnimationKeys that only searches the timelines of the joints with a weight in the mask */
+AnimationKey* getAnimationKeysMasked(const Animation* animation, float time, const JointMask* mask, AnimationKey* buffer, size_t capacity);
+
+// ----------------------------------------------------------------
+// pose blending
+// ----------------------------------------------------------------
+#define ANIMATION_BLEND_LAYERS  4
+#define ANIMATION_CROSSFADE     0.25f   // default crossfade duration in seconds
+
+typedef struct
+{
+    const Animation* clip;
+    float time;
+    float speed;
+
+    float weight;
+    float target_weight;
+    float fade_rate;        // weight change per second towards target_weight
+
+    const JointMask* mask;  // NULL for the whole skeleton
+} AnimationLayer;
+
+/*
+ * Stack of clips blended in local space. Every layer is blended over the
+ * layers below it with its weight, translations and scales are lerped and
+ * rotations nlerped. The matrix palette is built once from the result.
+ */
+typedef struct
+{
+    AnimationLayer layers[ANIMATION_BLEND_LAYERS];
+    size_t count;
+} AnimationBlend;
+
+/* Replaces all layers with a single clip at full weight, clip may be NULL */
+void setAnimationBlend(AnimationBlend* blend, const Animation* clip);
+int  addAnimationLayer(AnimationBlend* blend, const Animation* clip, float weight, const JointMask* mask);
+
+/*
+ * Fades clip in on top of the full body layers, the layers below are dropped once it covers them.
+ * Masked layers stay on top of it.
+ */
+int  crossfadeAnimation(AnimationBlend* blend, const Animation* clip, float duration);
+
+/*
+ * Fades the layer playing through mask to weight, it is added on top if there is none.
+ * A different clip replaces the one the layer plays, weight 0 fades it out and drops it.
+ */
+int  fadeMaskedLayer(AnimationBlend* blend, const Animation* clip, const JointMask* mask, float weight, float duration);
+
+/* Advances times and fades, drops layers that no longer contribute */
+void tickAnimationBlend(AnimationBlend* blend, float deltatime);
+
+/*
+ * Samples all layers with a weight at their time plus time_offset into the palette.
+ * Joints with a subtree height below min_height keep their bind pose. Returns the number of sampled joints.
+ * scratch holds scratch_keys timeline keys for each of the ANIMATION_BLEND_LAYERS layers, NULL uses
+ * ANIMATION_STACK_KEYS on the stack. Clips with more timelines allocate their keys.
+ */
+size_t sampleAnimationBlendLOD(const Model* model, const AnimationBlend* blend, float time_offset, uint8_t min_height,
+                               AnimationKey* scratch, size_t scratch_keys, mat4x3* transforms);
+
+// ----------------------------------------------------------------
+// joint palette buffer
+// ----------------------------------------------------------------
+#define JOINT_PALETTE_BINDING       0
+#define JOINT_PALETTE_ROW_SIZE      (4 * sizeof(float))
+#define JOINT_PALETTE_LINEAR_ROWS   3   // rows of the affine transform
+#define JOINT_PALETTE_DQ_ROWS       2   // real and dual part
+#define JOINT_PALETTE_SCALE_EPSILON 1e-3f
+#define JOINT_PALETTE_INVALID       ((size_t)-1)
+
+/*
+ * Shader storage buffer of vec4 rows holding the joint palettes of any
+ * number of skeletons in either format. Palettes are appended every frame
+ * and the whole range is uploaded with a single buffer write, or copied
+ * into the stream buffer if there is one.
+ */
+typedef struct
+{
+    GLuint buffer;
+    float* staging;
+
+    size_t capacity;    // in rows
+    size_t count;       // rows written this frame
+    size_t uploaded;    // rows already in the bound range
+
+    StreamBuffer* stream;   // optional, the palette is streamed into it unless it is full
+
+    // range the shaders read from, either in buffer or in the stream
+    GLuint range_buffer;
+    size_t range_offset;
+    size_t range_size;
+} JointPaletteBuffer;
+
+int  createJointPaletteBuffer(JointPaletteBuffer* palette, size_t capacity);
+void destroyJointPaletteBuffer(JointPaletteBuffer* palette);
+
+void resetJointPaletteBuffer(JointPaletteBuffer* palette);
+
+/* Both return the row offset of the palette, that is passed to the shader as jointOffset */
+size_t writeJointPalette(JointPaletteBuffer* palette, const mat4x3* joints, size_t count);
+size_t writeJointPaletteRows(JointPaletteBuffer* palette, const float* rows, size_t count);
+
+/*
+ * Converts a palette to dual quaternions (JOINT_PALETTE_DQ_ROWS rows per joint).
+ * Fails if the joints are not rigid up to a uniform scale shared by all joints.
+ */
+int getJointPaletteDQ(const mat4x3* joints, size_t count, float* dq, float* scale);
+
+void uploadJointPaletteBuffer(JointPaletteBuffer* palette);
+void bindJointPaletteBuffer(const JointPaletteBuffer* palette, GLuint binding);
+
+// ----------------------------------------------------------------
+// bounding volume hierarchy
+// ----------------------------------------------------------------
+#define BVH_BINS            16
+#define BVH_LEAF_SIZE       4       // nodes with fewer items are never split
+#define BVH_MAX_LEAF_SIZE   16      // nodes with more items are split even if sah disagrees
+#define BVH_TRAVERSAL_COST  1.0f    // relative to testing one item
+#define BVH_MAX_DEPTH       64
+#define BVH_PARALLEL_SIZE   4096    // subtrees below this size are built as separate jobs
+
+typedef struct
+{
+    aabb bounds;
+    uint32_t first;     // left child for inner nodes (the right one follows), first item for leaves
+    uint32_t count;     // items of a leaf, 0 for inner nodes
+} BVHNode;
+
+/*
+ * Binned sah tree over item bounds, flattened depth first so children always
+ * come after their parents. Every subtree references a contiguous range of
+ * items, which are stored in leaf order together with their bounds.
+ */
+typedef struct
+{
+    BVHNode* nodes;
+    size_t node_count;
+    size_t node_capacity;
+
+    uint32_t* items;
+    aabb* item_bounds;
+    size_t count;
+    size_t capacity;
+
+    float build_cost;   // sah cost relative to the root after the last build
+    float cost;         // sah cost relative to the root after the last refit
+} BVH;
+
+void destroyBVH(BVH* bvh);
+
+/* bounds are indexed by item, the big top level subtrees are built in parallel on jobs (may be NULL) */
+int buildBVH(BVH* bvh, const aabb* bounds, size_t count, JobPool* jobs);
+
+/* Updates every node for the new item bounds without changing the topology */
+void refitBVH(BVH* bvh, const aabb* bounds);
+
+/* Writes the visible item indices to out which has room for every item, returns the number written */
+size_t cullBVH(const BVH* bvh, const frustum* f, uint32_t* out);
+
+/* Closest item box hit by the ray. Returns 0 if there is none closer than max_distance */
+int raycastBVH(const BVH* bvh, vec3 origin, vec3 dir, float max_distance, uint32_t* item, float* distance);
+
+// ----------------------------------------------------------------
+// animation world
+// ----------------------------------------------------------------
+typedef struct
+{
+    const Model* model;
+    AnimationBlend blend;
+    float speed;
+
+    mat4 transform;         // world transform of the instance
+    size_t palette_offset;  // first joint of the instance in AnimationWorld::palettes
+
+    // dual quaternion palette, only valid if the model uses SKINNING_DUAL_QUAT
+    int dq_valid;
+    float dq_scale;
+
+    // level of detail
+    uint32_t lod_interval;  // frames between two sampled poses
+    uint32_t lod_frame;     // frames since the cached poses were sampled
+    uint32_t joints_evaluated;
+
+    aabb bounds;            // skinned vertices of the current pose before transform
+} AnimationInstance;
+
+typedef struct
+{
+    AnimationInstance* instances;
+    size_t instance_count;
+    size_t instance_capacity;
+
+    mat4x3* palettes;
+    size_t palette_count;
+    size_t palette_capacity;
+
+    // two cached poses per instance at 2 * palette_offset, used by reduced update rates
+    mat4x3* pose_cache;
+
+    // JOINT_PALETTE_DQ_ROWS vec4 rows per joint
+    float* dq_palettes;
+
+    // world space bounds of the instances and the tree over them
+    aabb* bounds;
+    BVH bvh;
+    int bvh_dirty;          // instances changed since the last build
+
+    // instances found by the last cullAnimationWorld
+    uint32_t* visible;
+    size_t visible_count;
+
+    // view used by level of detail
+    frustum frustum;
+    vec3 eye;
+    int has_view;
+
+    // joint evaluations of the last tick
+    size_t joints_evaluated;
+    size_t joints_saved;
+
+    // level of detail blends that failed the dual quaternion conversion
+    size_t dq_lerp_fallbacks;
+
+    JobPool* jobs;      // may be NULL to update on the calling thread
+    size_t batch_size;  // instances per job
+
+    // timeline keys of every thread, ANIMATION_BLEND_LAYERS * key_capacity each
+    AnimationKey* keys;
+    size_t key_capacity;
+
+    double update_time; // seconds spent in the last tickAnimationWorld
+} AnimationWorld;
+
+int  createAnimationWorld(AnimationWorld* world, JobPool* jobs);
+void destroyAnimationWorld(AnimationWorld* world);
+void clearAnimationWorld(AnimationWorld* world);
+
+int  addAnimationInstance(AnimationWorld* world, const Model* model, const Animation* clip, mat4 transform);
+
+void setAnimationWorldView(AnimationWorld* world, mat4 view_proj, vec3 eye);
+void tickAnimationWorld(AnimationWorld* world, float deltatime);
+
+const mat4x3* getAnimationInstancePalette(const AnimationWorld* world, size_t index);
+
+/* Writes the instances inside f to AnimationWorld::visible, every instance if f is NULL */
+size_t cullAnimationWorld(AnimationWorld* world, const frustum* f);
+
+/* Instance with the closest bounds along the ray, returns 0 if none is hit */
+int pickAnimationInstance(AnimationWorld* world, vec3 origin, vec3 dir, size_t* index);
+
+/*
+ * Conservative box around the vertices skinned with palette: every vertex is a
+ * weighted average of its joints, so it stays within their transformed bounds
+ */
+aabb getSkinnedBounds(const Model* model, const mat4x3* palette);
+
+// ----------------------------------------------------------------
+// skinning buffer
+// ----------------------------------------------------------------
+#define SKINNING_VERTEX_FLOATS  8   // position, normal, texcoord
+#define SKINNING_COMPUTE_SHADER "res/shaders/skinning.comp"
+
+typedef struct
+{
+    const Mesh* mesh;
+    const float* palette;
+    float* out;
+    size_t begin;
+    size_t end;
+} SkinningTask;
+
+/* Uniform locations of the skinning compute shader */
+typedef struct
+{
+    GLint vertex_count;
+    GLint source_offset;
+    GLint mesh_offset;
+    GLint instance_stride;
+    GLint has_texcoords;
+    GLint has_normals;
+    GLint has_joints;
+    int resolved;
+} SkinningComputeUniforms;
+
+/*
+ * Skins every mesh of a model once per instance of an animation world into
+ * a single stream buffer, either on the cpu or in a compute pre-pass. The
+ * result is drawn with the static model shader by any number of passes.
+ */
+typedef struct
+{
+    const Model* model;
+
+    GLuint vbo;
+    GLuint vao;             // the skinned vertices with the element buffer of the model
+    GLuint vertex_source;   // buffer the vao reads the vertices from, the vbo or the stream
+    uint32_t vertex_source_generation;  // of the stream, 0 for the vbo
+    size_t vertex_source_offset;
+    size_t* vertex_offsets; // first vertex of each mesh within an instance
+    size_t vertex_count;    // vertices per instance
+
+    float* vertices;        // staging, SKINNING_VERTEX_FLOATS per vertex
+    float* palettes;        // 4 padded columns per joint
+    size_t capacity;        // in instances
+    size_t instance_count;
+
+    SkinningTask* tasks;
+    size_t task_capacity;
+
+    // compute pre-pass, 0 if the shader is not available
+    GLuint compute;
+    SkinningComputeUniforms compute_uniforms;
+    GLuint instance_buffer;
+    uint32_t* instance_rows;    // first palette row of every slot
+    size_t instance_row_capacity;
+
+    StreamBuffer* stream;   // optional, cpu skinned vertices and instance rows are streamed into it unless it is full
+
+    double skinning_time;   // seconds spent skinning in the last frame
+} SkinningBuffer;
+
+/* The compute shader is only built with a cache and linked with the other variants */
+int  createSkinningBuffer(SkinningBuffer* skinning, const Model* model, ShaderCache* cache);
+void destroySkinningBuffer(SkinningBuffer* skinning);
+
+/* Converts joints to 16 floats per joint, the layout expected by skinMeshVertices */
+void getSkinningPalette(const mat4x3* joints, size_t count, float* palette);
+void skinMeshVertices(const Mesh* mesh, const float* palette, float* out, size_t begin, size_t end);
+
+/* Skins all instances of the buffers model, slots match the instance indices of the world */
+int  skinAnimationWorld(SkinningBuffer* skinning, const AnimationWorld* world, JobPool* jobs);
+
+/*
+ * Same as skinAnimationWorld but on the gpu. Expects the linear palettes of the
+ * world to be bound at JOINT_PALETTE_BINDING, starting at the row palette_base.
+ */
+int  skinAnimationWorldCompute(SkinningBuffer* skinning, const AnimationWorld* world, size_t palette_base);
+
+// ----------------------------------------------------------------
+// baked animation
+// ----------------------------------------------------------------
+#define BAKED_ANIMATION_FRAME_RATE   30.0f
+#define BAKED_ANIMATION_TEXELS       3   // RGBA16F texels per joint, rows of the affine transform
+#define BAKED_ANIMATION_TEXTURE_UNIT 4
+
+typedef struct
+{
+    uint32_t first_frame;
+    uint32_t frame_count;   // frames are spaced evenly over the duration and loop
+    float duration;
+} BakedClip;
+
+/*
+ * Skinning palettes of every frame of every clip in a half-float texture
+ * with one row per frame and BAKED_ANIMATION_TEXELS texels per joint.
+ */
+typedef struct
+{
+    BakedClip* clips;
+    size_t clip_count;
+
+    size_t joint_count;
+    size_t frame_count;
+
+    uint16_t* data;     // half-floats, kept for saving
+    GLuint texture;
+
+    uint64_t source_hash;   // see getBakedAnimationHash
+} BakedAnimation;
+
+int  bakeAnimations(BakedAnimation* baked, const Model* model, const AnimationList* animations, float frame_rate);
+void destroyBakedAnimation(BakedAnimation* baked);
+int  uploadBakedAnimation(BakedAnimation* baked);
+
+/* Identifies the skeleton, the keys of every clip and the frame rate a bake was made from */
+uint64_t getBakedAnimationHash(const Model* model, const AnimationList* animations, float frame_rate);
+
+int  saveBakedAnimation(const BakedAnimation* baked, const char* path);
+int  loadBakedAnimation(BakedAnimation* baked, const char* path);
+
+typedef struct
+{
+    mat4 transform;
+    float normal_matrix[9];
+
+    // matches the clip attribute of baked.vert
+    float first_frame;
+    float frame_count;
+    float frame_rate;   // frames per second including the speed of the instance
+    float frame_offset;
+} BakedInstance;
+
+/* Instanced draws of a model animated entirely on the gpu from a baked animation */
+typedef struct
+{
+    const Model* model;
+    const BakedAnimation* baked;
+
+    BakedInstance* instances;
+    size_t instance_count;
+    size_t instance_capacity;
+
+    GLuint instance_buffer;
+    GLuint vao;             // the model geometry with the instance attributes
+    int dirty;
+
+    // Draw block of every model instance, written once and bound as a range per draw
+    GLuint draw_buffer;
+    size_t draw_stride;
+} BakedCrowd;
+
+int  createBakedCrowd(BakedCrowd* crowd, const Model* model, const BakedAnimation* baked);
+void destroyBakedCrowd(BakedCrowd* crowd);
+void clearBakedCrowd(BakedCrowd* crowd);
+
+int  addBakedInstance(BakedCrowd* crowd, mat4 transform, uint32_t clip, float time_offset, float speed);
+/* The crowd plays at the time of the Scene block */
+void renderBakedCrowd(BakedCrowd* crowd, IgnisShader shader);
+
+// ----------------------------------------------------------------
+// occlusion culling
+// ----------------------------------------------------------------
+#define OCCLUSION_TILE_WIDTH    64
+#define OCCLUSION_TILE_HEIGHT   32
+#define OCCLUSION_MAX_LEVELS    16
+#define OCCLUSION_DEPTH_BIAS    0.0001f // boxes touching an occluder surface stay visible
+
+/* Occluder triangle in buffer pixels, z is depth in [0, 1] */
+typedef struct
+{
+    float x[3];
+    float y[3];
+    float z[3];
+} OcclusionTriangle;
+
+/*
+ * Low resolution depth buffer rasterized on the cpu from a few occluder meshes.
+ * Every level of the pyramid holds the farthest depth of the four texels below
+ * it, so a box is hidden if it is behind every texel of its footprint on the
+ * level where that footprint is at most two texels wide.
+ */
+typedef struct
+{
+    uint32_t width;         // multiples of the tile size
+    uint32_t height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+
+    float* depth;           // every level back to back, rows from the bottom
+    uint32_t level_offsets[OCCLUSION_MAX_LEVELS];
+    uint32_t level_count;
+
+    mat4 view_proj;
+
+    OcclusionTriangle* triangles;
+    size_t triangle_count;
+    size_t triangle_capacity;
+
+    // triangles overlapping each tile
+    uint32_t* bins;
+    uint32_t* bin_offsets;  // tiles_x * tiles_y + 1 entries
+    size_t bin_capacity;
+} OcclusionBuffer;
+
+int  createOcclusionBuffer(OcclusionBuffer* buffer, uint32_t width, uint32_t height);
+void destroyOcclusionBuffer(OcclusionBuffer* buffer);
+
+/* Drops the occluders of the last frame */
+void clearOcclusionBuffer(OcclusionBuffer* buffer, mat4 view_proj);
+
+/* Triangles crossing the near plane are skipped, so occluders never hide anything they do not cover */
+int addOccluder(OcclusionBuffer* buffer, const float* positions, const uint32_t* indices, size_t index_count, mat4 transform);
+
+/* Rasterizes the occluders tile by tile on jobs (may be NULL) and builds the pyramid */
+void rasterizeOcclusionBuffer(OcclusionBuffer* buffer, JobPool* jobs);
+
+/* Returns 0 if the box is completely hidden by the occluders */
+int testOcclusion(const OcclusionBuffer* buffer, aabb box);
+
+/* Tests the boxes still marked visible and clears the hidden ones. Returns the number of hidden boxes */
+size_t testOcclusionBoxes(const OcclusionBuffer* buffer, const aabb* boxes, size_t count, uint8_t* visible);
+
+// ----------------------------------------------------------------
+// draw list
+// ----------------------------------------------------------------
+/*
+ * Sort key from the most to the least significant bits: shader, material set,
+ * vertex array, mesh and depth, so draws sharing state end up next to each other
+ * and the instances of a mesh are drawn front to back. Materials are indexed per
+ * instance, so they no longer split batches.
+ */
+#define DRAW_KEY_SHADER_BITS    6
+#define DRAW_KEY_MATERIAL_BITS  12
+#define DRAW_KEY_VAO_BITS       10
+#define DRAW_KEY_MESH_BITS      12
+#define DRAW_KEY_DEPTH_BITS     24
+
+#define DRAW_LIST_SHADERS       (1 << DRAW_KEY_SHADER_BITS)
+
+// per instance attributes, the baked crowd uses the same locations in its own vertex array
+#define DRAW_LOCATION_TRANSFORM     5   // mat4, occupies 5 to 8
+#define DRAW_LOCATION_MATERIAL      9
+#define DRAW_LOCATION_JOINT_OFFSET  10
+#define DRAW_LOCATION_JOINT_SCALE   11
+#define DRAW_LOCATION_NORMAL_MATRIX 12  // mat3, occupies 12 to 14
+
+/* Vertex layout of the instance buffer, everything a draw needs besides the material set */
+typedef struct
+{
+    mat4 transform;
+    uint32_t material;      // index into the material set of the draw
+    int32_t joint_offset;   // first palette row, skinned shaders only
+    float joint_scale;      // dual quaternion shader only
+    float normal_matrix[9]; // see mat4_normal_matrix
+} DrawInstance;
+
+/* Matches DrawElementsIndirectCommand */
+typedef struct
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+} DrawCommand;
+
+typedef struct
+{
+    IgnisShader shader;
+    const MaterialSet* materials;
+    const Mesh* mesh;
+    GLuint vao;             // the model geometry unless the vertices live somewhere else
+    GLint base_vertex;
+
+    DrawInstance instance;
+} DrawItem;
+
+typedef struct
+{
+    uint64_t key;
+    uint32_t item;
+} DrawKey;
+
+typedef struct
+{
+    // culling, since the last resetDrawList
+    size_t tested;
+    size_t culled;
+    size_t occluded;        // part of culled
+
+    // submission
+    size_t draws;           // instances
+    size_t commands;        // indirect commands, one per run of instances
+    size_t batches;         // multi draw calls
+    size_t shader_binds;
+    size_t texture_binds;   // material sets
+    size_t vao_binds;
+    size_t binds_saved;     // shader, texture and vertex array binds skipped as redundant
+} DrawListStats;
+
+typedef struct
+{
+    DrawItem* items;
+    DrawKey* keys;
+    DrawKey* sort_buffer;
+    aabb* bounds;           // world bounds of every item
+    uint8_t* visible;
+    size_t count;           // items
+    size_t key_count;       // keys left after culling
+    size_t capacity;
+
+    // instances in key order, consecutive items with the same mesh are one command
+    DrawInstance* instances;
+    GLuint instance_buffer;
+
+    // consecutive commands with the same shader, material set and vertex array are one multi draw
+    DrawCommand* commands;
+    uint32_t* command_items;    // first key of every command
+    GLuint command_buffer;
+
+    // shaders seen this frame, their index is the shader field of the key
+    IgnisShader shaders[DRAW_LIST_SHADERS];
+    size_t shader_count;
+
+    vec3 eye;
+    float far_plane;
+
+    frustum frustum;
+    int culling;
+
+    const OcclusionBuffer* occlusion;   // rasterized occluders, NULL to skip occlusion culling
+    StreamBuffer* stream;               // optional, instances and commands are streamed into it unless it is full
+
+    DrawListStats stats;
+} DrawList;
+
+int  createDrawList(DrawList* list);
+void destroyDrawList(DrawList* list);
+
+/* Drops all draws, depth is the distance to eye relative to far_plane. Draws are culled against view_proj */
+void resetDrawList(DrawList* list, mat4 view_proj, vec3 eye, float far_plane);
+
+/* Sets the instance transform of the item together with its normal matrix */
+void setDrawTransform(DrawItem* item, mat4 transform);
+
+int pushDraw(DrawList* list, const DrawItem* item, aabb bounds);
+int pushModelDraws(DrawList* list, const Model* model, IgnisShader shader);
+
+/* bounds are the skinned vertices before transform, see AnimationInstance::bounds */
+int pushModelDrawsSkinned(DrawList* list, const Model* model, aabb bounds, size_t palette_offset, float scale, mat4 transform, IgnisShader shader);
+int pushSkinningBufferDraws(DrawList* list, const SkinningBuffer* skinning, size_t slot, aabb bounds, mat4 transform, IgnisShader shader);
+
+/* Drops the draws outside of the frustum and the ones hidden by DrawList::occlusion */
+void cullDrawList(DrawList* list);
+
+/* Radix sort of the keys */
+void sortDrawList(DrawList* list);
+
+/*
+ * Draws in key order and only touches the state that changed since the previous draw.
+ * Runs of items with the same mesh become one indirect command and runs of commands
+ * with the same state one glMultiDrawElementsIndirect
+ */
+void submitDrawList(DrawList* list);
 
 int loadGLTF(const char* dir, const char* filename, Model* model, AnimationList* animations);
 
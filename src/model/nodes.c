@@ -0,0 +1,170 @@
+#include "model.h"
+
+#include <string.h>
+
+NodeTransform getNodeTransformGLTF(const cgltf_node* node)
+{
+    NodeTransform transform = {
+        { 0.0f, 0.0f, 0.0f },
+        quat_identity(),
+        { 1.0f, 1.0f, 1.0f }
+    };
+
+    if (node->has_matrix)
+    {
+        // decompose, shear is lost
+        mat4x3 m = mat4x3_cast(*(const mat4*)node->matrix);
+        transform.translation = (vec3){ m.v[3][0], m.v[3][1], m.v[3][2] };
+
+        float* scale = &transform.scale.x;
+        for (int c = 0; c < 3; ++c)
+            scale[c] = vec3_length((vec3){ m.v[c][0], m.v[c][1], m.v[c][2] });
+
+        // mirroring goes into the scale, so the remaining rotation is proper
+        vec3 x = { m.v[0][0], m.v[0][1], m.v[0][2] };
+        vec3 y = { m.v[1][0], m.v[1][1], m.v[1][2] };
+        vec3 z = { m.v[2][0], m.v[2][1], m.v[2][2] };
+        if (vec3_dot(vec3_cross(x, y), z) < 0.0f) scale[0] = -scale[0];
+
+        for (int c = 0; c < 3; ++c)
+        {
+            if (scale[c] == 0.0f) continue;
+
+            m.v[c][0] /= scale[c];
+            m.v[c][1] /= scale[c];
+            m.v[c][2] /= scale[c];
+        }
+        transform.rotation = mat4x3_rotation(m, 1.0f);
+        return transform;
+    }
+
+    if (node->has_translation) memcpy(&transform.translation, node->translation, sizeof(vec3));
+    if (node->has_rotation)    memcpy(&transform.rotation, node->rotation, sizeof(quat));
+    if (node->has_scale)       memcpy(&transform.scale, node->scale, sizeof(vec3));
+
+    return transform;
+}
+
+int loadNodeHierarchyGLTF(NodeHierarchy* nodes, const cgltf_data* data, uint32_t* remap)
+{
+    size_t count = data->nodes_count;
+
+    memset(nodes, 0, sizeof(NodeHierarchy));
+    nodes->count = count;
+
+    nodes->parents = malloc(count * sizeof(uint32_t));
+    nodes->locals = malloc(count * sizeof(NodeTransform));
+    nodes->rest = malloc(count * sizeof(NodeTransform));
+    nodes->worlds = malloc(count * sizeof(mat4x3));
+    nodes->flags = malloc(count * sizeof(uint8_t));
+
+    uint32_t* order = malloc(count * sizeof(uint32_t));
+    uint32_t* node_remap = remap ? remap : malloc(count * sizeof(uint32_t));
+
+    if (!(nodes->parents && nodes->locals && nodes->rest && nodes->worlds && nodes->flags && order && node_remap))
+    {
+        free(order);
+        if (node_remap != remap) free(node_remap);
+        destroyNodeHierarchy(nodes);
+        return IGNIS_FAILURE;
+    }
+
+    getNodeOrder(data, order, node_remap);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const cgltf_node* node = &data->nodes[order[i]];
+
+        nodes->parents[i] = node->parent ? node_remap[node->parent - data->nodes] : HIERARCHY_ROOT;
+        nodes->rest[i] = getNodeTransformGLTF(node);
+    }
+
+    free(order);
+    if (node_remap != remap) free(node_remap);
+
+    resetNodeHierarchy(nodes);
+    updateNodeHierarchy(nodes);
+
+    return IGNIS_SUCCESS;
+}
+
+void destroyNodeHierarchy(NodeHierarchy* nodes)
+{
+    free(nodes->parents);
+    free(nodes->locals);
+    free(nodes->rest);
+    free(nodes->worlds);
+    free(nodes->flags);
+    free(nodes->keys);
+
+    memset(nodes, 0, sizeof(NodeHierarchy));
+}
+
+void resetNodeHierarchy(NodeHierarchy* nodes)
+{
+    memcpy(nodes->locals, nodes->rest, nodes->count * sizeof(NodeTransform));
+    memset(nodes->flags, NODE_DIRTY, nodes->count * sizeof(uint8_t));
+}
+
+void setNodeTransform(NodeHierarchy* nodes, size_t index, NodeTransform transform)
+{
+    if (index >= nodes->count) return;
+
+    nodes->locals[index] = transform;
+    nodes->flags[index] |= NODE_DIRTY;
+}
+
+void animateNodeHierarchy(NodeHierarchy* nodes, const Animation* animation, float time)
+{
+    if (!animation) return;
+
+    if (animation->timeline_count > nodes->key_capacity)
+    {
+        AnimationKey* keys = realloc(nodes->keys, animation->timeline_count * sizeof(AnimationKey));
+        if (keys)
+        {
+            nodes->keys = keys;
+            nodes->key_capacity = animation->timeline_count;
+        }
+    }
+
+    AnimationKey* keys = getAnimationKeys(animation, time, nodes->keys, nodes->key_capacity);
+
+    size_t count = animation->channel_count < nodes->count ? animation->channel_count : nodes->count;
+    for (size_t i = 0; i < count; ++i)
+    {
+        NodeTransform* local = &nodes->locals[i];
+        int sampled = keys ? sampleAnimationTRSKeys(animation, i, keys, &local->translation, &local->rotation, &local->scale)
+                           : sampleAnimationTRS(animation, i, time, &local->translation, &local->rotation, &local->scale);
+        if (sampled) nodes->flags[i] |= NODE_DIRTY;
+    }
+
+    releaseAnimationKeys(keys, nodes->keys);
+}
+
+size_t updateNodeHierarchy(NodeHierarchy* nodes)
+{
+    size_t updated = 0;
+
+    // parents come first, so their flags are final when the children are visited
+    for (size_t i = 0; i < nodes->count; ++i)
+    {
+        uint32_t parent = nodes->parents[i];
+        int parent_updated = parent != HIERARCHY_ROOT && (nodes->flags[parent] & NODE_UPDATED);
+
+        if (!(nodes->flags[i] & NODE_DIRTY) && !parent_updated)
+        {
+            nodes->flags[i] = 0;
+            continue;
+        }
+
+        const NodeTransform* local = &nodes->locals[i];
+        mat4x3 transform = mat4x3_trs(local->translation, local->rotation, local->scale);
+
+        nodes->worlds[i] = parent == HIERARCHY_ROOT ? transform : mat4x3_multiply(nodes->worlds[parent], transform);
+        nodes->flags[i] = NODE_UPDATED;
+        updated++;
+    }
+
+    return updated;
+}
@@ -0,0 +1,476 @@
+#include "model.h"
+
+#include <string.h>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define OCCLUSION_AVX2
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define OCCLUSION_SSE
+#endif
+
+#ifdef OCCLUSION_AVX2
+    #define OCCLUSION_LANES             8
+    #define occlusion_simd              __m256
+    #define occlusion_set1(x)           _mm256_set1_ps(x)
+    #define occlusion_lanes()           _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f)
+    #define occlusion_add(a, b)         _mm256_add_ps(a, b)
+    #define occlusion_mul(a, b)         _mm256_mul_ps(a, b)
+    #define occlusion_min(a, b)         _mm256_min_ps(a, b)
+    #define occlusion_and(a, b)         _mm256_and_ps(a, b)
+    #define occlusion_andnot(a, b)      _mm256_andnot_ps(a, b)
+    #define occlusion_or(a, b)          _mm256_or_ps(a, b)
+    #define occlusion_cmpge(a, b)       _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+    #define occlusion_movemask(a)       _mm256_movemask_ps(a)
+    #define occlusion_load(p)           _mm256_loadu_ps(p)
+    #define occlusion_store(p, a)       _mm256_storeu_ps(p, a)
+    #define occlusion_zero()            _mm256_setzero_ps()
+#elif defined(OCCLUSION_SSE)
+    #define OCCLUSION_LANES             4
+    #define occlusion_simd              __m128
+    #define occlusion_set1(x)           _mm_set1_ps(x)
+    #define occlusion_lanes()           _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)
+    #define occlusion_add(a, b)         _mm_add_ps(a, b)
+    #define occlusion_mul(a, b)         _mm_mul_ps(a, b)
+    #define occlusion_min(a, b)         _mm_min_ps(a, b)
+    #define occlusion_and(a, b)         _mm_and_ps(a, b)
+    #define occlusion_andnot(a, b)      _mm_andnot_ps(a, b)
+    #define occlusion_or(a, b)          _mm_or_ps(a, b)
+    #define occlusion_cmpge(a, b)       _mm_cmpge_ps(a, b)
+    #define occlusion_movemask(a)       _mm_movemask_ps(a)
+    #define occlusion_load(p)           _mm_loadu_ps(p)
+    #define occlusion_store(p, a)       _mm_storeu_ps(p, a)
+    #define occlusion_zero()            _mm_setzero_ps()
+#else
+    #define OCCLUSION_LANES             1
+#endif
+
+#define OCCLUSION_MIN_TRIANGLES 256
+
+static void getOcclusionLevelSize(const OcclusionBuffer* buffer, uint32_t level, uint32_t* width, uint32_t* height)
+{
+    *width = buffer->width;
+    *height = buffer->height;
+    for (uint32_t i = 0; i < level; ++i)
+    {
+        *width = (*width + 1) / 2;
+        *height = (*height + 1) / 2;
+    }
+}
+
+int createOcclusionBuffer(OcclusionBuffer* buffer, uint32_t width, uint32_t height)
+{
+    memset(buffer, 0, sizeof(OcclusionBuffer));
+
+    buffer->tiles_x = (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+    buffer->tiles_y = (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+    if (!buffer->tiles_x || !buffer->tiles_y) return IGNIS_FAILURE;
+
+    buffer->width = buffer->tiles_x * OCCLUSION_TILE_WIDTH;
+    buffer->height = buffer->tiles_y * OCCLUSION_TILE_HEIGHT;
+
+    // halve until a single texel is left
+    uint32_t total = 0;
+    uint32_t w = buffer->width, h = buffer->height;
+    while (buffer->level_count < OCCLUSION_MAX_LEVELS)
+    {
+        buffer->level_offsets[buffer->level_count++] = total;
+        total += w * h;
+
+        if (w == 1 && h == 1) break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+
+    buffer->depth = malloc(total * sizeof(float));
+    buffer->bin_offsets = malloc((buffer->tiles_x * buffer->tiles_y + 1) * sizeof(uint32_t));
+    if (!buffer->depth || !buffer->bin_offsets)
+    {
+        destroyOcclusionBuffer(buffer);
+        return IGNIS_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < total; ++i)
+        buffer->depth[i] = 1.0f;
+
+    buffer->view_proj = mat4_identity();
+    return IGNIS_SUCCESS;
+}
+
+void destroyOcclusionBuffer(OcclusionBuffer* buffer)
+{
+    free(buffer->depth);
+    free(buffer->triangles);
+    free(buffer->bins);
+    free(buffer->bin_offsets);
+    memset(buffer, 0, sizeof(OcclusionBuffer));
+}
+
+void clearOcclusionBuffer(OcclusionBuffer* buffer, mat4 view_proj)
+{
+    buffer->view_proj = view_proj;
+    buffer->triangle_count = 0;
+}
+
+int addOccluder(OcclusionBuffer* buffer, const float* positions, const uint32_t* indices, size_t index_count, mat4 transform)
+{
+    size_t count = index_count / 3;
+    if (buffer->triangle_count + count > buffer->triangle_capacity)
+    {
+        size_t capacity = buffer->triangle_capacity ? buffer->triangle_capacity : OCCLUSION_MIN_TRIANGLES;
+        while (capacity < buffer->triangle_count + count) capacity *= 2;
+
+        OcclusionTriangle* triangles = realloc(buffer->triangles, capacity * sizeof(OcclusionTriangle));
+        if (!triangles) return IGNIS_FAILURE;
+
+        buffer->triangles = triangles;
+        buffer->triangle_capacity = capacity;
+    }
+
+    mat4 m = mat4_multiply(buffer->view_proj, transform);
+    float width = (float)buffer->width, height = (float)buffer->height;
+
+    for (size_t t = 0; t < count; ++t)
+    {
+        OcclusionTriangle triangle;
+
+        int valid = 1;
+        for (int k = 0; k < 3 && valid; ++k)
+        {
+            const float* p = &positions[indices[t * 3 + k] * 3];
+
+            float x = m.v[0][0] * p[0] + m.v[1][0] * p[1] + m.v[2][0] * p[2] + m.v[3][0];
+            float y = m.v[0][1] * p[0] + m.v[1][1] * p[1] + m.v[2][1] * p[2] + m.v[3][1];
+            float z = m.v[0][2] * p[0] + m.v[1][2] * p[1] + m.v[2][2] * p[2] + m.v[3][2];
+            float w = m.v[0][3] * p[0] + m.v[1][3] * p[1] + m.v[2][3] * p[2] + m.v[3][3];
+
+            // the gpu clips at the near plane, a clipped occluder would hide what shows through the hole
+            if (w <= 0.0f || z < -w)
+            {
+                valid = 0;
+                break;
+            }
+
+            float inv_w = 1.0f / w;
+            triangle.x[k] = (x * inv_w * 0.5f + 0.5f) * width;
+            triangle.y[k] = (y * inv_w * 0.5f + 0.5f) * height;
+            triangle.z[k] = z * inv_w * 0.5f + 0.5f;
+        }
+
+        if (!valid) continue;
+
+        // completely off screen or behind the far plane
+        if (fmaxf(triangle.x[0], fmaxf(triangle.x[1], triangle.x[2])) < 0.0f) continue;
+        if (fmaxf(triangle.y[0], fmaxf(triangle.y[1], triangle.y[2])) < 0.0f) continue;
+        if (fminf(triangle.x[0], fminf(triangle.x[1], triangle.x[2])) > width) continue;
+        if (fminf(triangle.y[0], fminf(triangle.y[1], triangle.y[2])) > height) continue;
+        if (fminf(triangle.z[0], fminf(triangle.z[1], triangle.z[2])) > 1.0f) continue;
+
+        buffer->triangles[buffer->triangle_count++] = triangle;
+    }
+
+    return IGNIS_SUCCESS;
+}
+
+/* Pixels whose centers lie in the bounding rectangle of the triangle, returns 0 if there are none */
+static int getTriangleRect(const OcclusionBuffer* buffer, const OcclusionTriangle* triangle, int rect[4])
+{
+    float min_x = fminf(triangle->x[0], fminf(triangle->x[1], triangle->x[2]));
+    float max_x = fmaxf(triangle->x[0], fmaxf(triangle->x[1], triangle->x[2]));
+    float min_y = fminf(triangle->y[0], fminf(triangle->y[1], triangle->y[2]));
+    float max_y = fmaxf(triangle->y[0], fmaxf(triangle->y[1], triangle->y[2]));
+
+    rect[0] = max((int)ceilf(min_x - 0.5f), 0);
+    rect[1] = max((int)ceilf(min_y - 0.5f), 0);
+    rect[2] = (int)floorf(max_x - 0.5f);
+    rect[3] = (int)floorf(max_y - 0.5f);
+
+    if (rect[2] > (int)buffer->width - 1)  rect[2] = (int)buffer->width - 1;
+    if (rect[3] > (int)buffer->height - 1) rect[3] = (int)buffer->height - 1;
+
+    return rect[0] <= rect[2] && rect[1] <= rect[3];
+}
+
+static int binOcclusionTriangles(OcclusionBuffer* buffer)
+{
+    size_t tile_count = buffer->tiles_x * buffer->tiles_y;
+    uint32_t* offsets = buffer->bin_offsets;
+    memset(offsets, 0, (tile_count + 1) * sizeof(uint32_t));
+
+    // count the triangles of every tile, then place them
+    size_t total = 0;
+    for (size_t t = 0; t < buffer->triangle_count; ++t)
+    {
+        int rect[4];
+        if (!getTriangleRect(buffer, &buffer->triangles[t], rect)) continue;
+
+        for (int ty = rect[1] / OCCLUSION_TILE_HEIGHT; ty <= rect[3] / OCCLUSION_TILE_HEIGHT; ++ty)
+        {
+            for (int tx = rect[0] / OCCLUSION_TILE_WIDTH; tx <= rect[2] / OCCLUSION_TILE_WIDTH; ++tx)
+                offsets[ty * buffer->tiles_x + tx]++;
+        }
+    }
+
+    for (size_t i = 0; i < tile_count; ++i)
+    {
+        uint32_t count = offsets[i];
+        offsets[i] = (uint32_t)total;
+        total += count;
+    }
+    offsets[tile_count] = (uint32_t)total;
+
+    if (total > buffer->bin_capacity)
+    {
+        uint32_t* bins = realloc(buffer->bins, total * sizeof(uint32_t));
+        if (!bins) return IGNIS_FAILURE;
+
+        buffer->bins = bins;
+        buffer->bin_capacity = total;
+    }
+
+    for (size_t t = 0; t < buffer->triangle_count; ++t)
+    {
+        int rect[4];
+        if (!getTriangleRect(buffer, &buffer->triangles[t], rect)) continue;
+
+        for (int ty = rect[1] / OCCLUSION_TILE_HEIGHT; ty <= rect[3] / OCCLUSION_TILE_HEIGHT; ++ty)
+        {
+            for (int tx = rect[0] / OCCLUSION_TILE_WIDTH; tx <= rect[2] / OCCLUSION_TILE_WIDTH; ++tx)
+                buffer->bins[offsets[ty * buffer->tiles_x + tx]++] = (uint32_t)t;
+        }
+    }
+
+    // placing moved every offset to the start of the next tile
+    for (size_t i = tile_count; i > 0; --i)
+        offsets[i] = offsets[i - 1];
+    offsets[0] = 0;
+
+    return IGNIS_SUCCESS;
+}
+
+static void rasterizeOcclusionTriangle(OcclusionBuffer* buffer, const OcclusionTriangle* triangle, const int tile[4])
+{
+    float x0 = triangle->x[0], y0 = triangle->y[0], z0 = triangle->z[0];
+    float x1 = triangle->x[1], y1 = triangle->y[1], z1 = triangle->z[1];
+    float x2 = triangle->x[2], y2 = triangle->y[2], z2 = triangle->z[2];
+
+    // occluders are two sided, wind every triangle counter clockwise
+    float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+    if (area == 0.0f) return;
+    if (area < 0.0f)
+    {
+        float t;
+        t = x1; x1 = x2; x2 = t;
+        t = y1; y1 = y2; y2 = t;
+        t = z1; z1 = z2; z2 = t;
+        area = -area;
+    }
+
+    int rect[4];
+    if (!getTriangleRect(buffer, triangle, rect)) return;
+
+    rect[0] = max(rect[0], tile[0]);
+    rect[1] = max(rect[1], tile[1]);
+    rect[2] = rect[2] < tile[2] ? rect[2] : tile[2];
+    rect[3] = rect[3] < tile[3] ? rect[3] : tile[3];
+    if (rect[0] > rect[2] || rect[1] > rect[3]) return;
+
+    // edge functions a * x + b * y + c, positive inside
+    float a0 = y1 - y2, b0 = x2 - x1, c0 = x1 * y2 - x2 * y1;   // opposite of vertex 0
+    float a1 = y2 - y0, b1 = x0 - x2, c1 = x2 * y0 - x0 * y2;
+    float a2 = y0 - y1, b2 = x1 - x0, c2 = x0 * y1 - x1 * y0;
+
+    // the edge functions over the area are the barycentric coordinates
+    float inv_area = 1.0f / area;
+    float za = (a0 * z0 + a1 * z1 + a2 * z2) * inv_area;
+    float zb = (b0 * z0 + b1 * z1 + b2 * z2) * inv_area;
+    float zc = (c0 * z0 + c1 * z1 + c2 * z2) * inv_area;
+
+    // rows are walked in whole vectors, the tile width is a multiple of the lanes
+    int start = rect[0] - (rect[0] - tile[0]) % OCCLUSION_LANES;
+
+    for (int y = rect[1]; y <= rect[3]; ++y)
+    {
+        float* row = &buffer->depth[y * buffer->width];
+        float py = (float)y + 0.5f;
+
+#if defined(OCCLUSION_AVX2) || defined(OCCLUSION_SSE)
+        occlusion_simd lanes = occlusion_lanes();
+        occlusion_simd zero = occlusion_zero();
+
+        occlusion_simd e0_row = occlusion_set1(b0 * py + c0), e0_step = occlusion_set1(a0);
+        occlusion_simd e1_row = occlusion_set1(b1 * py + c1), e1_step = occlusion_set1(a1);
+        occlusion_simd e2_row = occlusion_set1(b2 * py + c2), e2_step = occlusion_set1(a2);
+        occlusion_simd z_row = occlusion_set1(zb * py + zc), z_step = occlusion_set1(za);
+
+        for (int x = start; x <= rect[2]; x += OCCLUSION_LANES)
+        {
+            occlusion_simd px = occlusion_add(occlusion_set1((float)x + 0.5f), lanes);
+
+            occlusion_simd e0 = occlusion_add(e0_row, occlusion_mul(e0_step, px));
+            occlusion_simd e1 = occlusion_add(e1_row, occlusion_mul(e1_step, px));
+            occlusion_simd e2 = occlusion_add(e2_row, occlusion_mul(e2_step, px));
+
+            occlusion_simd inside = occlusion_and(occlusion_cmpge(e0, zero), occlusion_and(occlusion_cmpge(e1, zero), occlusion_cmpge(e2, zero)));
+            if (!occlusion_movemask(inside)) continue;
+
+            occlusion_simd z = occlusion_add(z_row, occlusion_mul(z_step, px));
+            occlusion_simd depth = occlusion_load(&row[x]);
+
+            depth = occlusion_or(occlusion_and(inside, occlusion_min(depth, z)), occlusion_andnot(inside, depth));
+            occlusion_store(&row[x], depth);
+        }
+#else
+        for (int x = start; x <= rect[2]; ++x)
+        {
+            float px = (float)x + 0.5f;
+            if (a0 * px + b0 * py + c0 < 0.0f) continue;
+            if (a1 * px + b1 * py + c1 < 0.0f) continue;
+            if (a2 * px + b2 * py + c2 < 0.0f) continue;
+
+            row[x] = fminf(row[x], za * px + zb * py + zc);
+        }
+#endif
+    }
+}
+
+static void rasterizeOcclusionTiles(void* data, size_t begin, size_t end, uint32_t thread)
+{
+    OcclusionBuffer* buffer = data;
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        int tx = (int)(i % buffer->tiles_x), ty = (int)(i / buffer->tiles_x);
+        int tile[4] = {
+            tx * OCCLUSION_TILE_WIDTH,
+            ty * OCCLUSION_TILE_HEIGHT,
+            (tx + 1) * OCCLUSION_TILE_WIDTH - 1,
+            (ty + 1) * OCCLUSION_TILE_HEIGHT - 1
+        };
+
+        for (int y = tile[1]; y <= tile[3]; ++y)
+        {
+            float* row = &buffer->depth[y * buffer->width];
+            for (int x = tile[0]; x <= tile[2]; ++x)
+                row[x] = 1.0f;
+        }
+
+        for (uint32_t k = buffer->bin_offsets[i]; k < buffer->bin_offsets[i + 1]; ++k)
+            rasterizeOcclusionTriangle(buffer, &buffer->triangles[buffer->bins[k]], tile);
+    }
+}
+
+static void buildOcclusionPyramid(OcclusionBuffer* buffer)
+{
+    uint32_t w = buffer->width, h = buffer->height;
+    for (uint32_t level = 1; level < buffer->level_count; ++level)
+    {
+        const float* src = &buffer->depth[buffer->level_offsets[level - 1]];
+        float* dst = &buffer->depth[buffer->level_offsets[level]];
+
+        uint32_t dw = (w + 1) / 2, dh = (h + 1) / 2;
+        for (uint32_t y = 0; y < dh; ++y)
+        {
+            // odd sizes repeat the last row or column
+            const float* row0 = &src[(2 * y) * w];
+            const float* row1 = &src[(2 * y + 1 < h ? 2 * y + 1 : 2 * y) * w];
+
+            for (uint32_t x = 0; x < dw; ++x)
+            {
+                uint32_t x0 = 2 * x, x1 = 2 * x + 1 < w ? 2 * x + 1 : 2 * x;
+                dst[y * dw + x] = fmaxf(fmaxf(row0[x0], row0[x1]), fmaxf(row1[x0], row1[x1]));
+            }
+        }
+
+        w = dw;
+        h = dh;
+    }
+}
+
+void rasterizeOcclusionBuffer(OcclusionBuffer* buffer, JobPool* jobs)
+{
+    if (!binOcclusionTriangles(buffer))
+        buffer->triangle_count = 0;
+
+    // tiles do not share pixels, so every job writes its own part of the buffer
+    jobPoolParallelFor(jobs, buffer->tiles_x * buffer->tiles_y, 1, rasterizeOcclusionTiles, buffer);
+    buildOcclusionPyramid(buffer);
+}
+
+int testOcclusion(const OcclusionBuffer* buffer, aabb box)
+{
+    if (!buffer->triangle_count || aabb_is_empty(box)) return 1;
+
+    const mat4 m = buffer->view_proj;
+
+    float min_x = INFINITY, min_y = INFINITY, min_z = INFINITY;
+    float max_x = -INFINITY, max_y = -INFINITY;
+    for (int c = 0; c < 8; ++c)
+    {
+        vec3 p = {
+            (c & 1) ? box.max.x : box.min.x,
+            (c & 2) ? box.max.y : box.min.y,
+            (c & 4) ? box.max.z : box.min.z
+        };
+
+        float x = m.v[0][0] * p.x + m.v[1][0] * p.y + m.v[2][0] * p.z + m.v[3][0];
+        float y = m.v[0][1] * p.x + m.v[1][1] * p.y + m.v[2][1] * p.z + m.v[3][1];
+        float z = m.v[0][2] * p.x + m.v[1][2] * p.y + m.v[2][2] * p.z + m.v[3][2];
+        float w = m.v[0][3] * p.x + m.v[1][3] * p.y + m.v[2][3] * p.z + m.v[3][3];
+
+        // boxes reaching past the near plane are never hidden
+        if (w <= 0.0f || z < -w) return 1;
+
+        float inv_w = 1.0f / w;
+        x = (x * inv_w * 0.5f + 0.5f) * buffer->width;
+        y = (y * inv_w * 0.5f + 0.5f) * buffer->height;
+        z = z * inv_w * 0.5f + 0.5f;
+
+        min_x = fminf(min_x, x); max_x = fmaxf(max_x, x);
+        min_y = fminf(min_y, y); max_y = fmaxf(max_y, y);
+        min_z = fminf(min_z, z);
+    }
+
+    // every pixel the box touches
+    if (max_x < 0.0f || max_y < 0.0f || min_x >= buffer->width || min_y >= buffer->height) return 1;
+
+    int x0 = max((int)floorf(min_x), 0);
+    int y0 = max((int)floorf(min_y), 0);
+    int x1 = (int)floorf(max_x), y1 = (int)floorf(max_y);
+    if (x1 > (int)buffer->width - 1)  x1 = (int)buffer->width - 1;
+    if (y1 > (int)buffer->height - 1) y1 = (int)buffer->height - 1;
+
+    // coarsest level with at most two texels in each direction
+    uint32_t level = 0;
+    while (level + 1 < buffer->level_count && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        level++;
+
+    uint32_t w, h;
+    getOcclusionLevelSize(buffer, level, &w, &h);
+
+    const float* depth = &buffer->depth[buffer->level_offsets[level]];
+    for (int y = y0 >> level; y <= y1 >> level; ++y)
+    {
+        for (int x = x0 >> level; x <= x1 >> level; ++x)
+        {
+            if (min_z <= depth[y * w + x] + OCCLUSION_DEPTH_BIAS) return 1;
+        }
+    }
+    return 0;
+}
+
+size_t testOcclusionBoxes(const OcclusionBuffer* buffer, const aabb* boxes, size_t count, uint8_t* visible)
+{
+    if (!buffer->triangle_count) return 0;
+
+    size_t hidden = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!visible[i] || testOcclusion(buffer, boxes[i])) continue;
+
+        visible[i] = 0;
+        hidden++;
+    }
+    return hidden;
+}
@@ -0,0 +1,200 @@
+#include "model.h"
+
+#include <string.h>
+
+int createJointPaletteBuffer(JointPaletteBuffer* palette, size_t capacity)
+{
+    palette->capacity = capacity ? capacity : 256;
+    palette->count = 0;
+    palette->uploaded = 0;
+    palette->stream = NULL;
+
+    palette->staging = malloc(palette->capacity * JOINT_PALETTE_ROW_SIZE);
+    if (!palette->staging) return IGNIS_FAILURE;
+
+    glGenBuffers(1, &palette->buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, palette->buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, palette->capacity * JOINT_PALETTE_ROW_SIZE, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    palette->range_buffer = palette->buffer;
+    palette->range_offset = 0;
+    palette->range_size = 0;
+
+    return IGNIS_SUCCESS;
+}
+
+void destroyJointPaletteBuffer(JointPaletteBuffer* palette)
+{
+    glDeleteBuffers(1, &palette->buffer);
+    if (palette->staging) free(palette->staging);
+
+    palette->staging = NULL;
+    palette->capacity = 0;
+    palette->count = 0;
+}
+
+void resetJointPaletteBuffer(JointPaletteBuffer* palette)
+{
+    palette->count = 0;
+    palette->uploaded = 0;
+
+    // last frame's stream range is reused by later frames
+    palette->range_buffer = palette->buffer;
+    palette->range_offset = 0;
+    palette->range_size = 0;
+}
+
+static int growJointPaletteBuffer(JointPaletteBuffer* palette, size_t capacity)
+{
+    float* staging = realloc(palette->staging, capacity * JOINT_PALETTE_ROW_SIZE);
+    if (!staging) return IGNIS_FAILURE;
+    palette->staging = staging;
+
+    // keep what was already uploaded this frame
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity * JOINT_PALETTE_ROW_SIZE, NULL, GL_DYNAMIC_DRAW);
+
+    if (palette->uploaded && palette->range_buffer == palette->buffer)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, palette->buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, palette->uploaded * JOINT_PALETTE_ROW_SIZE);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (palette->range_buffer == palette->buffer) palette->range_buffer = buffer;
+
+    glDeleteBuffers(1, &palette->buffer);
+    palette->buffer = buffer;
+    palette->capacity = capacity;
+
+    return IGNIS_SUCCESS;
+}
+
+static float* reserveJointPalette(JointPaletteBuffer* palette, size_t rows, size_t* offset)
+{
+    if (palette->count + rows > palette->capacity)
+    {
+        size_t capacity = palette->capacity;
+        while (capacity < palette->count + rows) capacity *= 2;
+
+        if (!growJointPaletteBuffer(palette, capacity)) return NULL;
+    }
+
+    *offset = palette->count;
+    palette->count += rows;
+    return &palette->staging[*offset * 4];
+}
+
+size_t writeJointPalette(JointPaletteBuffer* palette, const mat4x3* joints, size_t count)
+{
+    size_t offset = 0;
+    float* dst = reserveJointPalette(palette, count * JOINT_PALETTE_LINEAR_ROWS, &offset);
+    if (!dst) return JOINT_PALETTE_INVALID;
+
+    // store transposed: three rows of vec4 per joint
+    for (size_t i = 0; i < count; ++i)
+    {
+        const mat4x3* m = &joints[i];
+        for (int r = 0; r < 3; ++r)
+        {
+            *dst++ = m->v[0][r];
+            *dst++ = m->v[1][r];
+            *dst++ = m->v[2][r];
+            *dst++ = m->v[3][r];
+        }
+    }
+
+    return offset;
+}
+
+size_t writeJointPaletteRows(JointPaletteBuffer* palette, const float* rows, size_t count)
+{
+    size_t offset = 0;
+    float* dst = reserveJointPalette(palette, count, &offset);
+    if (!dst) return JOINT_PALETTE_INVALID;
+
+    memcpy(dst, rows, count * JOINT_PALETTE_ROW_SIZE);
+    return offset;
+}
+
+int getJointPaletteDQ(const mat4x3* joints, size_t count, float* dq, float* scale)
+{
+    if (!count) return IGNIS_FAILURE;
+
+    // dual quaternions can only express rigid transforms, a scale shared by all joints is passed separately
+    *scale = vec3_length((vec3){ joints[0].v[0][0], joints[0].v[0][1], joints[0].v[0][2] });
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!mat4x3_has_uniform_scale(joints[i], *scale, JOINT_PALETTE_SCALE_EPSILON))
+            return IGNIS_FAILURE;
+    }
+
+    float inv_scale = 1.0f / *scale;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const mat4x3* m = &joints[i];
+        quat q = mat4x3_rotation(*m, inv_scale);
+        vec3 t = { m->v[3][0], m->v[3][1], m->v[3][2] };
+
+        // real part
+        *dq++ = q.x;
+        *dq++ = q.y;
+        *dq++ = q.z;
+        *dq++ = q.w;
+
+        // dual part: 0.5 * t * q
+        *dq++ = 0.5f * ( t.x * q.w + t.y * q.z - t.z * q.y);
+        *dq++ = 0.5f * (-t.x * q.z + t.y * q.w + t.z * q.x);
+        *dq++ = 0.5f * ( t.x * q.y - t.y * q.x + t.z * q.w);
+        *dq++ = -0.5f * (t.x * q.x + t.y * q.y + t.z * q.z);
+    }
+
+    return IGNIS_SUCCESS;
+}
+
+void uploadJointPaletteBuffer(JointPaletteBuffer* palette)
+{
+    if (palette->count <= palette->uploaded) return;
+
+    // the stream range has to hold every row, the shaders index from its start
+    size_t stream_offset = 0;
+    size_t size = palette->count * JOINT_PALETTE_ROW_SIZE;
+    void* dst = palette->stream ? streamBufferAlloc(palette->stream, size, palette->stream->storage_alignment, &stream_offset) : NULL;
+    if (dst)
+    {
+        memcpy(dst, palette->staging, size);
+
+        palette->range_buffer = palette->stream->name;
+        palette->range_offset = stream_offset;
+        palette->range_size = size;
+        palette->uploaded = palette->count;
+        return;
+    }
+
+    // rows that went into the stream earlier this frame are not in the buffer
+    if (palette->range_buffer != palette->buffer) palette->uploaded = 0;
+
+    size_t offset = palette->uploaded * JOINT_PALETTE_ROW_SIZE;
+    size = (palette->count - palette->uploaded) * JOINT_PALETTE_ROW_SIZE;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, palette->buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, (const char*)palette->staging + offset);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    palette->range_buffer = palette->buffer;
+    palette->range_offset = 0;
+    palette->range_size = palette->count * JOINT_PALETTE_ROW_SIZE;
+    palette->uploaded = palette->count;
+}
+
+void bindJointPaletteBuffer(const JointPaletteBuffer* palette, GLuint binding)
+{
+    if (palette->range_size)
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, palette->range_buffer, palette->range_offset, palette->range_size);
+    else
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, palette->buffer);
+}
@@ -0,0 +1,482 @@
+#include "model.h"
+
+#include <string.h>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define SKINNING_AVX2
+
+    // fma only where the compiler says it is there, msvc never defines __FMA__
+    #ifdef __FMA__
+        #define SKINNING_MADD(a, b, c) _mm256_fmadd_ps(a, b, c)
+    #else
+        #define SKINNING_MADD(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+    #endif
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SKINNING_SSE
+#endif
+
+#define SKINNING_CHUNK_SIZE     2048    // vertices per job
+#define SKINNING_WORKGROUP_SIZE 64      // local_size_x of the compute shader
+
+// storage buffer bindings of the compute shader
+#define SKINNING_BINDING_POSITIONS  1
+#define SKINNING_BINDING_TEXCOORDS  2
+#define SKINNING_BINDING_NORMALS    3
+#define SKINNING_BINDING_JOINTS     4
+#define SKINNING_BINDING_WEIGHTS    5
+#define SKINNING_BINDING_INSTANCES  6
+#define SKINNING_BINDING_VERTICES   7
+
+#define SKINNING_INVALID_ROW 0xFFFFFFFFu
+
+// ----------------------------------------------------------------
+// vertex skinning
+// ----------------------------------------------------------------
+void getSkinningPalette(const mat4x3* joints, size_t count, float* palette)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            *palette++ = joints[i].v[c][0];
+            *palette++ = joints[i].v[c][1];
+            *palette++ = joints[i].v[c][2];
+            *palette++ = 0.0f;
+        }
+    }
+}
+
+static void copyVertexAttributes(const Mesh* mesh, size_t v, float* dst)
+{
+    dst[6] = mesh->texcoords ? mesh->texcoords[v * 2 + 0] : 0.0f;
+    dst[7] = mesh->texcoords ? mesh->texcoords[v * 2 + 1] : 0.0f;
+}
+
+static void copyVertices(const Mesh* mesh, float* out, size_t begin, size_t end)
+{
+    for (size_t v = begin; v < end; ++v)
+    {
+        float* dst = &out[v * SKINNING_VERTEX_FLOATS];
+        for (int c = 0; c < 3; ++c)
+        {
+            dst[c] = mesh->positions[v * 3 + c];
+            dst[c + 3] = mesh->normals ? mesh->normals[v * 3 + c] : 0.0f;
+        }
+        copyVertexAttributes(mesh, v, dst);
+    }
+}
+
+#if defined(SKINNING_AVX2) || defined(SKINNING_SSE)
+
+static void skinVerticesSIMD(const Mesh* mesh, const float* palette, float* out, size_t begin, size_t end)
+{
+    static const float zero[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (size_t v = begin; v < end; ++v)
+    {
+        const uint32_t* joints = &mesh->joints[v * 4];
+        const float* weights = &mesh->weights[v * 4];
+
+#ifdef SKINNING_AVX2
+        // two columns per register
+        __m256 c01 = _mm256_setzero_ps();
+        __m256 c23 = _mm256_setzero_ps();
+        for (int i = 0; i < 4; ++i)
+        {
+            if (weights[i] == 0.0f) continue;
+
+            const float* m = &palette[joints[i] * 16];
+            __m256 w = _mm256_set1_ps(weights[i]);
+            c01 = SKINNING_MADD(w, _mm256_loadu_ps(m), c01);
+            c23 = SKINNING_MADD(w, _mm256_loadu_ps(m + 8), c23);
+        }
+        __m128 c0 = _mm256_castps256_ps128(c01);
+        __m128 c1 = _mm256_extractf128_ps(c01, 1);
+        __m128 c2 = _mm256_castps256_ps128(c23);
+        __m128 c3 = _mm256_extractf128_ps(c23, 1);
+#else
+        __m128 c0 = _mm_setzero_ps();
+        __m128 c1 = _mm_setzero_ps();
+        __m128 c2 = _mm_setzero_ps();
+        __m128 c3 = _mm_setzero_ps();
+        for (int i = 0; i < 4; ++i)
+        {
+            if (weights[i] == 0.0f) continue;
+
+            const float* m = &palette[joints[i] * 16];
+            __m128 w = _mm_set1_ps(weights[i]);
+            c0 = _mm_add_ps(c0, _mm_mul_ps(w, _mm_loadu_ps(m + 0)));
+            c1 = _mm_add_ps(c1, _mm_mul_ps(w, _mm_loadu_ps(m + 4)));
+            c2 = _mm_add_ps(c2, _mm_mul_ps(w, _mm_loadu_ps(m + 8)));
+            c3 = _mm_add_ps(c3, _mm_mul_ps(w, _mm_loadu_ps(m + 12)));
+        }
+#endif
+
+        const float* p = &mesh->positions[v * 3];
+        const float* n = mesh->normals ? &mesh->normals[v * 3] : zero;
+
+        __m128 pos = _mm_add_ps(c3, _mm_mul_ps(c0, _mm_set1_ps(p[0])));
+        pos = _mm_add_ps(pos, _mm_mul_ps(c1, _mm_set1_ps(p[1])));
+        pos = _mm_add_ps(pos, _mm_mul_ps(c2, _mm_set1_ps(p[2])));
+
+        __m128 normal = _mm_mul_ps(c0, _mm_set1_ps(n[0]));
+        normal = _mm_add_ps(normal, _mm_mul_ps(c1, _mm_set1_ps(n[1])));
+        normal = _mm_add_ps(normal, _mm_mul_ps(c2, _mm_set1_ps(n[2])));
+
+        // the fourth lane of each store is overwritten by the next one
+        float* dst = &out[v * SKINNING_VERTEX_FLOATS];
+        _mm_storeu_ps(dst, pos);
+        _mm_storeu_ps(dst + 3, normal);
+        copyVertexAttributes(mesh, v, dst);
+    }
+}
+
+#else
+
+static void skinVerticesScalar(const Mesh* mesh, const float* palette, float* out, size_t begin, size_t end)
+{
+    for (size_t v = begin; v < end; ++v)
+    {
+        const uint32_t* joints = &mesh->joints[v * 4];
+        const float* weights = &mesh->weights[v * 4];
+
+        float m[16] = { 0 };
+        for (int i = 0; i < 4; ++i)
+        {
+            if (weights[i] == 0.0f) continue;
+
+            const float* joint = &palette[joints[i] * 16];
+            for (int k = 0; k < 16; ++k)
+                m[k] += weights[i] * joint[k];
+        }
+
+        const float* p = &mesh->positions[v * 3];
+        float* dst = &out[v * SKINNING_VERTEX_FLOATS];
+        for (int c = 0; c < 3; ++c)
+        {
+            dst[c] = m[c] * p[0] + m[4 + c] * p[1] + m[8 + c] * p[2] + m[12 + c];
+            dst[c + 3] = 0.0f;
+        }
+
+        if (mesh->normals)
+        {
+            const float* n = &mesh->normals[v * 3];
+            for (int c = 0; c < 3; ++c)
+                dst[c + 3] = m[c] * n[0] + m[4 + c] * n[1] + m[8 + c] * n[2];
+        }
+        copyVertexAttributes(mesh, v, dst);
+    }
+}
+
+#endif
+
+void skinMeshVertices(const Mesh* mesh, const float* palette, float* out, size_t begin, size_t end)
+{
+    if (!mesh->joints || !mesh->weights)
+    {
+        copyVertices(mesh, out, begin, end);
+        return;
+    }
+
+#if defined(SKINNING_AVX2) || defined(SKINNING_SSE)
+    skinVerticesSIMD(mesh, palette, out, begin, end);
+#else
+    skinVerticesScalar(mesh, palette, out, begin, end);
+#endif
+}
+
+// ----------------------------------------------------------------
+// skinning buffer
+// ----------------------------------------------------------------
+/* Points the attributes at the skinned vertices, the same locations as model.vert */
+static void setSkinningVertexSource(SkinningBuffer* skinning, GLuint buffer, uint32_t generation, size_t offset)
+{
+    // a regrown stream can get the name of the buffer it replaced
+    if (skinning->vertex_source == buffer && skinning->vertex_source_generation == generation
+        && skinning->vertex_source_offset == offset) return;
+
+    GLsizei stride = SKINNING_VERTEX_FLOATS * sizeof(float);
+    glBindVertexArray(skinning->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (const void*)(offset + 0 * sizeof(float)));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (const void*)(offset + 6 * sizeof(float)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (const void*)(offset + 3 * sizeof(float)));
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    skinning->vertex_source = buffer;
+    skinning->vertex_source_generation = generation;
+    skinning->vertex_source_offset = offset;
+}
+
+int createSkinningBuffer(SkinningBuffer* skinning, const Model* model, ShaderCache* cache)
+{
+    memset(skinning, 0, sizeof(SkinningBuffer));
+    skinning->model = model;
+
+    skinning->vertex_offsets = calloc(model->mesh_count, sizeof(size_t));
+    if (!skinning->vertex_offsets) return IGNIS_FAILURE;
+
+    for (size_t i = 0; i < model->mesh_count; ++i)
+    {
+        skinning->vertex_offsets[i] = skinning->vertex_count;
+        skinning->vertex_count += model->meshes[i].vertex_count;
+    }
+
+    glGenBuffers(1, &skinning->vbo);
+    glGenVertexArrays(1, &skinning->vao);
+
+    glBindVertexArray(skinning->vao);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+
+    // the meshes keep their order, so the indices of the model geometry apply as they are
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->vao.buffers[5].name);
+    glBindVertexArray(0);
+
+    setSkinningVertexSource(skinning, skinning->vbo, 0, 0);
+
+    // links with the other variants, 0 if it fails or there is no cache
+    if (cache && loadComputeVariant(cache, &skinning->compute, SKINNING_COMPUTE_SHADER, NULL, NULL))
+        glGenBuffers(1, &skinning->instance_buffer);
+
+    return IGNIS_SUCCESS;
+}
+
+void destroySkinningBuffer(SkinningBuffer* skinning)
+{
+    if (skinning->vao)
+    {
+        glDeleteVertexArrays(1, &skinning->vao);
+        glDeleteBuffers(1, &skinning->vbo);
+    }
+
+    if (skinning->compute) glDeleteProgram(skinning->compute);
+    if (skinning->instance_buffer) glDeleteBuffers(1, &skinning->instance_buffer);
+
+    free(skinning->vertex_offsets);
+    free(skinning->vertices);
+    free(skinning->palettes);
+    free(skinning->tasks);
+    free(skinning->instance_rows);
+
+    memset(skinning, 0, sizeof(SkinningBuffer));
+}
+
+static int reserveSkinningBuffer(SkinningBuffer* skinning, size_t instance_count, size_t task_count)
+{
+    if (instance_count > skinning->capacity)
+    {
+        const Model* model = skinning->model;
+
+        float* vertices = realloc(skinning->vertices, instance_count * skinning->vertex_count * SKINNING_VERTEX_FLOATS * sizeof(float));
+        if (!vertices) return IGNIS_FAILURE;
+        skinning->vertices = vertices;
+
+        float* palettes = realloc(skinning->palettes, instance_count * model->joint_count * 16 * sizeof(float));
+        if (!palettes) return IGNIS_FAILURE;
+        skinning->palettes = palettes;
+
+        skinning->capacity = instance_count;
+    }
+
+    if (task_count > skinning->task_capacity)
+    {
+        SkinningTask* tasks = realloc(skinning->tasks, task_count * sizeof(SkinningTask));
+        if (!tasks) return IGNIS_FAILURE;
+
+        skinning->tasks = tasks;
+        skinning->task_capacity = task_count;
+    }
+
+    return IGNIS_SUCCESS;
+}
+
+static void runSkinningTasks(void* data, size_t begin, size_t end, uint32_t thread)
+{
+    SkinningBuffer* skinning = data;
+    for (size_t i = begin; i < end; ++i)
+    {
+        SkinningTask* task = &skinning->tasks[i];
+        skinMeshVertices(task->mesh, task->palette, task->out, task->begin, task->end);
+    }
+}
+
+int skinAnimationWorld(SkinningBuffer* skinning, const AnimationWorld* world, JobPool* jobs)
+{
+    double start = jobTimerNow();
+
+    const Model* model = skinning->model;
+
+    size_t chunks_per_instance = 0;
+    for (size_t m = 0; m < model->mesh_count; ++m)
+        chunks_per_instance += (model->meshes[m].vertex_count + SKINNING_CHUNK_SIZE - 1) / SKINNING_CHUNK_SIZE;
+
+    if (!reserveSkinningBuffer(skinning, world->instance_count, world->instance_count * chunks_per_instance))
+        return IGNIS_FAILURE;
+
+    // one task per chunk of vertices, slots match the world instances
+    size_t task_count = 0;
+    for (size_t i = 0; i < world->instance_count; ++i)
+    {
+        const AnimationInstance* instance = &world->instances[i];
+        if (instance->model != model) continue;
+
+        float* palette = &skinning->palettes[i * model->joint_count * 16];
+        getSkinningPalette(&world->palettes[instance->palette_offset], model->joint_count, palette);
+
+        for (size_t m = 0; m < model->mesh_count; ++m)
+        {
+            const Mesh* mesh = &model->meshes[m];
+            float* out = &skinning->vertices[(i * skinning->vertex_count + skinning->vertex_offsets[m]) * SKINNING_VERTEX_FLOATS];
+
+            for (size_t v = 0; v < mesh->vertex_count; v += SKINNING_CHUNK_SIZE)
+            {
+                SkinningTask* task = &skinning->tasks[task_count++];
+                task->mesh = mesh;
+                task->palette = palette;
+                task->out = out;
+                task->begin = v;
+                task->end = v + SKINNING_CHUNK_SIZE < mesh->vertex_count ? v + SKINNING_CHUNK_SIZE : mesh->vertex_count;
+            }
+        }
+    }
+
+    size_t batch = max(task_count / (jobPoolThreadCount(jobs) * 4), 1);
+    jobPoolParallelFor(jobs, task_count, batch, runSkinningTasks, skinning);
+
+    skinning->skinning_time = jobTimerNow() - start;
+
+    // copied from the staging, the overlapping simd stores would be slow on the write combined mapping
+    size_t size = world->instance_count * skinning->vertex_count * SKINNING_VERTEX_FLOATS * sizeof(float);
+    size_t offset = 0;
+    void* dst = skinning->stream ? streamBufferAlloc(skinning->stream, size, 4 * sizeof(float), &offset) : NULL;
+    if (dst)
+    {
+        memcpy(dst, skinning->vertices, size);
+        setSkinningVertexSource(skinning, skinning->stream->name, skinning->stream->generation, offset);
+    }
+    else
+    {
+        // orphan and refill the vbo
+        glBindBuffer(GL_ARRAY_BUFFER, skinning->vbo);
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, skinning->vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        setSkinningVertexSource(skinning, skinning->vbo, 0, 0);
+    }
+
+    skinning->instance_count = world->instance_count;
+    return IGNIS_SUCCESS;
+}
+
+
+int skinAnimationWorldCompute(SkinningBuffer* skinning, const AnimationWorld* world, size_t palette_base)
+{
+    if (!skinning->compute) return IGNIS_FAILURE;
+
+    const Model* model = skinning->model;
+
+    // the rows are written straight into the stream if it has room left
+    size_t row_size = world->instance_count * sizeof(uint32_t);
+    size_t row_offset = 0;
+    uint32_t* rows = skinning->stream && row_size ? streamBufferAlloc(skinning->stream, row_size, skinning->stream->storage_alignment, &row_offset) : NULL;
+    if (!rows)
+    {
+        if (world->instance_count > skinning->instance_row_capacity)
+        {
+            uint32_t* staging = realloc(skinning->instance_rows, row_size);
+            if (!staging) return IGNIS_FAILURE;
+
+            skinning->instance_rows = staging;
+            skinning->instance_row_capacity = world->instance_count;
+        }
+        rows = skinning->instance_rows;
+    }
+
+    for (size_t i = 0; i < world->instance_count; ++i)
+    {
+        const AnimationInstance* instance = &world->instances[i];
+        rows[i] = instance->model == model
+            ? (uint32_t)(palette_base + instance->palette_offset * JOINT_PALETTE_LINEAR_ROWS)
+            : SKINNING_INVALID_ROW;
+    }
+
+    if (rows != skinning->instance_rows)
+    {
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SKINNING_BINDING_INSTANCES, skinning->stream->name, row_offset, row_size);
+    }
+    else
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, skinning->instance_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, row_size, rows, GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_BINDING_INSTANCES, skinning->instance_buffer);
+    }
+
+    // the output is written by the gpu and stays out of the stream, which only pays off for cpu writes
+    // and would have to hold it for every frame in flight. Orphaning lets the previous frame keep drawing.
+    size_t size = world->instance_count * skinning->vertex_count * SKINNING_VERTEX_FLOATS * sizeof(float);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, skinning->vbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_BINDING_VERTICES, skinning->vbo);
+    setSkinningVertexSource(skinning, skinning->vbo, 0, 0);
+
+    glUseProgram(skinning->compute);
+
+    // resolved once the program is linked, the dispatch loop only sets values
+    SkinningComputeUniforms* uniforms = &skinning->compute_uniforms;
+    if (!uniforms->resolved)
+    {
+        uniforms->vertex_count = glGetUniformLocation(skinning->compute, "vertexCount");
+        uniforms->source_offset = glGetUniformLocation(skinning->compute, "sourceOffset");
+        uniforms->mesh_offset = glGetUniformLocation(skinning->compute, "meshOffset");
+        uniforms->instance_stride = glGetUniformLocation(skinning->compute, "instanceStride");
+        uniforms->has_texcoords = glGetUniformLocation(skinning->compute, "hasTexCoords");
+        uniforms->has_normals = glGetUniformLocation(skinning->compute, "hasNormals");
+        uniforms->has_joints = glGetUniformLocation(skinning->compute, "hasJoints");
+        uniforms->resolved = 1;
+    }
+
+    glUniform1ui(uniforms->instance_stride, (GLuint)skinning->vertex_count);
+
+    // the sources are the attributes of the model geometry, meshes start at their base vertex
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_BINDING_POSITIONS, model->vao.buffers[0].name);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_BINDING_TEXCOORDS, model->vao.buffers[1].name);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_BINDING_NORMALS, model->vao.buffers[2].name);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_BINDING_JOINTS, model->vao.buffers[3].name);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_BINDING_WEIGHTS, model->vao.buffers[4].name);
+
+    for (size_t m = 0; m < model->mesh_count; ++m)
+    {
+        const Mesh* mesh = &model->meshes[m];
+        if (!mesh->vertex_count) continue;
+
+        glUniform1ui(uniforms->vertex_count, (GLuint)mesh->vertex_count);
+        glUniform1ui(uniforms->source_offset, mesh->base_vertex);
+        glUniform1ui(uniforms->mesh_offset, (GLuint)skinning->vertex_offsets[m]);
+        glUniform1i(uniforms->has_texcoords, mesh->texcoords != NULL);
+        glUniform1i(uniforms->has_normals, mesh->normals != NULL);
+        glUniform1i(uniforms->has_joints, mesh->joints && mesh->weights);
+
+        GLuint groups = (GLuint)((mesh->vertex_count + SKINNING_WORKGROUP_SIZE - 1) / SKINNING_WORKGROUP_SIZE);
+        glDispatchCompute(groups, (GLuint)world->instance_count, 1);
+    }
+
+    glUseProgram(0);
+
+    // every later pass sources the results as vertex attributes
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    skinning->instance_count = world->instance_count;
+    return IGNIS_SUCCESS;
+}
@@ -0,0 +1,130 @@
+#include "model.h"
+
+#include <string.h>
+
+#define UNIFORM_RING_SLOTS  256
+
+/* Fallback for a full stream, every write still gets its own range until the ring wraps */
+typedef struct
+{
+    GLuint name;
+    size_t stride;      // block size rounded up to the offset alignment
+    size_t next;        // slot of the next write
+} UniformRing;
+
+static UniformRing scene_ring = { 0 };
+static UniformRing draw_ring = { 0 };
+static StreamBuffer* uniform_stream = NULL;
+
+static void createUniformRing(UniformRing* ring, size_t size, GLint alignment)
+{
+    ring->stride = (size + alignment - 1) / alignment * alignment;
+    ring->next = 0;
+
+    glGenBuffers(1, &ring->name);
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->name);
+    glBufferData(GL_UNIFORM_BUFFER, ring->stride * UNIFORM_RING_SLOTS, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+static void destroyUniformRing(UniformRing* ring)
+{
+    glDeleteBuffers(1, &ring->name);
+    memset(ring, 0, sizeof(UniformRing));
+}
+
+int createShaderUniforms()
+{
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment < 1) alignment = 1;
+
+    createUniformRing(&scene_ring, sizeof(SceneUniforms), alignment);
+    createUniformRing(&draw_ring, sizeof(DrawUniforms), alignment);
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, SCENE_UNIFORM_BINDING, scene_ring.name, 0, sizeof(SceneUniforms));
+    glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_UNIFORM_BINDING, draw_ring.name, 0, sizeof(DrawUniforms));
+
+    return IGNIS_SUCCESS;
+}
+
+void destroyShaderUniforms()
+{
+    destroyUniformRing(&scene_ring);
+    destroyUniformRing(&draw_ring);
+    uniform_stream = NULL;
+}
+
+void setShaderUniformStream(StreamBuffer* stream)
+{
+    uniform_stream = stream;
+}
+
+/* Every write gets its own range in the stream, or in the ring once the stream is full */
+static void writeUniformBlock(GLuint binding, UniformRing* ring, const void* data, size_t size)
+{
+    size_t offset = 0;
+    void* dst = uniform_stream ? streamBufferAlloc(uniform_stream, size, uniform_stream->uniform_alignment, &offset) : NULL;
+    if (dst)
+    {
+        memcpy(dst, data, size);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, uniform_stream->name, offset, size);
+        return;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->name);
+    if (ring->next == UNIFORM_RING_SLOTS)
+    {
+        // orphaned, draws still reading the old storage keep it
+        glBufferData(GL_UNIFORM_BUFFER, ring->stride * UNIFORM_RING_SLOTS, NULL, GL_DYNAMIC_DRAW);
+        ring->next = 0;
+    }
+
+    offset = ring->next++ * ring->stride;
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring->name, offset, size);
+}
+
+static void bindUniformBlock(IgnisShader shader, const char* name, GLuint binding)
+{
+    GLuint index = glGetUniformBlockIndex(shader, name);
+    if (index != GL_INVALID_INDEX) glUniformBlockBinding(shader, index, binding);
+}
+
+static void bindSampler(IgnisShader shader, const char* name, GLint unit)
+{
+    GLint location = ignisGetUniformLocation(shader, name);
+    if (location >= 0) ignisSetUniformil(shader, location, unit);
+}
+
+static void setupModelShader(GLuint shader)
+{
+    bindUniformBlock(shader, "Scene", SCENE_UNIFORM_BINDING);
+    bindUniformBlock(shader, "Draw", DRAW_UNIFORM_BINDING);
+
+    // samplers keep their unit for the lifetime of the program
+    bindSampler(shader, "baseTexture", BASE_TEXTURE_UNIT);
+    bindSampler(shader, "bakedJoints", BAKED_ANIMATION_TEXTURE_UNIT);
+}
+
+int loadModelShader(ShaderCache* cache, IgnisShader* shader, const char* vert, const char* frag, const char* defines)
+{
+    return loadShaderVariant(cache, shader, vert, frag, defines, setupModelShader);
+}
+
+void setSceneUniforms(mat4 proj, mat4 view, float time)
+{
+    SceneUniforms scene = { 0 };
+    scene.proj = proj;
+    scene.view = view;
+    scene.time = time;
+
+    writeUniformBlock(SCENE_UNIFORM_BINDING, &scene_ring, &scene, sizeof(SceneUniforms));
+}
+
+void setDrawUniforms(const DrawUniforms* draw)
+{
+    writeUniformBlock(DRAW_UNIFORM_BINDING, &draw_ring, draw, sizeof(DrawUniforms));
+}
@@ -0,0 +1,399 @@
+#include "model.h"
+
+#include <string.h>
+
+#define ANIMATION_WORLD_BATCH_SIZE  16
+#define ANIMATION_WORLD_REBUILD     1.5f    // the bvh is rebuilt once refits made it this much worse
+
+int createAnimationWorld(AnimationWorld* world, JobPool* jobs)
+{
+    world->instances = NULL;
+    world->instance_count = 0;
+    world->instance_capacity = 0;
+
+    world->palettes = NULL;
+    world->palette_count = 0;
+    world->palette_capacity = 0;
+
+    world->pose_cache = NULL;
+    world->dq_palettes = NULL;
+
+    world->bounds = NULL;
+    memset(&world->bvh, 0, sizeof(BVH));
+    world->bvh_dirty = 1;
+
+    world->visible = NULL;
+    world->visible_count = 0;
+
+    world->has_view = 0;
+    world->joints_evaluated = 0;
+    world->joints_saved = 0;
+    world->dq_lerp_fallbacks = 0;
+
+    world->jobs = jobs;
+    world->batch_size = ANIMATION_WORLD_BATCH_SIZE;
+
+    world->keys = NULL;
+    world->key_capacity = 0;
+
+    world->update_time = 0.0;
+    return IGNIS_SUCCESS;
+}
+
+void destroyAnimationWorld(AnimationWorld* world)
+{
+    if (world->instances) free(world->instances);
+    if (world->palettes)  free(world->palettes);
+    if (world->pose_cache) free(world->pose_cache);
+    if (world->dq_palettes) free(world->dq_palettes);
+    if (world->bounds)  free(world->bounds);
+    if (world->visible) free(world->visible);
+    if (world->keys)    free(world->keys);
+    destroyBVH(&world->bvh);
+
+    world->instances = NULL;
+    world->palettes = NULL;
+    world->pose_cache = NULL;
+    world->dq_palettes = NULL;
+    world->bounds = NULL;
+    world->visible = NULL;
+    world->keys = NULL;
+    world->key_capacity = 0;
+    clearAnimationWorld(world);
+}
+
+void clearAnimationWorld(AnimationWorld* world)
+{
+    world->instance_count = 0;
+    world->palette_count = 0;
+    world->visible_count = 0;
+    world->bvh_dirty = 1;
+}
+
+/* The draws place every mesh with its node transform on top of the instance transform */
+static aabb getInstanceWorldBounds(const AnimationInstance* instance)
+{
+    const Model* model = instance->model;
+    if (!model->instance_count) return aabb_transform(instance->bounds, instance->transform);
+
+    aabb bounds = aabb_empty();
+    for (size_t i = 0; i < model->instance_count; ++i)
+        bounds = aabb_merge(bounds, aabb_transform(instance->bounds, model->transforms[i]));
+
+    return aabb_transform(bounds, instance->transform);
+}
+
+int addAnimationInstance(AnimationWorld* world, const Model* model, const Animation* clip, mat4 transform)
+{
+    if (!model->joint_count) return IGNIS_FAILURE;
+
+    if (world->instance_count >= world->instance_capacity)
+    {
+        size_t capacity = world->instance_capacity ? world->instance_capacity * 2 : 64;
+        AnimationInstance* instances = realloc(world->instances, capacity * sizeof(AnimationInstance));
+        if (!instances) return IGNIS_FAILURE;
+
+        world->instances = instances;
+
+        aabb* bounds = realloc(world->bounds, capacity * sizeof(aabb));
+        if (!bounds) return IGNIS_FAILURE;
+        world->bounds = bounds;
+
+        uint32_t* visible = realloc(world->visible, capacity * sizeof(uint32_t));
+        if (!visible) return IGNIS_FAILURE;
+        world->visible = visible;
+
+        world->instance_capacity = capacity;
+    }
+
+    if (world->palette_count + model->joint_count > world->palette_capacity)
+    {
+        size_t capacity = world->palette_capacity ? world->palette_capacity : 1024;
+        while (capacity < world->palette_count + model->joint_count) capacity *= 2;
+
+        mat4x3* palettes = realloc(world->palettes, capacity * sizeof(mat4x3));
+        if (!palettes) return IGNIS_FAILURE;
+        world->palettes = palettes;
+
+        mat4x3* pose_cache = realloc(world->pose_cache, 2 * capacity * sizeof(mat4x3));
+        if (!pose_cache) return IGNIS_FAILURE;
+        world->pose_cache = pose_cache;
+
+        float* dq_palettes = realloc(world->dq_palettes, capacity * JOINT_PALETTE_DQ_ROWS * 4 * sizeof(float));
+        if (!dq_palettes) return IGNIS_FAILURE;
+        world->dq_palettes = dq_palettes;
+
+        world->palette_capacity = capacity;
+    }
+
+    AnimationInstance* instance = &world->instances[world->instance_count++];
+    instance->model = model;
+    setAnimationBlend(&instance->blend, clip);
+    instance->speed = 1.0f;
+    instance->transform = transform;
+    instance->palette_offset = world->palette_count;
+    instance->lod_interval = 1;
+    instance->lod_frame = 0;
+    instance->joints_evaluated = 0;
+    instance->dq_valid = 0;
+    instance->dq_scale = 1.0f;
+
+    world->palette_count += model->joint_count;
+
+    getBindPose(model, &world->palettes[instance->palette_offset]);
+    instance->bounds = getSkinnedBounds(model, &world->palettes[instance->palette_offset]);
+
+    world->bounds[world->instance_count - 1] = getInstanceWorldBounds(instance);
+    world->bvh_dirty = 1;
+    return IGNIS_SUCCESS;
+}
+
+void setAnimationWorldView(AnimationWorld* world, mat4 view_proj, vec3 eye)
+{
+    world->frustum = frustum_extract(view_proj);
+    world->eye = eye;
+    world->has_view = 1;
+}
+
+static void buildAnimationWorldBVH(AnimationWorld* world)
+{
+    world->bvh_dirty = !buildBVH(&world->bvh, world->bounds, world->instance_count, world->jobs);
+}
+
+typedef struct
+{
+    AnimationWorld* world;
+    float deltatime;
+} AnimationWorldTick;
+
+static float getInstanceScale(mat4 m)
+{
+    float x = vec3_length((vec3){ m.v[0][0], m.v[0][1], m.v[0][2] });
+    float y = vec3_length((vec3){ m.v[1][0], m.v[1][1], m.v[1][2] });
+    float z = vec3_length((vec3){ m.v[2][0], m.v[2][1], m.v[2][2] });
+    return fmaxf(x, fmaxf(y, z));
+}
+
+/* Grows the key scratch to the clip with the most timelines, so ticks never allocate keys */
+static void reserveAnimationKeys(AnimationWorld* world)
+{
+    size_t capacity = world->key_capacity;
+    for (size_t i = 0; i < world->instance_count; ++i)
+    {
+        const AnimationBlend* blend = &world->instances[i].blend;
+        for (size_t l = 0; l < blend->count; ++l)
+        {
+            if (blend->layers[l].clip->timeline_count > capacity)
+                capacity = blend->layers[l].clip->timeline_count;
+        }
+    }
+
+    if (capacity <= world->key_capacity) return;
+
+    size_t threads = jobPoolThreadCount(world->jobs);
+    AnimationKey* keys = realloc(world->keys, threads * ANIMATION_BLEND_LAYERS * capacity * sizeof(AnimationKey));
+    if (!keys) return;
+
+    world->keys = keys;
+    world->key_capacity = capacity;
+}
+
+static void tickAnimationInstance(AnimationWorld* world, AnimationInstance* instance, float deltatime, uint32_t thread)
+{
+    const Model* model = instance->model;
+    AnimationKey* keys = world->keys ? &world->keys[thread * ANIMATION_BLEND_LAYERS * world->key_capacity] : NULL;
+    const AnimationLOD* lod = &model->lod;
+    mat4x3* palette = &world->palettes[instance->palette_offset];
+
+    if (!instance->blend.count)
+    {
+        getBindPose(model, palette);
+        instance->joints_evaluated = 0;
+        return;
+    }
+
+    float step = deltatime * instance->speed;
+    tickAnimationBlend(&instance->blend, step);
+
+    if (!lod->enabled || !world->has_view)
+    {
+        instance->lod_interval = 1;
+        instance->joints_evaluated = sampleAnimationBlendLOD(model, &instance->blend, 0.0f, 0, keys, world->key_capacity, palette);
+        return;
+    }
+
+    // bounding sphere of the instance
+    vec3 center = vec3_mult(vec3_add(model->min, model->max), 0.5f);
+    float radius = vec3_length(vec3_sub(model->max, center)) * getInstanceScale(instance->transform);
+    center = mat4_transform_point(instance->transform, center);
+
+    if (lod->freeze_culled && !frustum_test_sphere(&world->frustum, center, radius))
+    {
+        // keep the last pose, time keeps running
+        instance->lod_interval = 1;
+        instance->joints_evaluated = 0;
+        return;
+    }
+
+    float distance = vec3_length(vec3_sub(center, world->eye));
+
+    uint32_t interval = 1;
+    for (uint32_t i = 0; i < ANIMATION_LOD_LEVELS; ++i)
+    {
+        if (lod->update_distances[i] > 0.0f && distance > lod->update_distances[i])
+            interval = 2u << i;
+    }
+
+    uint8_t min_height = (lod->leaf_distance > 0.0f && distance > lod->leaf_distance) ? lod->leaf_height : 0;
+
+    if (interval == 1)
+    {
+        instance->lod_interval = 1;
+        instance->joints_evaluated = sampleAnimationBlendLOD(model, &instance->blend, 0.0f, min_height, keys, world->key_capacity, palette);
+        return;
+    }
+
+    // sample ahead and interpolate between the two cached poses
+    mat4x3* prev = &world->pose_cache[2 * instance->palette_offset];
+    mat4x3* next = prev + model->joint_count;
+
+    instance->joints_evaluated = 0;
+    if (instance->lod_interval != interval)
+    {
+        instance->joints_evaluated += sampleAnimationBlendLOD(model, &instance->blend, 0.0f, min_height, keys, world->key_capacity, prev);
+        instance->lod_frame = interval;
+    }
+
+    if (instance->lod_frame >= interval)
+    {
+        if (instance->lod_interval == interval)
+            memcpy(prev, next, model->joint_count * sizeof(mat4x3));
+
+        instance->joints_evaluated += sampleAnimationBlendLOD(model, &instance->blend, step * interval, min_height, keys, world->key_capacity, next);
+        instance->lod_frame = 0;
+    }
+
+    instance->lod_interval = interval;
+
+    float alpha = (float)instance->lod_frame / (float)interval;
+    for (size_t i = 0; i < model->joint_count; ++i)
+        palette[i] = mat4x3_lerp(prev[i], next[i], alpha);
+
+    instance->lod_frame++;
+}
+
+static void updateInstanceDQ(AnimationWorld* world, AnimationInstance* instance)
+{
+    const Model* model = instance->model;
+    if (model->skinning != SKINNING_DUAL_QUAT)
+    {
+        instance->dq_valid = 0;
+        return;
+    }
+
+    // frozen instances keep their last pose
+    if (instance->dq_valid && !instance->joints_evaluated && instance->lod_interval == 1) return;
+
+    const mat4x3* palette = &world->palettes[instance->palette_offset];
+    float* dq = &world->dq_palettes[instance->palette_offset * JOINT_PALETTE_DQ_ROWS * 4];
+    instance->dq_valid = getJointPaletteDQ(palette, model->joint_count, dq, &instance->dq_scale);
+}
+
+static void tickAnimationInstances(void* data, size_t begin, size_t end, uint32_t thread)
+{
+    AnimationWorldTick* tick = data;
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        AnimationInstance* instance = &tick->world->instances[i];
+
+        tickAnimationInstance(tick->world, instance, tick->deltatime, thread);
+        updateInstanceDQ(tick->world, instance);
+
+        instance->bounds = getSkinnedBounds(instance->model, &tick->world->palettes[instance->palette_offset]);
+        tick->world->bounds[i] = getInstanceWorldBounds(instance);
+    }
+}
+
+void tickAnimationWorld(AnimationWorld* world, float deltatime)
+{
+    double start = jobTimerNow();
+
+    reserveAnimationKeys(world);
+
+    AnimationWorldTick tick = { world, deltatime };
+    jobPoolParallelFor(world->jobs, world->instance_count, world->batch_size, tickAnimationInstances, &tick);
+
+    world->joints_evaluated = 0;
+    world->joints_saved = 0;
+    world->dq_lerp_fallbacks = 0;
+    for (size_t i = 0; i < world->instance_count; ++i)
+    {
+        const AnimationInstance* instance = &world->instances[i];
+        size_t joint_count = instance->model->joint_count;
+        size_t evaluated = instance->joints_evaluated;
+
+        world->joints_evaluated += evaluated;
+        world->joints_saved += evaluated < joint_count ? joint_count - evaluated : 0;
+
+        // a lerped palette is not rigid, skinning falls back to linear blending
+        if (instance->model->skinning == SKINNING_DUAL_QUAT && !instance->dq_valid && instance->lod_interval > 1)
+            world->dq_lerp_fallbacks++;
+    }
+
+    // instances move a little every frame, refitting keeps the tree valid until it gets too loose
+    if (!world->bvh_dirty) refitBVH(&world->bvh, world->bounds);
+    if (world->bvh_dirty || world->bvh.cost > world->bvh.build_cost * ANIMATION_WORLD_REBUILD)
+        buildAnimationWorldBVH(world);
+
+    world->update_time = jobTimerNow() - start;
+}
+
+const mat4x3* getAnimationInstancePalette(const AnimationWorld* world, size_t index)
+{
+    if (index >= world->instance_count) return NULL;
+    return &world->palettes[world->instances[index].palette_offset];
+}
+
+size_t cullAnimationWorld(AnimationWorld* world, const frustum* f)
+{
+    if (world->bvh_dirty)
+        buildAnimationWorldBVH(world);
+
+    if (f && !world->bvh_dirty)
+    {
+        world->visible_count = cullBVH(&world->bvh, f, world->visible);
+        return world->visible_count;
+    }
+
+    for (size_t i = 0; i < world->instance_count; ++i)
+        world->visible[i] = (uint32_t)i;
+
+    world->visible_count = world->instance_count;
+    return world->visible_count;
+}
+
+int pickAnimationInstance(AnimationWorld* world, vec3 origin, vec3 dir, size_t* index)
+{
+    if (world->bvh_dirty)
+        buildAnimationWorldBVH(world);
+
+    uint32_t item = 0;
+    if (world->bvh_dirty || !raycastBVH(&world->bvh, origin, dir, INFINITY, &item, NULL)) return 0;
+
+    *index = item;
+    return 1;
+}
+
+aabb getSkinnedBounds(const Model* model, const mat4x3* palette)
+{
+    aabb bounds = aabb_empty();
+    if (!model->joint_bounds) return (aabb){ model->min, model->max };
+
+    for (size_t i = 0; i < model->joint_count; ++i)
+    {
+        if (aabb_is_empty(model->joint_bounds[i])) continue;
+        bounds = aabb_merge(bounds, aabb_transform(model->joint_bounds[i], mat4x3_to_mat4(palette[i])));
+    }
+    return bounds;
+}
@@ -27,18 +27,38 @@ NK_SHADER_VERSION
 "   Out_Color = Frag_Color * texture(Texture, Frag_UV.st);\n"
 "}\n";
 
+/* resolved once the program is linked, the ui is not drawn before */
+static GLint uniform_proj = -1;
+static int program_ready = 0;
+
+static void nk_glfw3_program_ready(GLuint program)
+{
+    ignisSetUniformil(program, ignisGetUniformLocation(program, "Texture"), 0);
+    uniform_proj = ignisGetUniformLocation(program, "ProjMtx");
+    program_ready = 1;
+}
+
 NK_API int
-nk_glfw3_init(struct nk_glfw* glfw, MinimalWindow* win)
+nk_glfw3_init(struct nk_glfw* glfw, MinimalWindow* win, ShaderCache* cache)
 {
     glfw->win = win;
+    glfw->stream = NULL;
 
     nk_init_default(&glfw->ctx, 0);
     nk_buffer_init_default(&glfw->cmds);
+    nk_buffer_init_default(&glfw->vbuf);
+    nk_buffer_init_default(&glfw->ebuf);
 
-    glfw->prog = ignisCreateShaderSrcvf(vertex_shader, fragment_shader);
-
-    glfw->uniform_tex = ignisGetUniformLocation(glfw->prog, "Texture");
-    glfw->uniform_proj = ignisGetUniformLocation(glfw->prog, "ProjMtx");
+    program_ready = 0;
+    if (cache)
+    {
+        loadShaderVariantSrc(cache, &glfw->prog, vertex_shader, fragment_shader, NULL, nk_glfw3_program_ready, "nuklear");
+    }
+    else
+    {
+        glfw->prog = ignisCreateShaderSrcvf(vertex_shader, fragment_shader);
+        if (glfw->prog) nk_glfw3_program_ready(glfw->prog);
+    }
 
     /* buffer setup */
     IgnisBufferElement layout[] = {
@@ -83,6 +103,8 @@ void nk_glfw3_shutdown(struct nk_glfw* glfw)
     ignisDeleteShader(glfw->prog);
     ignisDeleteVertexArray(&glfw->vao);
     nk_buffer_free(&glfw->cmds);
+    nk_buffer_free(&glfw->vbuf);
+    nk_buffer_free(&glfw->ebuf);
 
     nk_free(&glfw->ctx);
 }
@@ -189,22 +211,62 @@ nk_glfw3_new_frame(struct nk_glfw* glfw, float deltatime)
 NK_API void
 nk_glfw3_render(struct nk_glfw* glfw, const float* proj)
 {
+    /* still linking or failed to link, the commands of this frame are dropped */
+    if (!glfw->prog || !program_ready)
+    {
+        nk_clear(&glfw->ctx);
+        nk_buffer_clear(&glfw->cmds);
+        return;
+    }
+
     /* convert from command queue into draw list and draw to screen */
-    /* allocate vertex and element buffer */
     ignisBindVertexArray(&glfw->vao);
 
-    /* load draw vertices & elements directly into vertex + element buffer */
-    void* vertices = ignisMapBuffer(&glfw->vao.buffers[0], GL_WRITE_ONLY);
-    void* elements = ignisMapBuffer(&glfw->vao.buffers[1], GL_WRITE_ONLY);
+    /* convert into the staging buffers, only what was used is copied to the gpu */
+    nk_buffer_clear(&glfw->vbuf);
+    nk_buffer_clear(&glfw->ebuf);
+    nk_convert(&glfw->ctx, &glfw->cmds, &glfw->vbuf, &glfw->ebuf, &glfw->config);
+
+    size_t vertex_size = glfw->vbuf.allocated;
+    size_t element_size = glfw->ebuf.allocated;
+
+    /* load draw vertices & elements into the stream or into the own buffers */
+    GLuint vertex_buffer = glfw->vao.buffers[0].name;
+    GLuint element_buffer = glfw->vao.buffers[1].name;
+    size_t vertex_offset = 0, element_offset = 0;
+
+    void* vertices = NULL;
+    void* elements = NULL;
+    if (glfw->stream)
     {
-        /* setup buffers to load vertices and elements */
-        struct nk_buffer vbuf, ebuf;
-        nk_buffer_init_fixed(&vbuf, vertices, (size_t)MAX_VERTEX_BUFFER);
-        nk_buffer_init_fixed(&ebuf, elements, (size_t)MAX_ELEMENT_BUFFER);
-        nk_convert(&glfw->ctx, &glfw->cmds, &vbuf, &ebuf, &glfw->config);
+        vertices = streamBufferAlloc(glfw->stream, vertex_size, 16, &vertex_offset);
+        elements = vertices ? streamBufferAlloc(glfw->stream, element_size, 16, &element_offset) : NULL;
     }
-    ignisUnmapBuffer(&glfw->vao.buffers[0]);
-    ignisUnmapBuffer(&glfw->vao.buffers[1]);
+
+    if (vertices && elements)
+    {
+        nk_memcopy(vertices, glfw->vbuf.memory.ptr, vertex_size);
+        nk_memcopy(elements, glfw->ebuf.memory.ptr, element_size);
+        vertex_buffer = element_buffer = glfw->stream->name;
+    }
+    else
+    {
+        if (vertices) streamBufferShrink(glfw->stream, vertex_offset, 0);
+        vertex_offset = element_offset = 0;
+
+        /* orphans the previous contents, the buffers grow with the ui */
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertex_size, glfw->vbuf.memory.ptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)element_size, glfw->ebuf.memory.ptr, GL_STREAM_DRAW);
+    }
+
+    /* the vertex array points at whichever buffer was written this frame */
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 20, (const void*)(vertex_offset + 0));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 20, (const void*)(vertex_offset + 8));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, 20, (const void*)(vertex_offset + 16));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
 
     int width, height;
     minimalGetFramebufferSize(glfw->win, &width, &height);
@@ -225,12 +287,11 @@ nk_glfw3_render(struct nk_glfw* glfw, const float* proj)
 
     /* setup program */
     ignisUseShader(glfw->prog);
-    ignisSetUniformil(glfw->prog, glfw->uniform_tex, 0);
-    ignisSetUniformMat4l(glfw->prog, glfw->uniform_proj, 1, proj);
+    ignisSetUniformMat4l(glfw->prog, uniform_proj, 1, proj);
 
 
     /* iterate over and execute each draw command */
-    nk_size offset = 0;
+    nk_size offset = element_offset;
     const struct nk_draw_command* cmd;
     nk_draw_foreach(cmd, &glfw->ctx, &glfw->cmds)
     {
@@ -18,6 +18,9 @@
 #include <ignis/ignis.h>
 #include <minimal.h>
 
+#include "stream_buffer.h"
+#include "shader_cache.h"
+
 #ifndef NK_GLFW_TEXT_MAX
 #define NK_GLFW_TEXT_MAX 256
 #endif
@@ -29,11 +32,12 @@ struct nk_glfw {
     MinimalWindow *win;
 
     struct nk_buffer cmds;
+    struct nk_buffer vbuf;  /* converted vertices and elements, copied out with their used size */
+    struct nk_buffer ebuf;
 
     IgnisShader prog;
     IgnisVertexArray vao;
-    GLint uniform_tex;
-    GLint uniform_proj;
+    StreamBuffer* stream;   /* optional, vertices and elements are streamed into it unless it is full */
 
     struct nk_context ctx;
     IgnisFontAtlas atlas;
@@ -45,7 +49,7 @@ struct nk_glfw {
     struct nk_vec2 scroll;
 };
 
-NK_API int  nk_glfw3_init(struct nk_glfw* glfw, MinimalWindow* win);
+NK_API int  nk_glfw3_init(struct nk_glfw* glfw, MinimalWindow* win, ShaderCache* cache);
 NK_API void nk_glfw3_shutdown(struct nk_glfw* glfw);
 NK_API void nk_glfw3_load_font_atlas(struct nk_glfw* glfw);
 NK_API void nk_glfw3_new_frame(struct nk_glfw* glfw, float deltatime);
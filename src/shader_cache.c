@@ -0,0 +1,424 @@
+#include "shader_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// the directory leaves room for the file name, the buffers are sized for the compiler to see that
+#define SHADER_BINARY_PATH_MAX  (SHADER_CACHE_PATH_MAX + 32)
+
+#define SHADER_HASH_SEED    0xcbf29ce484222325ull
+#define SHADER_HASH_PRIME   0x100000001b3ull
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+} ShaderFileHeader;
+
+// fnv-1a, the terminator is hashed as well so "ab" + "c" differs from "a" + "bc"
+static uint64_t hashString(uint64_t hash, const char* str)
+{
+    if (!str) str = "";
+    do
+    {
+        hash ^= (uint8_t)*str;
+        hash *= SHADER_HASH_PRIME;
+    } while (*str++);
+
+    return hash;
+}
+
+static int hasExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if (extension && strcmp(extension, name) == 0) return 1;
+    }
+    return 0;
+}
+
+int createShaderCache(ShaderCache* cache, const char* directory)
+{
+    memset(cache, 0, sizeof(ShaderCache));
+
+    if (directory && strlen(directory) + 32 < SHADER_CACHE_PATH_MAX)
+        strcpy(cache->directory, directory);
+    else if (directory)
+        IGNIS_WARN("SHADER: [%s] Cache directory path is too long", directory);
+
+    // a driver update invalidates every binary
+    cache->driver_hash = SHADER_HASH_SEED;
+    cache->driver_hash = hashString(cache->driver_hash, (const char*)glGetString(GL_VENDOR));
+    cache->driver_hash = hashString(cache->driver_hash, (const char*)glGetString(GL_RENDERER));
+    cache->driver_hash = hashString(cache->driver_hash, (const char*)glGetString(GL_VERSION));
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    cache->binaries = formats > 0;
+
+    cache->parallel = hasExtension("GL_KHR_parallel_shader_compile") || hasExtension("GL_ARB_parallel_shader_compile");
+
+    return IGNIS_SUCCESS;
+}
+
+void destroyShaderCache(ShaderCache* cache)
+{
+    finishShaderVariants(cache, 1);
+    free(cache->pending);
+    memset(cache, 0, sizeof(ShaderCache));
+}
+
+// ----------------------------------------------------------------
+// program binaries
+// ----------------------------------------------------------------
+static void getBinaryPath(const ShaderCache* cache, uint64_t key, char* path, size_t size)
+{
+    snprintf(path, size, "%s%016llx.bin", cache->directory, (unsigned long long)key);
+}
+
+static GLuint loadProgramBinary(const ShaderCache* cache, uint64_t key)
+{
+    if (!cache->directory[0] || !cache->binaries) return 0;
+
+    char path[SHADER_BINARY_PATH_MAX];
+    getBinaryPath(cache, key, path, sizeof(path));
+
+    // a missing file is the usual cold start, not worth an error
+    FILE* file = fopen(path, "rb");
+    if (!file) return 0;
+
+    ShaderFileHeader header;
+    void* data = NULL;
+    int valid = fread(&header, sizeof(header), 1, file) == 1
+             && header.magic == SHADER_CACHE_MAGIC && header.version == SHADER_CACHE_VERSION
+             && header.key == key && header.length > 0;
+
+    if (valid)
+    {
+        data = malloc(header.length);
+        valid = data && fread(data, 1, header.length, file) == header.length;
+    }
+    fclose(file);
+
+    GLuint program = 0;
+    if (valid)
+    {
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, data, (GLsizei)header.length);
+
+        // the driver may still reject binaries of an older build
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status != GL_TRUE)
+        {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+    free(data);
+    return program;
+}
+
+static void saveProgramBinary(const ShaderCache* cache, const ShaderVariant* variant)
+{
+    if (!cache->directory[0] || !cache->binaries) return;
+
+    GLint length = 0;
+    glGetProgramiv(variant->program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    void* data = malloc(length);
+    if (!data) return;
+
+    ShaderFileHeader header = { SHADER_CACHE_MAGIC, SHADER_CACHE_VERSION, variant->key, 0, 0 };
+
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(variant->program, length, &written, &format, data);
+    header.format = format;
+    header.length = (uint32_t)written;
+
+    char path[SHADER_BINARY_PATH_MAX];
+    getBinaryPath(cache, variant->key, path, sizeof(path));
+
+    FILE* file = fopen(path, "wb");
+    if (file)
+    {
+        if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(data, 1, written, file) != (size_t)written)
+            IGNIS_WARN("SHADER: [%s] Failed to write program binary", path);
+        fclose(file);
+    }
+    else
+    {
+        IGNIS_WARN("SHADER: [%s] Failed to open file for writing", path);
+    }
+
+    free(data);
+}
+
+// ----------------------------------------------------------------
+// variants
+// ----------------------------------------------------------------
+static char* getDefineBlock(const char* defines, int line)
+{
+    // every name gains "#define " and a line break, the block ends with a #line directive
+    size_t length = defines ? strlen(defines) : 0;
+    char* block = malloc(length * 10 + 32);
+    if (!block) return NULL;
+
+    char* dst = block;
+    const char* src = defines;
+    while (src && *src)
+    {
+        while (*src == ' ') src++;
+        if (!*src) break;
+
+        memcpy(dst, "#define ", 8);
+        dst += 8;
+
+        // NAME=VALUE becomes NAME VALUE
+        for (; *src && *src != ' '; ++src)
+            *dst++ = *src == '=' ? ' ' : *src;
+        *dst++ = '\n';
+    }
+
+    // keep the line numbers of compile errors pointing into the file
+    sprintf(dst, "#line %d\n", line);
+    return block;
+}
+
+static GLuint compileStage(GLenum type, const char* source, const char* defines)
+{
+    // the defines have to come after the version directive
+    const char* body = source;
+    int line = 1;
+    if (strncmp(source, "#version", 8) == 0)
+    {
+        const char* end = strchr(source, '\n');
+        body = end ? end + 1 : source + strlen(source);
+        line = 2;
+    }
+
+    char* block = getDefineBlock(defines, line);
+    if (!block) return 0;
+
+    const GLchar* sources[3] = { source, block, body };
+    GLint lengths[3] = { (GLint)(body - source), -1, -1 };
+
+    // the status is checked once the program is linked, asking now would block
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 3, sources, lengths);
+    glCompileShader(shader);
+
+    free(block);
+    return shader;
+}
+
+static ShaderVariant* reserveShaderVariant(ShaderCache* cache)
+{
+    if (cache->pending_count >= cache->pending_capacity)
+    {
+        size_t capacity = cache->pending_capacity ? cache->pending_capacity * 2 : 8;
+        ShaderVariant* pending = realloc(cache->pending, capacity * sizeof(ShaderVariant));
+        if (!pending) return NULL;
+
+        cache->pending = pending;
+        cache->pending_capacity = capacity;
+    }
+
+    return &cache->pending[cache->pending_count++];
+}
+
+static int loadVariant(ShaderCache* cache, GLuint* handle, const GLenum types[2], const char* sources[2], const char* defines, ShaderReadyFunc ready, const char* name)
+{
+    // the stage type is part of the key, so a compute and a vertex shader of the same source differ
+    uint64_t key = cache->driver_hash;
+    for (int i = 0; i < 2; ++i)
+    {
+        key = (key ^ types[i]) * SHADER_HASH_PRIME;
+        key = hashString(key, sources[i]);
+    }
+    key = hashString(key, defines);
+
+    GLuint program = loadProgramBinary(cache, key);
+    if (program)
+    {
+        cache->hits++;
+        *handle = program;
+        if (ready) ready(program);
+        return IGNIS_SUCCESS;
+    }
+
+    ShaderVariant* variant = reserveShaderVariant(cache);
+    if (!variant) return IGNIS_FAILURE;
+
+    program = glCreateProgram();
+    for (int i = 0; i < 2; ++i)
+    {
+        variant->types[i] = types[i];
+        variant->stages[i] = types[i] ? compileStage(types[i], sources[i], defines) : 0;
+        if (variant->stages[i]) glAttachShader(program, variant->stages[i]);
+    }
+
+    variant->handle = handle;
+    variant->key = key;
+    variant->ready = ready;
+    snprintf(variant->name, sizeof(variant->name), "%s", name ? name : "");
+
+    if (cache->binaries && cache->directory[0])
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    glLinkProgram(program);
+    variant->program = program;
+
+    *handle = program;
+    return IGNIS_SUCCESS;
+}
+
+static void getVariantName(char* name, size_t size, const char* path, const char* defines)
+{
+    snprintf(name, size, "%s%s%s", path, defines ? " " : "", defines ? defines : "");
+}
+
+int loadShaderVariantSrc(ShaderCache* cache, GLuint* handle, const char* vert_src, const char* frag_src, const char* defines, ShaderReadyFunc ready, const char* name)
+{
+    const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    const char* sources[2] = { vert_src, frag_src };
+
+    *handle = 0;
+    return loadVariant(cache, handle, types, sources, defines, ready, name);
+}
+
+int loadShaderVariant(ShaderCache* cache, GLuint* handle, const char* vert, const char* frag, const char* defines, ShaderReadyFunc ready)
+{
+    size_t size = 0;
+    char* vert_src = ignisReadFile(vert, &size);
+    char* frag_src = ignisReadFile(frag, &size);
+
+    char name[64];
+    getVariantName(name, sizeof(name), vert, defines);
+
+    int result = IGNIS_FAILURE;
+    *handle = 0;
+    if (vert_src && frag_src)
+        result = loadShaderVariantSrc(cache, handle, vert_src, frag_src, defines, ready, name);
+
+    free(vert_src);
+    free(frag_src);
+    return result;
+}
+
+int loadComputeVariant(ShaderCache* cache, GLuint* handle, const char* comp, const char* defines, ShaderReadyFunc ready)
+{
+    size_t size = 0;
+    char* comp_src = ignisReadFile(comp, &size);
+
+    char name[64];
+    getVariantName(name, sizeof(name), comp, defines);
+
+    const GLenum types[2] = { GL_COMPUTE_SHADER, 0 };
+    const char* sources[2] = { comp_src, NULL };
+
+    int result = IGNIS_FAILURE;
+    *handle = 0;
+    if (comp_src)
+        result = loadVariant(cache, handle, types, sources, defines, ready, name);
+
+    free(comp_src);
+    return result;
+}
+
+static const char* getStageName(GLenum type)
+{
+    switch (type)
+    {
+    case GL_VERTEX_SHADER:      return "vertex";
+    case GL_FRAGMENT_SHADER:    return "fragment";
+    case GL_COMPUTE_SHADER:     return "compute";
+    default:                    return "unknown";
+    }
+}
+
+static void logShaderErrors(const ShaderVariant* variant)
+{
+    char log[512];
+    for (int i = 0; i < 2; ++i)
+    {
+        if (!variant->types[i]) continue;
+
+        GLint status = GL_FALSE;
+        if (variant->stages[i]) glGetShaderiv(variant->stages[i], GL_COMPILE_STATUS, &status);
+        if (status == GL_TRUE) continue;
+
+        log[0] = '\0';
+        if (variant->stages[i]) glGetShaderInfoLog(variant->stages[i], sizeof(log), NULL, log);
+        IGNIS_ERROR("SHADER: [%s] Failed to compile %s shader: %s", variant->name, getStageName(variant->types[i]), log);
+    }
+
+    glGetProgramInfoLog(variant->program, sizeof(log), NULL, log);
+    IGNIS_ERROR("SHADER: [%s] Failed to link program: %s", variant->name, log);
+}
+
+static void finishShaderVariant(ShaderCache* cache, const ShaderVariant* variant)
+{
+    GLint status = GL_FALSE;
+    glGetProgramiv(variant->program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) logShaderErrors(variant);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (!variant->stages[i]) continue;
+        glDetachShader(variant->program, variant->stages[i]);
+        glDeleteShader(variant->stages[i]);
+    }
+
+    // the owner only ever sees a program that works or 0
+    if (status != GL_TRUE)
+    {
+        glDeleteProgram(variant->program);
+        if (*variant->handle == variant->program) *variant->handle = 0;
+        cache->failed++;
+        return;
+    }
+
+    cache->compiled++;
+    if (variant->ready) variant->ready(variant->program);
+    saveProgramBinary(cache, variant);
+}
+
+size_t finishShaderVariants(ShaderCache* cache, int wait)
+{
+    size_t remaining = 0;
+    for (size_t i = 0; i < cache->pending_count; ++i)
+    {
+        const ShaderVariant* variant = &cache->pending[i];
+
+        // without the extension there is no way to ask, so every variant is waited for
+        if (!wait && cache->parallel)
+        {
+            GLint done = GL_FALSE;
+            glGetProgramiv(variant->program, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+            {
+                cache->pending[remaining++] = *variant;
+                continue;
+            }
+        }
+
+        finishShaderVariant(cache, variant);
+    }
+
+    cache->pending_count = remaining;
+    return remaining;
+}
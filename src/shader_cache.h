@@ -0,0 +1,71 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <ignis/ignis.h>
+
+/*
+ * Builds shader variants from a vertex and fragment source, or a compute
+ * source, and a set of defines. Linked programs are stored on disk with
+ * glGetProgramBinary and keyed by the sources, the defines and the driver,
+ * so warm starts skip compiling entirely. Programs that have to be compiled are linked on the
+ * driver's compiler threads (KHR_parallel_shader_compile) and only waited
+ * for in finishShaderVariants.
+ */
+#define SHADER_CACHE_MAGIC      0x43485347  /* "GSHC" */
+#define SHADER_CACHE_VERSION    1
+#define SHADER_CACHE_PATH_MAX   256
+
+/* Called once the program is linked, e.g. to bind uniform blocks */
+typedef void (*ShaderReadyFunc)(GLuint program);
+
+typedef struct
+{
+    GLuint program;
+    GLuint* handle;     /* set to 0 if the program fails to link */
+    GLenum types[2];    /* 0 for unused stages */
+    GLuint stages[2];
+    uint64_t key;
+    ShaderReadyFunc ready;
+    char name[64];  /* for error messages */
+} ShaderVariant;
+
+typedef struct
+{
+    char directory[SHADER_CACHE_PATH_MAX];  /* empty to disable the disk cache */
+    uint64_t driver_hash;
+    int binaries;   /* the driver has at least one program binary format */
+    int parallel;   /* link status can be polled without blocking */
+
+    ShaderVariant* pending;
+    size_t pending_count;
+    size_t pending_capacity;
+
+    size_t hits;        /* programs loaded from disk */
+    size_t compiled;    /* programs compiled from source */
+    size_t failed;      /* programs that did not link */
+} ShaderCache;
+
+/* directory may be NULL, it has to exist and end with a separator */
+int  createShaderCache(ShaderCache* cache, const char* directory);
+void destroyShaderCache(ShaderCache* cache);
+
+/*
+ * defines is a space separated list like "SKINNING DQ=1" and may be NULL.
+ * The program is written to handle right away, it can only be used once ready
+ * has been called. A program that fails to link is deleted and handle is set
+ * to 0 by finishShaderVariants, so handle has to stay valid until then.
+ * Fails if the sources could not be read.
+ */
+int loadShaderVariant(ShaderCache* cache, GLuint* handle, const char* vert, const char* frag, const char* defines, ShaderReadyFunc ready);
+int loadShaderVariantSrc(ShaderCache* cache, GLuint* handle, const char* vert_src, const char* frag_src, const char* defines, ShaderReadyFunc ready, const char* name);
+
+/* Same for a program with a single compute stage */
+int loadComputeVariant(ShaderCache* cache, GLuint* handle, const char* comp, const char* defines, ShaderReadyFunc ready);
+
+/*
+ * Checks programs still linking, wait blocks until all are done.
+ * Returns the number still pending, programs that failed are counted in failed.
+ */
+size_t finishShaderVariants(ShaderCache* cache, int wait);
+
+#endif /* !SHADER_CACHE_H */
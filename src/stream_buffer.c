@@ -0,0 +1,144 @@
+#include "stream_buffer.h"
+
+#define STREAM_BUFFER_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+static int mapStreamBuffer(StreamBuffer* buffer)
+{
+    GLsizeiptr size = (GLsizeiptr)(buffer->frame_size * STREAM_BUFFER_FRAMES);
+
+    glGenBuffers(1, &buffer->name);
+    buffer->generation++;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->name);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, STREAM_BUFFER_FLAGS);
+    buffer->data = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, STREAM_BUFFER_FLAGS);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (!buffer->data)
+    {
+        IGNIS_ERROR("STREAM: Failed to map %zu bytes", (size_t)size);
+        glDeleteBuffers(1, &buffer->name);
+        buffer->name = 0;
+        return IGNIS_FAILURE;
+    }
+
+    return IGNIS_SUCCESS;
+}
+
+static void unmapStreamBuffer(StreamBuffer* buffer)
+{
+    for (int i = 0; i < STREAM_BUFFER_FRAMES; ++i)
+    {
+        if (buffer->fences[i]) glDeleteSync(buffer->fences[i]);
+        buffer->fences[i] = NULL;
+    }
+
+    if (buffer->data)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->name);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    glDeleteBuffers(1, &buffer->name);
+    buffer->name = 0;
+    buffer->data = NULL;
+}
+
+int streamBufferCreate(StreamBuffer* buffer, size_t frame_size)
+{
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &buffer->uniform_alignment);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &buffer->storage_alignment);
+
+    if (!frame_size) frame_size = STREAM_BUFFER_DEFAULT_SIZE;
+
+    // regions start at an offset every binding accepts
+    size_t alignment = (size_t)max(buffer->uniform_alignment, buffer->storage_alignment);
+    buffer->frame_size = (frame_size + alignment - 1) & ~(alignment - 1);
+    buffer->generation = 0;
+    buffer->offset = 0;
+    buffer->frame = 0;
+    buffer->used = 0;
+    buffer->overflow = 0;
+    buffer->stalls = 0;
+
+    for (int i = 0; i < STREAM_BUFFER_FRAMES; ++i)
+        buffer->fences[i] = NULL;
+
+    return mapStreamBuffer(buffer);
+}
+
+void streamBufferDestroy(StreamBuffer* buffer)
+{
+    unmapStreamBuffer(buffer);
+    buffer->frame_size = 0;
+}
+
+static void waitStreamFence(StreamBuffer* buffer, uint32_t region)
+{
+    GLsync fence = buffer->fences[region];
+    if (!fence) return;
+
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED)
+    {
+        buffer->stalls++;
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+
+    glDeleteSync(fence);
+    buffer->fences[region] = NULL;
+}
+
+void streamBufferBegin(StreamBuffer* buffer)
+{
+    // a region that was too small last frame is replaced once the GPU is done with all of them
+    if (buffer->overflow)
+    {
+        size_t frame_size = buffer->frame_size * 2;
+        while (frame_size < buffer->used + buffer->overflow) frame_size *= 2;
+
+        for (uint32_t i = 0; i < STREAM_BUFFER_FRAMES; ++i)
+            waitStreamFence(buffer, i);
+
+        unmapStreamBuffer(buffer);
+        buffer->frame_size = frame_size;
+        buffer->overflow = 0;
+        mapStreamBuffer(buffer);
+    }
+
+    waitStreamFence(buffer, buffer->frame % STREAM_BUFFER_FRAMES);
+    buffer->offset = 0;
+}
+
+void streamBufferEnd(StreamBuffer* buffer)
+{
+    uint32_t region = buffer->frame % STREAM_BUFFER_FRAMES;
+    if (buffer->data) buffer->fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    buffer->used = buffer->offset;
+    buffer->frame++;
+}
+
+void* streamBufferAlloc(StreamBuffer* buffer, size_t size, size_t alignment, size_t* offset)
+{
+    if (!buffer->data) return NULL;
+
+    size_t begin = (buffer->offset + alignment - 1) & ~(alignment - 1);
+    if (begin + size > buffer->frame_size)
+    {
+        buffer->overflow += size;
+        return NULL;
+    }
+
+    buffer->offset = begin + size;
+
+    *offset = (buffer->frame % STREAM_BUFFER_FRAMES) * buffer->frame_size + begin;
+    return buffer->data + *offset;
+}
+
+void streamBufferShrink(StreamBuffer* buffer, size_t offset, size_t size)
+{
+    size_t begin = offset - (buffer->frame % STREAM_BUFFER_FRAMES) * buffer->frame_size;
+    if (begin + size < buffer->offset) buffer->offset = begin + size;
+}
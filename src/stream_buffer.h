@@ -0,0 +1,51 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <ignis/ignis.h>
+
+/*
+ * Persistently mapped ring buffer for data that is written once per frame.
+ * The buffer is split into one region per frame in flight, a fence guards
+ * every region so the CPU only waits if the GPU is STREAM_BUFFER_FRAMES
+ * frames behind. Writes go straight into the coherent mapping.
+ */
+#define STREAM_BUFFER_FRAMES        3
+#define STREAM_BUFFER_DEFAULT_SIZE  (8 * 1024 * 1024)
+
+typedef struct
+{
+    GLuint name;
+    uint32_t generation;    /* changes whenever the buffer is replaced, names can be reused */
+    uint8_t* data;          /* mapping of all regions */
+    size_t frame_size;      /* bytes per region */
+    size_t offset;          /* write head in the current region */
+    uint32_t frame;
+    GLsync fences[STREAM_BUFFER_FRAMES];
+
+    GLint uniform_alignment;
+    GLint storage_alignment;
+
+    size_t used;            /* bytes allocated in the last finished frame */
+    size_t overflow;        /* bytes requested beyond the region, grows the buffer */
+    uint32_t stalls;        /* frames that had to wait for the GPU */
+} StreamBuffer;
+
+/* frame_size == 0 uses STREAM_BUFFER_DEFAULT_SIZE */
+int  streamBufferCreate(StreamBuffer* buffer, size_t frame_size);
+void streamBufferDestroy(StreamBuffer* buffer);
+
+/* Waits until the GPU is done with the next region */
+void streamBufferBegin(StreamBuffer* buffer);
+void streamBufferEnd(StreamBuffer* buffer);
+
+/*
+ * Returns a pointer to size bytes in the current region and their offset
+ * from the start of the buffer. alignment has to be a power of two.
+ * Returns NULL if the region is full, the buffer grows on the next begin.
+ */
+void* streamBufferAlloc(StreamBuffer* buffer, size_t size, size_t alignment, size_t* offset);
+
+/* Gives back the unused end of the latest allocation */
+void streamBufferShrink(StreamBuffer* buffer, size_t offset, size_t size);
+
+#endif /* !STREAM_BUFFER_H */